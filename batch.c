@@ -0,0 +1,198 @@
+/* picoc batch runner - runs many programs on a pool of worker threads.
+ * each worker has its own interpreter which is set up once, snapshotted
+ * and then restored after every job so jobs don't pay for the setup */
+
+#include "picoc.h"
+#include "interpreter.h"
+
+#ifdef UNIX_HOST
+#include <pthread.h>
+
+/* the jobs still waiting for a worker */
+struct BatchQueue
+{
+    pthread_mutex_t Lock;
+    struct PicocBatchJob *Jobs;
+    int NumJobs;
+    int NextJob;
+    int StackSize;
+    int RunScripts;
+};
+
+/* where a worker's output is going */
+struct BatchOutput
+{
+    struct PicocBatchJob *Job;  /* the job that's running */
+    size_t Size;                /* room in its output */
+};
+
+/* the writer a worker's interpreter sends the program's output to. it
+    goes straight on the end of the job's output */
+static void BatchWrite(void *Context, const char *Data, size_t Len)
+{
+    struct BatchOutput *Output = Context;
+    struct PicocBatchJob *Job = Output->Job;
+    char *NewOutput;
+    size_t NewSize;
+
+    if (Job == NULL)
+        return;
+
+    if (Job->OutputLen + Len + 1 > Output->Size) {
+        NewSize = Output->Size ? Output->Size : OUTPUT_BUFFER_SIZE;
+        while (NewSize < Job->OutputLen + Len + 1)
+            NewSize *= 2;
+
+        NewOutput = realloc(Job->Output, NewSize);
+        if (NewOutput == NULL)
+            return;
+
+        Job->Output = NewOutput;
+        Output->Size = NewSize;
+    }
+
+    memcpy(&Job->Output[Job->OutputLen], Data, Len);
+    Job->OutputLen += Len;
+    Job->Output[Job->OutputLen] = '\0';
+}
+
+/* take the next job off the queue, or NULL if they've all been taken */
+static struct PicocBatchJob *BatchNextJob(struct BatchQueue *Queue)
+{
+    struct PicocBatchJob *Job = NULL;
+
+    pthread_mutex_lock(&Queue->Lock);
+    if (Queue->NextJob < Queue->NumJobs)
+        Job = &Queue->Jobs[Queue->NextJob++];
+    pthread_mutex_unlock(&Queue->Lock);
+
+    return Job;
+}
+
+/* run one job, capturing its output, then put the interpreter back the
+    way it was before the job started */
+static void BatchRunJob(Picoc *pc, struct BatchOutput *Output,
+    struct PicocBatchJob *Job, int RunScripts)
+{
+    int ParamCount = 0;
+
+    Job->Output = NULL;
+    Job->OutputLen = 0;
+    Output->Job = Job;
+    Output->Size = 0;
+
+    if (!PicocPlatformSetExitPoint(pc)) {
+        for (; ParamCount < Job->argc && strcmp(Job->argv[ParamCount], "-") != 0;
+                ParamCount++)
+            PicocPlatformScanFile(pc, Job->argv[ParamCount]);
+
+        if (!RunScripts)
+            PicocCallMain(pc, Job->argc - ParamCount, &Job->argv[ParamCount]);
+    }
+
+    Job->ExitValue = pc->PicocExitValue;
+    PicocFlushOutput(pc);
+    Output->Job = NULL;
+
+    /* a job which printed nothing still gets an empty string */
+    if (Job->Output == NULL)
+        Job->Output = calloc(1, 1);
+
+    PicocRestoreSnapshot(pc);
+}
+
+/* a worker thread. it keeps taking jobs until there are none left */
+static void *BatchWorker(void *Arg)
+{
+    struct BatchQueue *Queue = Arg;
+    struct PicocBatchJob *Job;
+    struct BatchOutput Output;
+    Picoc *pc;
+
+    pc = malloc(sizeof(Picoc));
+    if (pc == NULL)
+        return NULL;
+
+    PicocInitialize(pc, Queue->StackSize);
+    Output.Job = NULL;
+    if (PicocPlatformSetExitPoint(pc) || !PicocSetOutput(pc, BatchWrite, &Output)) {
+        PicocCleanup(pc);
+        free(pc);
+        return NULL;
+    }
+
+    if (Queue->RunScripts)
+        PicocIncludeSystemHeadersOnDemand(pc);
+    PicocSnapshot(pc);
+
+    while ((Job = BatchNextJob(Queue)) != NULL)
+        BatchRunJob(pc, &Output, Job, Queue->RunScripts);
+
+    PicocCleanup(pc);
+    free(pc);
+    return NULL;
+}
+
+/* run a batch of jobs on up to NumThreads worker threads. each job's
+    output and exit value are left in the job. if RunScripts is set the
+    jobs are run as scripts, without calling main(). returns the number
+    of jobs which didn't exit with 0 */
+int PicocRunBatch(struct PicocBatchJob *Jobs, int NumJobs, int NumThreads,
+    int StackSize, int RunScripts)
+{
+    struct BatchQueue Queue;
+    pthread_t *Threads;
+    pthread_attr_t Attr;
+    int Started = 0;
+    int Failed = 0;
+    int Count;
+
+    for (Count = 0; Count < NumJobs; Count++) {
+        Jobs[Count].Output = NULL;
+        Jobs[Count].OutputLen = 0;
+        Jobs[Count].ExitValue = 1;
+    }
+
+    pthread_mutex_init(&Queue.Lock, NULL);
+    Queue.Jobs = Jobs;
+    Queue.NumJobs = NumJobs;
+    Queue.NextJob = 0;
+    Queue.StackSize = StackSize;
+    Queue.RunScripts = RunScripts;
+
+    if (NumThreads > NumJobs)
+        NumThreads = NumJobs;
+
+    /* give the workers as much native stack as the main thread gets, so
+        the recursion limit is the same either way */
+    Threads = malloc(sizeof(pthread_t) * (NumThreads > 0 ? NumThreads : 1));
+    pthread_attr_init(&Attr);
+    pthread_attr_setstacksize(&Attr,
+        PlatformNativeStackSize() + NATIVE_STACK_MARGIN);
+
+    if (Threads != NULL) {
+        for (; Started < NumThreads; Started++) {
+            if (pthread_create(&Threads[Started], &Attr, BatchWorker, &Queue) != 0)
+                break;
+        }
+    }
+
+    /* if no threads could be started, do the work here instead */
+    if (Started == 0)
+        BatchWorker(&Queue);
+
+    for (Count = 0; Count < Started; Count++)
+        pthread_join(Threads[Count], NULL);
+
+    pthread_attr_destroy(&Attr);
+    pthread_mutex_destroy(&Queue.Lock);
+    free(Threads);
+
+    for (Count = 0; Count < NumJobs; Count++) {
+        if (Jobs[Count].ExitValue != 0)
+            Failed++;
+    }
+
+    return Failed;
+}
+#endif
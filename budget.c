@@ -0,0 +1,83 @@
+/* picoc execution limits - stop a program which runs too many steps, for
+ * too long or uses too much memory. loops and function calls count down
+ * their thread's BudgetTicks as they go (see BUDGET_CHECKPOINT()), and only
+ * when it runs out are the limits looked at, so the clock is read once
+ * every BUDGET_CHECK_INTERVAL steps rather than on every statement. each
+ * thread adds what it's used to StepsUsed under the lock when it does */
+
+#include "picoc.h"
+#include "interpreter.h"
+
+
+/* set the program's limits, or turn them off with zeroes. the steps and the
+    clock count from now */
+void PicocSetLimits(Picoc *pc, const struct PicocLimits *Limits)
+{
+    pc->Limits = *Limits;
+    pc->StepsUsed = 0;
+    pc->BudgetStart = PlatformClock();
+    pc->MainThread.BudgetGranted = 0;
+    pc->MainThread.BudgetTicks = 0;
+    pc->OverMemLimit = false;
+}
+
+/* an allocation for the program has failed. if it was refused because it
+    would have gone over the memory limit, stop the program here rather
+    than let it carry on with NULL */
+void BudgetCheckMemory(struct ParseState *Parser)
+{
+    if (Parser->pc->OverMemLimit)
+        ProgramFailExit(Parser, PICOC_LIMIT_EXIT, "memory limit exceeded");
+}
+
+/* a thread has finished, count the steps it used since its last check */
+void BudgetThreadEnd(struct ThreadState *Thread)
+{
+    Picoc *pc = Thread->pc;
+
+    ThreadLock(pc);
+    pc->StepsUsed += Thread->BudgetGranted - Thread->BudgetTicks;
+    Thread->BudgetGranted = 0;
+    Thread->BudgetTicks = 0;
+    ThreadUnlock(pc);
+}
+
+/* the ticks have run out - stop the program if it's over a limit, or give
+    it some more */
+void BudgetCheck(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct ThreadState *Thread = THREAD(pc);
+    struct PicocLimits *Limits = &pc->Limits;
+    unsigned long StepsUsed;
+    long Grant = LONG_MAX;
+
+    ThreadLock(pc);
+    pc->StepsUsed += Thread->BudgetGranted - Thread->BudgetTicks;
+    StepsUsed = pc->StepsUsed;
+    if (Limits->MaxMilliseconds != 0 || Limits->MaxHeapBytes != 0)
+        Grant = BUDGET_CHECK_INTERVAL;
+
+    if (Limits->MaxSteps != 0) {
+        if (StepsUsed >= Limits->MaxSteps)
+            Grant = 0;
+        else if (Limits->MaxSteps - StepsUsed < (unsigned long)Grant)
+            Grant = Limits->MaxSteps - StepsUsed;
+    }
+
+    Thread->BudgetGranted = Grant;
+    Thread->BudgetTicks = Grant;
+    ThreadUnlock(pc);
+
+    if (Limits->MaxSteps != 0 && StepsUsed > Limits->MaxSteps)
+        ProgramFailExit(Parser, PICOC_LIMIT_EXIT, "step limit exceeded");
+
+    if (Limits->MaxMilliseconds != 0 && (PlatformClock() - pc->BudgetStart) /
+            1000000 >= Limits->MaxMilliseconds)
+        ProgramFailExit(Parser, PICOC_LIMIT_EXIT, "time limit exceeded");
+
+    if (Limits->MaxHeapBytes != 0 && (pc->OverMemLimit ||
+            pc->MemStats.HeapBytes + pc->MemStats.MappedBytes >
+            Limits->MaxHeapBytes))
+        ProgramFailExit(Parser, PICOC_LIMIT_EXIT, "memory limit exceeded");
+}
@@ -5,13 +5,13 @@
 
 /* endian-ness checking */
 static const int __ENDIAN_CHECK__ = 1;
-static int BigEndian;
-static int LittleEndian;
 
 
 /* global initialisation for libraries */
 void LibraryInit(Picoc *pc)
 {
+    TableInitTable(&pc->LibraryTable, &pc->LibraryHashTable[0],
+        LIBRARY_TABLE_SIZE);
 
     /* define the version number macro */
     pc->VersionString = TableStrRegister(pc, PICOC_VERSION);
@@ -19,38 +19,109 @@ void LibraryInit(Picoc *pc)
         (union AnyValue*)&pc->VersionString, false);
 
     /* define endian-ness macros */
-    BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
-    LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
+    pc->BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
+    pc->LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
 
     VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType,
-        (union AnyValue*)&BigEndian, false);
+        (union AnyValue*)&pc->BigEndian, false);
     VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType,
-        (union AnyValue*)&LittleEndian, false);
+        (union AnyValue*)&pc->LittleEndian, false);
 }
 
-/* add a library */
+/* free the table of library functions */
+void LibraryCleanup(Picoc *pc)
+{
+    TableFree(pc, &pc->LibraryTable);
+}
+
+/* add a library. the functions' prototypes aren't parsed until they're
+    first used, most programs only call a few of them */
 void LibraryAdd(Picoc *pc, struct LibraryFunction *FuncList)
 {
-    struct ParseState Parser;
     int Count;
+
+    for (Count = 0; FuncList[Count].Prototype != NULL; Count++)
+        TableSetPtr(pc, &pc->LibraryTable,
+            LibraryFunctionName(pc, FuncList[Count].Prototype),
+            &FuncList[Count]);
+}
+
+/* get the registered name of a library function from its prototype.
+    it's the identifier before the open bracket */
+char *LibraryFunctionName(Picoc *pc, const char *Prototype)
+{
+    const char *NameEnd = strchr(Prototype, '(');
+    const char *Name = NameEnd;
+
+    while (Name > Prototype && (isalnum((unsigned char)Name[-1]) ||
+            Name[-1] == '_'))
+        Name--;
+
+    return TableStrRegister2(pc, Name, NameEnd - Name);
+}
+
+/* define a library function the first time it's used. returns TRUE if
+    Ident was one. Ident must be registered */
+int LibraryResolve(Picoc *pc, const char *Ident)
+{
+    struct ParseState Parser;
     char *Identifier;
     struct ValueType *ReturnType;
     struct Value *NewValue;
     void *Tokens;
-    char *IntrinsicName = TableStrRegister(pc, "c library");
-
-    /* read all the library definitions */
-    for (Count = 0; FuncList[Count].Prototype != NULL; Count++) {
-        Tokens = LexAnalyse(pc,
-            (const char*)IntrinsicName, FuncList[Count].Prototype,
-            strlen((char*)FuncList[Count].Prototype), NULL);
-        LexInitParser(&Parser, pc, FuncList[Count].Prototype, Tokens,
-            IntrinsicName, true, false);
-        TypeParse(&Parser, &ReturnType, &Identifier, NULL);
-        NewValue = ParseFunctionDefinition(&Parser, ReturnType, Identifier);
-        NewValue->Val->FuncDef.Intrinsic = FuncList[Count].Func;
-        HeapFreeMem(pc, Tokens);
+    char *IntrinsicName;
+    struct ThreadState *Thread = THREAD(pc);
+    struct StackFrame *TopStackFrame = Thread->TopStackFrame;
+    struct Value LexValue = Thread->LexValue;
+    union AnyValue LexAnyValue = Thread->LexAnyValue;
+    struct LibraryFunction *Func = TableDeletePtr(pc, &pc->LibraryTable,
+        Ident);
+
+    if (Func == NULL)
+        return false;
+
+    /* it's a global even if we're in a function */
+    Thread->TopStackFrame = NULL;
+    IntrinsicName = TableStrRegister(pc, "c library");
+    Tokens = LexAnalyse(pc, (const char*)IntrinsicName, Func->Prototype,
+        strlen((char*)Func->Prototype), NULL);
+    LexInitParser(&Parser, pc, Func->Prototype, Tokens, IntrinsicName, true,
+        false);
+    TypeParse(&Parser, &ReturnType, &Identifier, NULL);
+    NewValue = ParseFunctionDefinition(&Parser, ReturnType, Identifier);
+    NewValue->Val->FuncDef.Intrinsic = Func->Func;
+    HeapFreeMem(pc, Tokens);
+
+    /* the caller may still be looking at the token it was given */
+    Thread->TopStackFrame = TopStackFrame;
+    Thread->LexValue = LexValue;
+    Thread->LexAnyValue = LexAnyValue;
+
+    return true;
+}
+
+/* get the function a library function was given as a callback. it's
+    passed as a void * holding the function's value, see
+    ExpressionAssignToPointer() */
+struct Value *LibraryGetCallback(struct ParseState *Parser, void *FuncPointer)
+{
+    int Count;
+    struct Table *Tbl = &Parser->pc->GlobalTable;
+
+    /* other threads may be adding globals */
+    ThreadLock(Parser->pc);
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        struct Value *Val = Tbl->HashTable[Count].Val;
+        if (Tbl->HashTable[Count].Key != NULL &&
+                Val->Typ == &Parser->pc->FunctionType &&
+                (void*)Val->Val == FuncPointer) {
+            ThreadUnlock(Parser->pc);
+            return Val;
+        }
     }
+
+    ProgramFail(Parser, "callback isn't a function");
+    return NULL;
 }
 
 /* print a type to a stream without using printf/sprintf */
@@ -0,0 +1,200 @@
+/* picoc coroutines - runs a function in the program on a native stack of
+ * its own, so the program can yield() back to the host and be resumed
+ * later. a host can keep many programs part way through on a few threads,
+ * each suspended wherever it yielded */
+
+#include "picoc.h"
+#include "interpreter.h"
+
+#ifdef UNIX_HOST
+#include <ucontext.h>
+
+/* a function in the program which is running on its own stack */
+struct Coroutine
+{
+    ucontext_t HostContext;     /* where the host resumed us from */
+    ucontext_t ProgramContext;  /* where the program yielded from */
+    jmp_buf ExitBuf;            /* the program's exit point while it's suspended */
+    char *Stack;
+    size_t StackSize;
+    int Running;                /* the program has control, not the host */
+    int Finished;
+    struct Value *FuncValue;
+    union AnyValue Args[PARAMETER_MAX];
+    int NumArgs;
+    union AnyValue *ReturnValue;
+    struct StackFrame *TopStackFrame;   /* the interpreter's stack before we started */
+    void *StackFrame;
+    void *HeapStackTop;
+};
+
+/* the interpreter whose coroutine is being started on this thread */
+static THREAD_LOCAL Picoc *CoroutineStarting;
+
+static void CoroutineYield(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs);
+
+struct LibraryFunction CoroutineFunctions[] =
+{
+    {CoroutineYield, "void yield();"},
+    {NULL, NULL}
+};
+
+/* pop any stack frames the coroutine left behind when it was abandoned
+    part way through */
+static void CoroutineUnwind(Picoc *pc, struct Coroutine *Co)
+{
+    VariableStackUnwind(&pc->MainThread, Co->TopStackFrame, Co->StackFrame,
+        Co->HeapStackTop);
+}
+
+/* the coroutine starts here, on its own stack. exit() and errors come back
+    here too, which ends the coroutine rather than leaving the host */
+static void CoroutineMain(void)
+{
+    Picoc *pc = CoroutineStarting;
+    struct Coroutine *Co = pc->Coroutine;
+
+    if (!PicocPlatformSetExitPoint(pc))
+        PicocCallFunction(pc, Co->FuncValue, Co->Args, Co->NumArgs,
+            Co->ReturnValue);
+
+    CoroutineUnwind(pc, Co);
+    Co->Finished = true;
+    setcontext(&Co->HostContext);
+}
+
+/* hand control to the program until it yields or finishes. while it's
+    running the program has its own exit point and native stack limits */
+static int CoroutineRun(Picoc *pc)
+{
+    struct Coroutine *Co = pc->Coroutine;
+    char *HostStackBase = pc->MainThread.NativeStackBase;
+    size_t HostStackLimit = pc->MainThread.NativeStackLimit;
+    jmp_buf HostExitBuf;
+
+    memcpy(HostExitBuf, pc->PicocExitBuf, sizeof(jmp_buf));
+    memcpy(pc->PicocExitBuf, Co->ExitBuf, sizeof(jmp_buf));
+    pc->MainThread.NativeStackBase = Co->Stack + Co->StackSize;
+    pc->MainThread.NativeStackLimit = Co->StackSize - COROUTINE_STACK_MARGIN;
+
+    Co->Running = true;
+    swapcontext(&Co->HostContext, &Co->ProgramContext);
+    Co->Running = false;
+
+    memcpy(Co->ExitBuf, pc->PicocExitBuf, sizeof(jmp_buf));
+    memcpy(pc->PicocExitBuf, HostExitBuf, sizeof(jmp_buf));
+    pc->MainThread.NativeStackBase = HostStackBase;
+    pc->MainThread.NativeStackLimit = HostStackLimit;
+
+    if (!Co->Finished)
+        return PICOC_YIELDED;
+
+    PicocStopCoroutine(pc);
+    return PICOC_FINISHED;
+}
+
+/* start calling a function in the program as a coroutine, on a native
+    stack of StackSize bytes (or COROUTINE_STACK_SIZE if it's 0). the
+    arguments are as for PicocCallFunction(), and ReturnValue must stay
+    valid until the coroutine finishes. returns PICOC_YIELDED if the
+    program yielded or PICOC_FINISHED if it returned, exited or failed -
+    PicocExitValue says which */
+int PicocStartCoroutine(Picoc *pc, struct Value *FuncValue,
+    union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue,
+    int StackSize)
+{
+    struct Coroutine *Co;
+
+    if (pc->Coroutine != NULL)
+        ProgramFailNoParser(pc, "(PicocStartCoroutine) a coroutine is already running");
+
+    if (NumArgs > PARAMETER_MAX)
+        ProgramFailNoParser(pc, "(PicocStartCoroutine) too many arguments");
+
+    if (StackSize == 0)
+        StackSize = COROUTINE_STACK_SIZE;
+
+    if (StackSize < COROUTINE_STACK_MARGIN * 2)
+        ProgramFailNoParser(pc, "(PicocStartCoroutine) stack too small");
+
+    Co = HeapAllocMem(pc, sizeof(struct Coroutine));
+    if (Co == NULL)
+        ProgramFailNoParser(pc, "(PicocStartCoroutine) out of memory");
+
+    Co->Stack = HeapAllocMem(pc, StackSize);
+    if (Co->Stack == NULL) {
+        HeapFreeMem(pc, Co);
+        ProgramFailNoParser(pc, "(PicocStartCoroutine) out of memory");
+    }
+
+    Co->StackSize = StackSize;
+    Co->FuncValue = FuncValue;
+    if (NumArgs > 0)
+        memcpy(Co->Args, Args, sizeof(union AnyValue) * NumArgs);
+    Co->NumArgs = NumArgs;
+    Co->ReturnValue = ReturnValue;
+    Co->TopStackFrame = pc->MainThread.TopStackFrame;
+    Co->StackFrame = pc->MainThread.StackFrame;
+    Co->HeapStackTop = pc->MainThread.HeapStackTop;
+    pc->PicocExitValue = 0;
+
+    getcontext(&Co->ProgramContext);
+    Co->ProgramContext.uc_stack.ss_sp = Co->Stack;
+    Co->ProgramContext.uc_stack.ss_size = StackSize;
+    Co->ProgramContext.uc_link = NULL;
+    makecontext(&Co->ProgramContext, CoroutineMain, 0);
+
+    pc->Coroutine = Co;
+    CoroutineStarting = pc;
+    return CoroutineRun(pc);
+}
+
+/* carry on with a coroutine from where it yielded. it can be resumed on a
+    different thread from the one it started on. returns as for
+    PicocStartCoroutine() */
+int PicocResumeCoroutine(Picoc *pc)
+{
+    if (pc->Coroutine == NULL)
+        return PICOC_FINISHED;
+
+    return CoroutineRun(pc);
+}
+
+/* suspend the program and go back to the host, which returns from
+    PicocStartCoroutine() or PicocResumeCoroutine() with PICOC_YIELDED.
+    library functions can call this to wait for something, eg. input the
+    host doesn't have yet. outside a coroutine it does nothing */
+void PicocYield(Picoc *pc)
+{
+    struct Coroutine *Co = pc->Coroutine;
+
+    if (Co == NULL || !Co->Running)
+        return;
+
+    swapcontext(&Co->ProgramContext, &Co->HostContext);
+}
+
+/* throw away the coroutine, whether or not it's finished. if it's part way
+    through its stack frames are popped, but anything else it changed - its
+    globals for instance - stays as it was */
+void PicocStopCoroutine(Picoc *pc)
+{
+    struct Coroutine *Co = pc->Coroutine;
+
+    if (Co == NULL || Co->Running)
+        return;
+
+    CoroutineUnwind(pc, Co);
+    HeapFreeMem(pc, Co->Stack);
+    HeapFreeMem(pc, Co);
+    pc->Coroutine = NULL;
+}
+
+/* void yield(); */
+static void CoroutineYield(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    PicocYield(Parser->pc);
+}
+#endif
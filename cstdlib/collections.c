@@ -0,0 +1,831 @@
+/* collections.h - hash maps and growable arrays which run natively. the
+ * program gets an opaque handle to each one and works on it through library
+ * calls, instead of building them out of malloc() in interpreted code */
+#include "../interpreter.h"
+
+#define MAP_MIN_SIZE 16         /* slots in a new map. always a power of two */
+#define ARRAY_MIN_CAPACITY 8    /* elements in an array's first allocation */
+
+/* a slot in a map. it's empty unless Used is set */
+struct MapEntry {
+    char *Key;                  /* our own copy of the key if it's a string */
+    long IntKey;
+    unsigned int Hash;
+    int Used;
+    union {
+        long Integer;
+        void *Pointer;
+    } Val;
+};
+
+/* a hash map keyed by strings or by integers. it's open addressed with
+    linear probing like struct Table, but it grows as it fills up and
+    removes entries by moving later ones back rather than leaving markers */
+struct Map {
+    struct MapEntry *Slots;
+    int Size;
+    int Count;
+    int IntKeys;
+};
+
+/* a growable array of fixed size elements */
+struct Array {
+    char *Data;
+    int Length;
+    int Capacity;
+    int ElemSize;
+};
+
+/* get memory for a map or an array. it's the program's, so it counts
+    towards its memory limit */
+static void *CollectionsAlloc(Picoc *pc, size_t Size)
+{
+    if (Size > INT_MAX)
+        return NULL;
+
+    return HeapAllocCategory(pc, Size, MemProgram);
+}
+
+/* stop the program because an allocation failed */
+static void CollectionsOutOfMemory(struct ParseState *Parser)
+{
+    BudgetCheckMemory(Parser);
+    ProgramFail(Parser, "out of memory");
+}
+
+/* hash an integer key */
+static unsigned int CollectionsIntHash(long Key)
+{
+    uint64_t Hash = (uint64_t)Key * 0x9e3779b97f4a7c15ULL;
+
+    return (unsigned int)(Hash ^ (Hash >> 32));
+}
+
+/* get a map from a handle, checking it's the right kind */
+static struct Map *CollectionsGetMap(struct ParseState *Parser,
+    struct Value *Handle, int IntKeys)
+{
+    struct Map *M = Handle->Val->Pointer;
+
+    if (M == NULL)
+        ProgramFail(Parser, "map is NULL");
+
+    if (M->IntKeys != IntKeys)
+        ProgramFail(Parser, IntKeys ? "map has string keys" :
+            "map has integer keys");
+
+    return M;
+}
+
+/* look for a key in a map. returns true and its slot if it's there, or
+    false and the slot it would go in if it isn't */
+static int CollectionsMapFind(struct Map *M, const char *Key, long IntKey,
+    unsigned int Hash, int *Slot)
+{
+    int Mask = M->Size - 1;
+    int Pos = Hash & Mask;
+    struct MapEntry *Entry;
+
+    while (M->Slots[Pos].Used) {
+        Entry = &M->Slots[Pos];
+        if (Entry->Hash == Hash && (M->IntKeys ? Entry->IntKey == IntKey :
+                strcmp(Entry->Key, Key) == 0)) {
+            *Slot = Pos;
+            return true;
+        }
+
+        Pos = (Pos + 1) & Mask;
+    }
+
+    *Slot = Pos;
+    return false;
+}
+
+/* double the number of slots in a map and put its entries back in */
+static void CollectionsMapGrow(struct ParseState *Parser, struct Map *M)
+{
+    struct MapEntry *OldSlots = M->Slots;
+    int OldSize = M->Size;
+    int Mask;
+    int Pos;
+    int Count;
+
+    M->Slots = CollectionsAlloc(Parser->pc, sizeof(struct MapEntry) * OldSize * 2);
+    if (M->Slots == NULL) {
+        M->Slots = OldSlots;
+        CollectionsOutOfMemory(Parser);
+    }
+
+    M->Size = OldSize * 2;
+    Mask = M->Size - 1;
+    for (Count = 0; Count < OldSize; Count++) {
+        if (!OldSlots[Count].Used)
+            continue;
+
+        Pos = OldSlots[Count].Hash & Mask;
+        while (M->Slots[Pos].Used)
+            Pos = (Pos + 1) & Mask;
+
+        M->Slots[Pos] = OldSlots[Count];
+    }
+
+    HeapFreeMem(Parser->pc, OldSlots);
+}
+
+/* find the entry for a key, adding it if it isn't there yet. new entries
+    start at zero */
+static struct MapEntry *CollectionsMapAdd(struct ParseState *Parser,
+    struct Map *M, const char *Key, long IntKey)
+{
+    unsigned int Hash;
+    struct MapEntry *Entry;
+    int Slot;
+
+    if (!M->IntKeys && Key == NULL)
+        ProgramFail(Parser, "map key is NULL");
+
+    Hash = M->IntKeys ? CollectionsIntHash(IntKey) : TableHash(Key, strlen(Key));
+    if (CollectionsMapFind(M, Key, IntKey, Hash, &Slot))
+        return &M->Slots[Slot];
+
+    /* keep the map at most three quarters full */
+    if ((M->Count + 1) * 4 > M->Size * 3) {
+        CollectionsMapGrow(Parser, M);
+        CollectionsMapFind(M, Key, IntKey, Hash, &Slot);
+    }
+
+    Entry = &M->Slots[Slot];
+    if (!M->IntKeys) {
+        Entry->Key = CollectionsAlloc(Parser->pc, strlen(Key) + 1);
+        if (Entry->Key == NULL)
+            CollectionsOutOfMemory(Parser);
+        strcpy(Entry->Key, Key);
+    }
+
+    Entry->IntKey = IntKey;
+    Entry->Hash = Hash;
+    Entry->Used = true;
+    Entry->Val.Integer = 0;
+    M->Count++;
+
+    return Entry;
+}
+
+/* find the entry for a key, or NULL if it isn't there */
+static struct MapEntry *CollectionsMapLookup(struct ParseState *Parser,
+    struct Map *M, const char *Key, long IntKey)
+{
+    unsigned int Hash;
+    int Slot;
+
+    if (!M->IntKeys && Key == NULL)
+        ProgramFail(Parser, "map key is NULL");
+
+    Hash = M->IntKeys ? CollectionsIntHash(IntKey) : TableHash(Key, strlen(Key));
+    if (!CollectionsMapFind(M, Key, IntKey, Hash, &Slot))
+        return NULL;
+
+    return &M->Slots[Slot];
+}
+
+/* take the entry for a key out of a map. the entries after it in the same
+    run are moved back into the gap if that's nearer their home slot, so
+    lookups never have to step over removed entries */
+static int CollectionsMapRemove(struct ParseState *Parser, struct Map *M,
+    const char *Key, long IntKey)
+{
+    struct MapEntry *Entry = CollectionsMapLookup(Parser, M, Key, IntKey);
+    int Mask = M->Size - 1;
+    int Hole;
+    int Pos;
+    int Home;
+
+    if (Entry == NULL)
+        return false;
+
+    HeapFreeMem(Parser->pc, Entry->Key);
+    Hole = Entry - M->Slots;
+    for (Pos = (Hole + 1) & Mask; M->Slots[Pos].Used; Pos = (Pos + 1) & Mask) {
+        Home = M->Slots[Pos].Hash & Mask;
+        if (((Pos - Home) & Mask) >= ((Pos - Hole) & Mask)) {
+            M->Slots[Hole] = M->Slots[Pos];
+            Hole = Pos;
+        }
+    }
+
+    memset(&M->Slots[Hole], '\0', sizeof(struct MapEntry));
+    M->Count--;
+
+    return true;
+}
+
+/* empty a map, keeping the slots it has */
+static void CollectionsMapEmpty(Picoc *pc, struct Map *M)
+{
+    int Count;
+
+    for (Count = 0; Count < M->Size; Count++)
+        HeapFreeMem(pc, M->Slots[Count].Key);
+
+    memset(M->Slots, '\0', sizeof(struct MapEntry) * M->Size);
+    M->Count = 0;
+}
+
+static void CollectionsNewMap(struct ParseState *Parser,
+    struct Value *ReturnValue, int IntKeys)
+{
+    struct Map *M = CollectionsAlloc(Parser->pc, sizeof(struct Map));
+
+    if (M == NULL)
+        CollectionsOutOfMemory(Parser);
+
+    M->Slots = CollectionsAlloc(Parser->pc, sizeof(struct MapEntry) * MAP_MIN_SIZE);
+    if (M->Slots == NULL) {
+        HeapFreeMem(Parser->pc, M);
+        CollectionsOutOfMemory(Parser);
+    }
+
+    M->Size = MAP_MIN_SIZE;
+    M->IntKeys = IntKeys;
+    ReturnValue->Val->Pointer = M;
+}
+
+/* map_t map_create(); a map with string keys */
+void CollectionsMapCreate(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    CollectionsNewMap(Parser, ReturnValue, false);
+}
+
+/* map_t imap_create(); a map with integer keys */
+void CollectionsIMapCreate(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    CollectionsNewMap(Parser, ReturnValue, true);
+}
+
+/* void map_destroy(map_t m); works on either kind of map */
+void CollectionsMapDestroy(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = Param[0]->Val->Pointer;
+
+    if (M == NULL)
+        return;
+
+    CollectionsMapEmpty(Parser->pc, M);
+    HeapFreeMem(Parser->pc, M->Slots);
+    HeapFreeMem(Parser->pc, M);
+}
+
+/* int map_size(map_t m); */
+void CollectionsMapSize(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = Param[0]->Val->Pointer;
+
+    if (M == NULL)
+        ProgramFail(Parser, "map is NULL");
+
+    ReturnValue->Val->Integer = M->Count;
+}
+
+/* void map_clear(map_t m); */
+void CollectionsMapClear(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = Param[0]->Val->Pointer;
+
+    if (M == NULL)
+        ProgramFail(Parser, "map is NULL");
+
+    CollectionsMapEmpty(Parser->pc, M);
+}
+
+/* void map_put(map_t m, char *key, long value); */
+void CollectionsMapPut(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+
+    CollectionsMapAdd(Parser, M, Param[1]->Val->Pointer, 0)->Val.Integer =
+        Param[2]->Val->LongInteger;
+}
+
+/* void map_put_ptr(map_t m, char *key, void *value); */
+void CollectionsMapPutPtr(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+
+    CollectionsMapAdd(Parser, M, Param[1]->Val->Pointer, 0)->Val.Pointer =
+        Param[2]->Val->Pointer;
+}
+
+/* long map_add(map_t m, char *key, long n); adds n to a key's value,
+    which starts at 0, and returns the new value */
+void CollectionsMapAddTo(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+    struct MapEntry *Entry = CollectionsMapAdd(Parser, M,
+        Param[1]->Val->Pointer, 0);
+
+    Entry->Val.Integer += Param[2]->Val->LongInteger;
+    ReturnValue->Val->LongInteger = Entry->Val.Integer;
+}
+
+/* long map_get(map_t m, char *key, long missing); */
+void CollectionsMapGet(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+    struct MapEntry *Entry = CollectionsMapLookup(Parser, M,
+        Param[1]->Val->Pointer, 0);
+
+    ReturnValue->Val->LongInteger = Entry != NULL ? Entry->Val.Integer :
+        Param[2]->Val->LongInteger;
+}
+
+/* void *map_get_ptr(map_t m, char *key); NULL if it's missing */
+void CollectionsMapGetPtr(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+    struct MapEntry *Entry = CollectionsMapLookup(Parser, M,
+        Param[1]->Val->Pointer, 0);
+
+    ReturnValue->Val->Pointer = Entry != NULL ? Entry->Val.Pointer : NULL;
+}
+
+/* int map_has(map_t m, char *key); */
+void CollectionsMapHas(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+
+    ReturnValue->Val->Integer = CollectionsMapLookup(Parser, M,
+        Param[1]->Val->Pointer, 0) != NULL;
+}
+
+/* int map_remove(map_t m, char *key); returns whether it was there */
+void CollectionsMapDelete(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], false);
+
+    ReturnValue->Val->Integer = CollectionsMapRemove(Parser, M,
+        Param[1]->Val->Pointer, 0);
+}
+
+/* void imap_put(map_t m, long key, long value); */
+void CollectionsIMapPut(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+
+    CollectionsMapAdd(Parser, M, NULL, Param[1]->Val->LongInteger)->Val.Integer =
+        Param[2]->Val->LongInteger;
+}
+
+/* void imap_put_ptr(map_t m, long key, void *value); */
+void CollectionsIMapPutPtr(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+
+    CollectionsMapAdd(Parser, M, NULL, Param[1]->Val->LongInteger)->Val.Pointer =
+        Param[2]->Val->Pointer;
+}
+
+/* long imap_add(map_t m, long key, long n); */
+void CollectionsIMapAddTo(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+    struct MapEntry *Entry = CollectionsMapAdd(Parser, M, NULL,
+        Param[1]->Val->LongInteger);
+
+    Entry->Val.Integer += Param[2]->Val->LongInteger;
+    ReturnValue->Val->LongInteger = Entry->Val.Integer;
+}
+
+/* long imap_get(map_t m, long key, long missing); */
+void CollectionsIMapGet(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+    struct MapEntry *Entry = CollectionsMapLookup(Parser, M, NULL,
+        Param[1]->Val->LongInteger);
+
+    ReturnValue->Val->LongInteger = Entry != NULL ? Entry->Val.Integer :
+        Param[2]->Val->LongInteger;
+}
+
+/* void *imap_get_ptr(map_t m, long key); */
+void CollectionsIMapGetPtr(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+    struct MapEntry *Entry = CollectionsMapLookup(Parser, M, NULL,
+        Param[1]->Val->LongInteger);
+
+    ReturnValue->Val->Pointer = Entry != NULL ? Entry->Val.Pointer : NULL;
+}
+
+/* int imap_has(map_t m, long key); */
+void CollectionsIMapHas(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+
+    ReturnValue->Val->Integer = CollectionsMapLookup(Parser, M, NULL,
+        Param[1]->Val->LongInteger) != NULL;
+}
+
+/* int imap_remove(map_t m, long key); */
+void CollectionsIMapDelete(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = CollectionsGetMap(Parser, Param[0], true);
+
+    ReturnValue->Val->Integer = CollectionsMapRemove(Parser, M, NULL,
+        Param[1]->Val->LongInteger);
+}
+
+/* get the entry at a position from map_next() */
+static struct MapEntry *CollectionsMapEntryAt(struct ParseState *Parser,
+    struct Value *Handle, struct Value *Position)
+{
+    struct Map *M = Handle->Val->Pointer;
+    int Pos = Position->Val->Integer;
+
+    if (M == NULL)
+        ProgramFail(Parser, "map is NULL");
+
+    if (Pos < 0 || Pos >= M->Size || !M->Slots[Pos].Used)
+        ProgramFail(Parser, "no map entry at position %d", Pos);
+
+    return &M->Slots[Pos];
+}
+
+/* int map_next(map_t m, int pos); the position of the first entry at or
+    after pos, or -1 if there are no more. go through a map with:
+        for (i = map_next(m, 0); i >= 0; i = map_next(m, i+1))
+    and don't add or remove entries while doing it */
+void CollectionsMapNext(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Map *M = Param[0]->Val->Pointer;
+    int Pos = Param[1]->Val->Integer;
+
+    if (M == NULL)
+        ProgramFail(Parser, "map is NULL");
+
+    if (Pos < 0)
+        Pos = 0;
+
+    while (Pos < M->Size && !M->Slots[Pos].Used)
+        Pos++;
+
+    ReturnValue->Val->Integer = Pos < M->Size ? Pos : -1;
+}
+
+/* char *map_key(map_t m, int pos); */
+void CollectionsMapKey(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    CollectionsGetMap(Parser, Param[0], false);
+    ReturnValue->Val->Pointer = CollectionsMapEntryAt(Parser, Param[0],
+        Param[1])->Key;
+}
+
+/* long imap_key(map_t m, int pos); */
+void CollectionsIMapKey(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    CollectionsGetMap(Parser, Param[0], true);
+    ReturnValue->Val->LongInteger = CollectionsMapEntryAt(Parser, Param[0],
+        Param[1])->IntKey;
+}
+
+/* long map_value(map_t m, int pos); */
+void CollectionsMapValue(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->LongInteger = CollectionsMapEntryAt(Parser, Param[0],
+        Param[1])->Val.Integer;
+}
+
+/* void *map_value_ptr(map_t m, int pos); */
+void CollectionsMapValuePtr(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Pointer = CollectionsMapEntryAt(Parser, Param[0],
+        Param[1])->Val.Pointer;
+}
+
+/* get an array from a handle */
+static struct Array *CollectionsGetArray(struct ParseState *Parser,
+    struct Value *Handle)
+{
+    struct Array *A = Handle->Val->Pointer;
+
+    if (A == NULL)
+        ProgramFail(Parser, "array is NULL");
+
+    return A;
+}
+
+/* make sure an array has room for at least Capacity elements. it at least
+    doubles each time so adding elements one by one stays cheap */
+static void CollectionsArrayReserve(struct ParseState *Parser,
+    struct Array *A, int Capacity)
+{
+    int NewCapacity = A->Capacity;
+    char *NewData;
+
+    if (Capacity <= A->Capacity)
+        return;
+
+    if (NewCapacity < ARRAY_MIN_CAPACITY)
+        NewCapacity = ARRAY_MIN_CAPACITY;
+
+    while (NewCapacity < Capacity && NewCapacity <= INT_MAX / 2)
+        NewCapacity *= 2;
+
+    if (NewCapacity < Capacity)
+        NewCapacity = Capacity;
+
+    NewData = CollectionsAlloc(Parser->pc, (size_t)NewCapacity * A->ElemSize);
+    if (NewData == NULL)
+        CollectionsOutOfMemory(Parser);
+
+    if (A->Length > 0)
+        memcpy(NewData, A->Data, A->Length * A->ElemSize);
+
+    HeapFreeMem(Parser->pc, A->Data);
+    A->Data = NewData;
+    A->Capacity = NewCapacity;
+}
+
+/* get the address of an element, checking the index */
+static void *CollectionsArrayElement(struct ParseState *Parser,
+    struct Array *A, int Index)
+{
+    if (Index < 0 || Index >= A->Length)
+        ProgramFail(Parser, "array index %d out of range (length %d)", Index,
+            A->Length);
+
+    return A->Data + Index * A->ElemSize;
+}
+
+/* check the elements are the size a typed array function expects */
+static void CollectionsArrayCheckType(struct ParseState *Parser,
+    struct Array *A, int ElemSize)
+{
+    if (A->ElemSize != ElemSize)
+        ProgramFail(Parser, "array elements are %d bytes, not %d", A->ElemSize,
+            ElemSize);
+}
+
+/* array_t array_create(int elem_size); eg. array_create(sizeof(double)) */
+void CollectionsArrayCreate(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    int ElemSize = Param[0]->Val->Integer;
+    struct Array *A;
+
+    if (ElemSize <= 0)
+        ProgramFail(Parser, "array element size %d is too small", ElemSize);
+
+    A = CollectionsAlloc(Parser->pc, sizeof(struct Array));
+    if (A == NULL)
+        CollectionsOutOfMemory(Parser);
+
+    A->ElemSize = ElemSize;
+    ReturnValue->Val->Pointer = A;
+}
+
+/* void array_destroy(array_t a); */
+void CollectionsArrayDestroy(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = Param[0]->Val->Pointer;
+
+    if (A == NULL)
+        return;
+
+    HeapFreeMem(Parser->pc, A->Data);
+    HeapFreeMem(Parser->pc, A);
+}
+
+/* int array_len(array_t a); */
+void CollectionsArrayLen(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = CollectionsGetArray(Parser, Param[0])->Length;
+}
+
+/* void array_resize(array_t a, int len); new elements are zeroed */
+void CollectionsArrayResize(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+    int Length = Param[1]->Val->Integer;
+
+    if (Length < 0)
+        ProgramFail(Parser, "array length %d is negative", Length);
+
+    CollectionsArrayReserve(Parser, A, Length);
+    if (Length > A->Length)
+        memset(A->Data + A->Length * A->ElemSize, '\0',
+            (Length - A->Length) * A->ElemSize);
+
+    A->Length = Length;
+}
+
+/* void array_clear(array_t a); */
+void CollectionsArrayClear(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    CollectionsGetArray(Parser, Param[0])->Length = 0;
+}
+
+/* void *array_data(array_t a); the elements, one after another. it moves
+    when the array grows */
+void CollectionsArrayData(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Pointer = CollectionsGetArray(Parser, Param[0])->Data;
+}
+
+/* void *array_at(array_t a, int i); */
+void CollectionsArrayAt(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Pointer = CollectionsArrayElement(Parser,
+        CollectionsGetArray(Parser, Param[0]), Param[1]->Val->Integer);
+}
+
+/* void array_push(array_t a, void *elem); copies an element on the end */
+void CollectionsArrayPush(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    if (Param[1]->Val->Pointer == NULL)
+        ProgramFail(Parser, "array element is NULL");
+
+    CollectionsArrayReserve(Parser, A, A->Length + 1);
+    memcpy(A->Data + A->Length * A->ElemSize, Param[1]->Val->Pointer,
+        A->ElemSize);
+    A->Length++;
+}
+
+/* int array_pop(array_t a, void *elem); takes the last element off,
+    copying it to elem unless that's NULL. returns 0 if it was empty */
+void CollectionsArrayPop(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    ReturnValue->Val->Integer = A->Length > 0;
+    if (A->Length == 0)
+        return;
+
+    A->Length--;
+    if (Param[1]->Val->Pointer != NULL)
+        memcpy(Param[1]->Val->Pointer, A->Data + A->Length * A->ElemSize,
+            A->ElemSize);
+}
+
+/* void array_push_long(array_t a, long value); */
+void CollectionsArrayPushLong(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(long));
+    CollectionsArrayReserve(Parser, A, A->Length + 1);
+    ((long *)A->Data)[A->Length++] = Param[1]->Val->LongInteger;
+}
+
+/* long array_get_long(array_t a, int i); */
+void CollectionsArrayGetLong(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(long));
+    ReturnValue->Val->LongInteger = *(long *)CollectionsArrayElement(Parser,
+        A, Param[1]->Val->Integer);
+}
+
+/* void array_set_long(array_t a, int i, long value); */
+void CollectionsArraySetLong(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(long));
+    *(long *)CollectionsArrayElement(Parser, A, Param[1]->Val->Integer) =
+        Param[2]->Val->LongInteger;
+}
+
+#ifndef NO_FP
+/* void array_push_double(array_t a, double value); */
+void CollectionsArrayPushDouble(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(double));
+    CollectionsArrayReserve(Parser, A, A->Length + 1);
+    ((double *)A->Data)[A->Length++] = Param[1]->Val->FP;
+}
+
+/* double array_get_double(array_t a, int i); */
+void CollectionsArrayGetDouble(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(double));
+    ReturnValue->Val->FP = *(double *)CollectionsArrayElement(Parser, A,
+        Param[1]->Val->Integer);
+}
+
+/* void array_set_double(array_t a, int i, double value); */
+void CollectionsArraySetDouble(struct ParseState *Parser,
+    struct Value *ReturnValue, struct Value **Param, int NumArgs)
+{
+    struct Array *A = CollectionsGetArray(Parser, Param[0]);
+
+    CollectionsArrayCheckType(Parser, A, sizeof(double));
+    *(double *)CollectionsArrayElement(Parser, A, Param[1]->Val->Integer) =
+        Param[2]->Val->FP;
+}
+#endif
+
+/* handy structure definitions */
+const char CollectionsDefs[] = "\
+typedef struct __MapStruct *map_t; \
+typedef struct __ArrayStruct *array_t; \
+";
+
+/* all collections.h functions */
+struct LibraryFunction CollectionsFunctions[] =
+{
+    {CollectionsMapCreate, "map_t map_create();"},
+    {CollectionsIMapCreate, "map_t imap_create();"},
+    {CollectionsMapDestroy, "void map_destroy(map_t);"},
+    {CollectionsMapSize, "int map_size(map_t);"},
+    {CollectionsMapClear, "void map_clear(map_t);"},
+    {CollectionsMapPut, "void map_put(map_t,char *,long);"},
+    {CollectionsMapPutPtr, "void map_put_ptr(map_t,char *,void *);"},
+    {CollectionsMapAddTo, "long map_add(map_t,char *,long);"},
+    {CollectionsMapGet, "long map_get(map_t,char *,long);"},
+    {CollectionsMapGetPtr, "void *map_get_ptr(map_t,char *);"},
+    {CollectionsMapHas, "int map_has(map_t,char *);"},
+    {CollectionsMapDelete, "int map_remove(map_t,char *);"},
+    {CollectionsIMapPut, "void imap_put(map_t,long,long);"},
+    {CollectionsIMapPutPtr, "void imap_put_ptr(map_t,long,void *);"},
+    {CollectionsIMapAddTo, "long imap_add(map_t,long,long);"},
+    {CollectionsIMapGet, "long imap_get(map_t,long,long);"},
+    {CollectionsIMapGetPtr, "void *imap_get_ptr(map_t,long);"},
+    {CollectionsIMapHas, "int imap_has(map_t,long);"},
+    {CollectionsIMapDelete, "int imap_remove(map_t,long);"},
+    {CollectionsMapNext, "int map_next(map_t,int);"},
+    {CollectionsMapKey, "char *map_key(map_t,int);"},
+    {CollectionsIMapKey, "long imap_key(map_t,int);"},
+    {CollectionsMapValue, "long map_value(map_t,int);"},
+    {CollectionsMapValuePtr, "void *map_value_ptr(map_t,int);"},
+    {CollectionsArrayCreate, "array_t array_create(int);"},
+    {CollectionsArrayDestroy, "void array_destroy(array_t);"},
+    {CollectionsArrayLen, "int array_len(array_t);"},
+    {CollectionsArrayResize, "void array_resize(array_t,int);"},
+    {CollectionsArrayClear, "void array_clear(array_t);"},
+    {CollectionsArrayData, "void *array_data(array_t);"},
+    {CollectionsArrayAt, "void *array_at(array_t,int);"},
+    {CollectionsArrayPush, "void array_push(array_t,void *);"},
+    {CollectionsArrayPop, "int array_pop(array_t,void *);"},
+    {CollectionsArrayPushLong, "void array_push_long(array_t,long);"},
+    {CollectionsArrayGetLong, "long array_get_long(array_t,int);"},
+    {CollectionsArraySetLong, "void array_set_long(array_t,int,long);"},
+#ifndef NO_FP
+    {CollectionsArrayPushDouble, "void array_push_double(array_t,double);"},
+    {CollectionsArrayGetDouble, "double array_get_double(array_t,int);"},
+    {CollectionsArraySetDouble, "void array_set_double(array_t,int,double);"},
+#endif
+    {NULL, NULL}
+};
+
+/* creates the opaque types the handles point to */
+void CollectionsSetupFunc(Picoc *pc)
+{
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "__MapStruct"),
+        sizeof(struct Map));
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "__ArrayStruct"),
+        sizeof(struct Array));
+}
@@ -0,0 +1,156 @@
+/* sys/mman.h - maps files into memory so a program can read a big file as
+ * one char array, without copying it in a piece at a time */
+#include "../interpreter.h"
+
+#ifdef UNIX_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int PROT_NONEValue = PROT_NONE;
+static int PROT_READValue = PROT_READ;
+static int PROT_WRITEValue = PROT_WRITE;
+static int PROT_EXECValue = PROT_EXEC;
+static int MAP_SHAREDValue = MAP_SHARED;
+static int MAP_PRIVATEValue = MAP_PRIVATE;
+static int MAP_ANONYMOUSValue = MAP_ANONYMOUS;
+static int MS_ASYNCValue = MS_ASYNC;
+static int MS_SYNCValue = MS_SYNC;
+static int MS_INVALIDATEValue = MS_INVALIDATE;
+static int MADV_NORMALValue = MADV_NORMAL;
+static int MADV_RANDOMValue = MADV_RANDOM;
+static int MADV_SEQUENTIALValue = MADV_SEQUENTIAL;
+static int MADV_WILLNEEDValue = MADV_WILLNEED;
+static int MADV_DONTNEEDValue = MADV_DONTNEED;
+static void *MAP_FAILEDValue = MAP_FAILED;
+
+void MmanMmap(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    unsigned long Len = Param[1]->Val->UnsignedLongInteger;
+
+    /* mapped memory counts towards the program's memory limit */
+    if (!HeapAddMapped(Parser->pc, Len))
+        BudgetCheckMemory(Parser);
+
+    ReturnValue->Val->Pointer = mmap(Param[0]->Val->Pointer, Len,
+        Param[2]->Val->Integer, Param[3]->Val->Integer, Param[4]->Val->Integer,
+        Param[5]->Val->LongInteger);
+    if (ReturnValue->Val->Pointer == MAP_FAILED)
+        HeapSubMapped(Parser->pc, Len);
+}
+
+void MmanMunmap(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = munmap(Param[0]->Val->Pointer,
+        Param[1]->Val->UnsignedLongInteger);
+    if (ReturnValue->Val->Integer == 0)
+        HeapSubMapped(Parser->pc, Param[1]->Val->UnsignedLongInteger);
+}
+
+void MmanMsync(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = msync(Param[0]->Val->Pointer,
+        Param[1]->Val->UnsignedLongInteger, Param[2]->Val->Integer);
+}
+
+void MmanMadvise(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = madvise(Param[0]->Val->Pointer,
+        Param[1]->Val->UnsignedLongInteger, Param[2]->Val->Integer);
+}
+
+/* char *map_file(char *path, unsigned long *len); maps a whole file
+    read-only for reading from start to end. returns NULL if it can't,
+    which includes an empty file. unmap it with munmap(p, len) */
+void MmanMapFile(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    unsigned long *Len = Param[1]->Val->Pointer;
+    struct stat FileInfo;
+    void *Map;
+    int Fd;
+
+    ReturnValue->Val->Pointer = NULL;
+    if (Len != NULL)
+        *Len = 0;
+
+    Fd = open(Param[0]->Val->Pointer, O_RDONLY);
+    if (Fd < 0)
+        return;
+
+    if (fstat(Fd, &FileInfo) != 0 || FileInfo.st_size == 0) {
+        close(Fd);
+        return;
+    }
+
+    if (!HeapAddMapped(Parser->pc, FileInfo.st_size)) {
+        close(Fd);
+        BudgetCheckMemory(Parser);
+    }
+
+    Map = mmap(NULL, FileInfo.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    close(Fd);
+    if (Map == MAP_FAILED) {
+        HeapSubMapped(Parser->pc, FileInfo.st_size);
+        return;
+    }
+
+    madvise(Map, FileInfo.st_size, MADV_SEQUENTIAL);
+    ReturnValue->Val->Pointer = Map;
+    if (Len != NULL)
+        *Len = FileInfo.st_size;
+}
+
+/* all sys/mman.h functions */
+struct LibraryFunction MmanFunctions[] =
+{
+    {MmanMmap, "void *mmap(void *,unsigned long,int,int,int,long);"},
+    {MmanMunmap, "int munmap(void *,unsigned long);"},
+    {MmanMsync, "int msync(void *,unsigned long,int);"},
+    {MmanMadvise, "int madvise(void *,unsigned long,int);"},
+    {MmanMapFile, "char *map_file(char *,unsigned long *);"},
+    {NULL, NULL}
+};
+
+/* creates various system-dependent definitions */
+void MmanSetupFunc(Picoc *pc)
+{
+    VariableDefinePlatformVar(pc, NULL, "PROT_NONE", &pc->IntType,
+        (union AnyValue*)&PROT_NONEValue, false);
+    VariableDefinePlatformVar(pc, NULL, "PROT_READ", &pc->IntType,
+        (union AnyValue*)&PROT_READValue, false);
+    VariableDefinePlatformVar(pc, NULL, "PROT_WRITE", &pc->IntType,
+        (union AnyValue*)&PROT_WRITEValue, false);
+    VariableDefinePlatformVar(pc, NULL, "PROT_EXEC", &pc->IntType,
+        (union AnyValue*)&PROT_EXECValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MAP_SHARED", &pc->IntType,
+        (union AnyValue*)&MAP_SHAREDValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MAP_PRIVATE", &pc->IntType,
+        (union AnyValue*)&MAP_PRIVATEValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MAP_ANONYMOUS", &pc->IntType,
+        (union AnyValue*)&MAP_ANONYMOUSValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MAP_FAILED", pc->VoidPtrType,
+        (union AnyValue*)&MAP_FAILEDValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MS_ASYNC", &pc->IntType,
+        (union AnyValue*)&MS_ASYNCValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MS_SYNC", &pc->IntType,
+        (union AnyValue*)&MS_SYNCValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MS_INVALIDATE", &pc->IntType,
+        (union AnyValue*)&MS_INVALIDATEValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MADV_NORMAL", &pc->IntType,
+        (union AnyValue*)&MADV_NORMALValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MADV_RANDOM", &pc->IntType,
+        (union AnyValue*)&MADV_RANDOMValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MADV_SEQUENTIAL", &pc->IntType,
+        (union AnyValue*)&MADV_SEQUENTIALValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MADV_WILLNEED", &pc->IntType,
+        (union AnyValue*)&MADV_WILLNEEDValue, false);
+    VariableDefinePlatformVar(pc, NULL, "MADV_DONTNEED", &pc->IntType,
+        (union AnyValue*)&MADV_DONTNEEDValue, false);
+}
+
+#endif /* UNIX_HOST */
@@ -21,9 +21,6 @@ static int _IONBFValue = _IONBF;
 static int L_tmpnamValue = L_tmpnam;
 static int GETS_MAXValue = 255;  /* arbitrary maximum size of a gets() file */
 
-static FILE *stdinValue;
-static FILE *stdoutValue;
-static FILE *stderrValue;
 
 
 /* our own internal output stream which can output to FILE * or strings */
@@ -31,7 +28,8 @@ typedef struct StdOutStreamStruct
 {
     FILE *FilePtr;
     char *StrOutPtr;
-    int StrOutLen;
+    int StrOutLen;      /* space left in the string, the terminator included */
+    int Unbounded;      /* sprintf() - there's no limit to the space */
     int CharCount;
 
 } StdOutStream;
@@ -46,29 +44,28 @@ struct StdVararg
 /* initializes the I/O system so error reporting works */
 void BasicIOInit(Picoc *pc)
 {
+    pc->CStdIn = stdin;
     pc->CStdOut = stdout;
-    stdinValue = stdin;
-    stdoutValue = stdout;
-    stderrValue = stderr;
+    pc->CStdErr = stderr;
 }
 
-/* output a single character to either a FILE * or a string */
+/* output a single character to either a FILE * or a string. it's counted
+    even if there's no room for it in the string, like snprintf() does */
 void StdioOutPutc(int OutCh, StdOutStream *Stream)
 {
     if (Stream->FilePtr != NULL) {
         /* output to stdio stream */
         putc(OutCh, Stream->FilePtr);
-        Stream->CharCount++;
-    } else if (Stream->StrOutLen < 0 || Stream->StrOutLen > 1) {
+    } else if (Stream->Unbounded || Stream->StrOutLen > 1) {
         /* output to a string */
         *Stream->StrOutPtr = OutCh;
         Stream->StrOutPtr++;
 
-        if (Stream->StrOutLen > 1)
+        if (!Stream->Unbounded)
             Stream->StrOutLen--;
-
-        Stream->CharCount++;
     }
+
+    Stream->CharCount++;
 }
 
 /* output a string to either a FILE * or a string */
@@ -77,22 +74,35 @@ void StdioOutPuts(const char *Str, StdOutStream *Stream)
     if (Stream->FilePtr != NULL) {
         /* output to stdio stream */
         fputs(Str, Stream->FilePtr);
+        Stream->CharCount += strlen(Str);
     } else {
         /* output to a string */
-        while (*Str != '\0') {
-            if (Stream->StrOutLen < 0 || Stream->StrOutLen > 1) {
-                /* output to a string */
-                *Stream->StrOutPtr = *Str;
-                Str++;
-                Stream->StrOutPtr++;
+        for (; *Str != '\0'; Str++)
+            StdioOutPutc(*Str, Stream);
+    }
+}
 
-                if (Stream->StrOutLen > 1)
-                    Stream->StrOutLen--;
+/* move past what snprintf() has just written to the string. CCount is
+    what it would have written given room, but the position can't go past
+    the last byte of the space, which is kept for the terminator */
+static void StdioStrAdvance(StdOutStream *Stream, int CCount)
+{
+    int Fitted = CCount;
 
-                Stream->CharCount++;
-            }
-        }
+    if (CCount < 0)
+        return;
+
+    Stream->CharCount += CCount;
+    if (Stream->Unbounded) {
+        Stream->StrOutPtr += CCount;
+        return;
     }
+
+    if (Fitted > Stream->StrOutLen - 1)
+        Fitted = (Stream->StrOutLen > 0) ? Stream->StrOutLen - 1 : 0;
+
+    Stream->StrOutPtr += Fitted;
+    Stream->StrOutLen -= Fitted;
 }
 
 /* printf-style format of an int or other word-sized object */
@@ -100,27 +110,24 @@ void StdioFprintfWord(StdOutStream *Stream, const char *Format, unsigned int Val
 {
     if (Stream->FilePtr != NULL)
         Stream->CharCount += fprintf(Stream->FilePtr, Format, Value);
-    else if (Stream->StrOutLen >= 0) {
+    else if (!Stream->Unbounded) {
 #ifndef WIN32
-		int CCount = snprintf(Stream->StrOutPtr, Stream->StrOutLen,
+        int CCount = snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
 #else
-		int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen,
+        int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
 #endif
-		Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
-    } else {
-        int CCount = sprintf(Stream->StrOutPtr, Format, Value);
-        Stream->CharCount += CCount;
-        Stream->StrOutPtr += CCount;
-    }
+        StdioStrAdvance(Stream, CCount);
+    } else
+        StdioStrAdvance(Stream, sprintf(Stream->StrOutPtr, Format, Value));
 }
 
-/* printf-style format of a long */
-void StdioFprintfLong(StdOutStream *Stream, const char *Format, uint64_t Value) {
-    char PlatformFormat[MAX_FORMAT+1], *FPos = PlatformFormat;
+/* turn a printf format for a long into one the platform's printf
+    understands, since it might need eg. %lld */
+static void StdioLongFormat(char *PlatformFormat, const char *Format)
+{
+    char *FPos = PlatformFormat;
 
     while (*Format) {
         char *UseFormat = NULL;
@@ -158,22 +165,25 @@ void StdioFprintfLong(StdOutStream *Stream, const char *Format, uint64_t Value)
         }
     }
 
+    *FPos = '\0';
+}
+
+/* printf-style format of a long. the format has already been through
+    StdioLongFormat() */
+void StdioFprintfLong(StdOutStream *Stream, const char *PlatformFormat,
+    uint64_t Value)
+{
     if (Stream->FilePtr != NULL)
         Stream->CharCount += fprintf(Stream->FilePtr, PlatformFormat, Value);
-    else if (Stream->StrOutLen >= 0) {
+    else if (!Stream->Unbounded) {
 #ifndef WIN32
         int CCount = snprintf(Stream->StrOutPtr, Stream->StrOutLen, PlatformFormat, Value);
 #else
         int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen, PlatformFormat, Value);
 #endif
-        Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
-    } else {
-        int CCount = sprintf(Stream->StrOutPtr, PlatformFormat, Value);
-        Stream->CharCount += CCount;
-        Stream->StrOutPtr += CCount;
-    }
+        StdioStrAdvance(Stream, CCount);
+    } else
+        StdioStrAdvance(Stream, sprintf(Stream->StrOutPtr, PlatformFormat, Value));
 }
 
 /* printf-style format of a floating point number */
@@ -181,7 +191,7 @@ void StdioFprintfFP(StdOutStream *Stream, const char *Format, double Value)
 {
     if (Stream->FilePtr != NULL)
         Stream->CharCount += fprintf(Stream->FilePtr, Format, Value);
-    else if (Stream->StrOutLen >= 0) {
+    else if (!Stream->Unbounded) {
 #ifndef WIN32
         int CCount = snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
@@ -189,14 +199,9 @@ void StdioFprintfFP(StdOutStream *Stream, const char *Format, double Value)
         int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
 #endif
-		Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
-    } else {
-        int CCount = sprintf(Stream->StrOutPtr, Format, Value);
-        Stream->CharCount += CCount;
-        Stream->StrOutPtr += CCount;
-    }
+        StdioStrAdvance(Stream, CCount);
+    } else
+        StdioStrAdvance(Stream, sprintf(Stream->StrOutPtr, Format, Value));
 }
 
 /* printf-style format of a pointer */
@@ -204,221 +209,552 @@ void StdioFprintfPointer(StdOutStream *Stream, const char *Format, void *Value)
 {
     if (Stream->FilePtr != NULL)
         Stream->CharCount += fprintf(Stream->FilePtr, Format, Value);
-    else if (Stream->StrOutLen >= 0) {
+    else if (!Stream->Unbounded) {
 #ifndef WIN32
         int CCount = snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
 #else
-		int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen,
+        int CCount = _snprintf(Stream->StrOutPtr, Stream->StrOutLen,
             Format, Value);
 #endif
-        Stream->StrOutPtr += CCount;
-        Stream->StrOutLen -= CCount;
-        Stream->CharCount += CCount;
+        StdioStrAdvance(Stream, CCount);
+    } else
+        StdioStrAdvance(Stream, sprintf(Stream->StrOutPtr, Format, Value));
+}
+
+/* the steps a compiled printf format is carried out in */
+enum StdioOpKind
+{
+    StdioOpSkip,            /* a conversion we don't know, which uses up an argument */
+    StdioOpText,            /* a span of the format copied out as it is */
+    StdioOpError,           /* %m */
+    StdioOpCount,           /* %n */
+    StdioOpInt,
+    StdioOpLong,
+    StdioOpUnsignedLong,
+    StdioOpFP,
+    StdioOpString,
+    StdioOpPointer
+};
+
+struct StdioFormatOp
+{
+    char Kind;
+    char Conv;              /* the conversion character, eg. 'd' */
+    char Fast;              /* it's plain enough for us to do without libc */
+    int Start;              /* where the text is in Text, or the spec in Specs */
+    int Len;
+};
+
+/* a printf format compiled into a list of steps, so it only has to be
+    picked apart the first time it's used */
+struct StdioFormat
+{
+    struct StdioFormat *Next;
+    const char *Format;     /* where the format was when it was compiled */
+    char *Text;             /* a copy of the format */
+    char *Specs;            /* each conversion, ready to hand to libc */
+    struct StdioFormatOp *Ops;
+    int NumOps;
+};
+
+/* other threads can be looking through the cache while a format is added
+    to it, so a new format is published only once it's complete */
+#ifdef UNIX_HOST
+#define FORMAT_CACHE_READ(b) __atomic_load_n(&(b), __ATOMIC_ACQUIRE)
+#define FORMAT_CACHE_PUBLISH(b, f) __atomic_store_n(&(b), (f), __ATOMIC_RELEASE)
+#else
+#define FORMAT_CACHE_READ(b) (b)
+#define FORMAT_CACHE_PUBLISH(b, f) ((b) = (f))
+#endif
+
+/* add a step to a format being compiled */
+static void StdioAddOp(struct StdioFormatOp *Ops, int *NumOps, int Kind,
+    int Start, int Len)
+{
+    Ops[*NumOps].Kind = Kind;
+    Ops[*NumOps].Conv = '\0';
+    Ops[*NumOps].Fast = false;
+    Ops[*NumOps].Start = Start;
+    Ops[*NumOps].Len = Len;
+    (*NumOps)++;
+}
+
+/* compile a printf format. conversions are worked out the same way the
+    old character at a time loop did, including that an 'l' carries on to
+    the next %d, %i or %u if it isn't used up by this one */
+static struct StdioFormat *StdioCompileFormat(struct ParseState *Parser,
+    const char *Format)
+{
+    Picoc *pc = Parser->pc;
+    int TextLen = strlen(Format);
+    struct StdioFormatOp *Ops;
+    struct StdioFormat *Compiled;
+    char *Specs;
+    char OneFormatBuf[MAX_FORMAT+1];
+    int OneFormatCount;
+    int NumOps = 0;
+    int SpecsLen = 0;
+    int ShowLong = false;
+    int Kind;
+    const char *FPos = Format;
+    const char *TextStart;
+
+    /* a conversion's spec is never more than three times as long as it
+        was in the format, even once it's been through StdioLongFormat() */
+    Ops = HeapAllocMem(pc, sizeof(struct StdioFormatOp) * (TextLen + 1));
+    Specs = HeapAllocMem(pc, TextLen * 3 + MAX_FORMAT * 3 + 1);
+    if (Ops == NULL || Specs == NULL) {
+        HeapFreeMem(pc, Ops);
+        HeapFreeMem(pc, Specs);
+        ProgramFail(Parser, "out of memory");
+    }
+
+    while (*FPos != '\0') {
+        if (*FPos != '%') {
+            /* a run of plain text goes out in one go */
+            TextStart = FPos;
+            while (*FPos != '\0' && *FPos != '%')
+                FPos++;
+
+            StdioAddOp(Ops, &NumOps, StdioOpText, TextStart - Format,
+                FPos - TextStart);
+            continue;
+        }
+
+        /* work out what type we're printing */
+        FPos++;
+        Kind = StdioOpSkip;
+        OneFormatBuf[0] = '%';
+        OneFormatCount = 1;
+
+        do {
+            switch (*FPos) {
+            case 'd':
+            case 'i':
+                Kind = ShowLong ? StdioOpLong : StdioOpInt;
+                ShowLong = false;
+                break;
+            case 'u':
+                if (ShowLong) {
+                    ShowLong = false;
+                    Kind = StdioOpUnsignedLong;
+                } else
+                    Kind = StdioOpInt;
+                break;
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'a':
+            case 'A':
+            case 'c':
+                Kind = StdioOpInt;
+                break;
+            case 'l':
+                ShowLong = true;
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+                Kind = StdioOpFP;
+                break;
+            case 's':
+                Kind = StdioOpString;
+                break;
+            case 'p':
+                Kind = StdioOpPointer;
+                break;
+            case 'n':
+                Kind = StdioOpCount;
+                break;
+            case 'm':
+                Kind = StdioOpError;
+                break;
+            case '%':
+                /* just a '%' character */
+                Kind = StdioOpText;
+                break;
+            case '\0':
+                /* a '%' at the very end, which prints the terminator */
+                Kind = StdioOpText;
+                break;
+            }
+
+            if (*FPos != 'l') {
+                OneFormatBuf[OneFormatCount] = *FPos;
+                OneFormatCount++;
+            }
+
+            if (Kind == StdioOpText || Kind == StdioOpError ||
+                    Kind == StdioOpCount)
+                StdioAddOp(Ops, &NumOps, Kind, FPos - Format, 1);
+
+            if (*FPos == '\0')
+                break;
+
+            FPos++;
+
+        } while (Kind == StdioOpSkip && OneFormatCount < MAX_FORMAT);
+
+        if (Kind == StdioOpText || Kind == StdioOpError ||
+                Kind == StdioOpCount)
+            continue;
+
+        /* a conversion which prints an argument */
+        OneFormatBuf[OneFormatCount] = '\0';
+        StdioAddOp(Ops, &NumOps, Kind, SpecsLen, 0);
+        Ops[NumOps-1].Conv = OneFormatBuf[OneFormatCount-1];
+        Ops[NumOps-1].Fast = OneFormatCount == 2 &&
+            Kind != StdioOpFP && Kind != StdioOpPointer &&
+            Ops[NumOps-1].Conv != 'a' && Ops[NumOps-1].Conv != 'A';
+
+        if (Kind == StdioOpLong || Kind == StdioOpUnsignedLong)
+            StdioLongFormat(&Specs[SpecsLen], OneFormatBuf);
+        else
+            strcpy(&Specs[SpecsLen], OneFormatBuf);
+
+        SpecsLen += strlen(&Specs[SpecsLen]) + 1;
+    }
+
+    /* put it all in one block so it's easy to free */
+    Compiled = HeapAllocMem(pc, sizeof(struct StdioFormat) +
+        sizeof(struct StdioFormatOp) * NumOps + TextLen + 1 + SpecsLen);
+    if (Compiled == NULL) {
+        HeapFreeMem(pc, Ops);
+        HeapFreeMem(pc, Specs);
+        ProgramFail(Parser, "out of memory");
+    }
+
+    Compiled->Format = Format;
+    Compiled->Ops = (struct StdioFormatOp *)(Compiled + 1);
+    Compiled->Text = (char *)&Compiled->Ops[NumOps];
+    Compiled->Specs = Compiled->Text + TextLen + 1;
+    Compiled->NumOps = NumOps;
+    memcpy(Compiled->Ops, Ops, sizeof(struct StdioFormatOp) * NumOps);
+    memcpy(Compiled->Text, Format, TextLen + 1);
+    memcpy(Compiled->Specs, Specs, SpecsLen);
+
+    HeapFreeMem(pc, Ops);
+    HeapFreeMem(pc, Specs);
+    return Compiled;
+}
+
+/* free all the compiled formats */
+void StdioFreeFormats(Picoc *pc)
+{
+    struct StdioFormat *Compiled;
+    struct StdioFormat *Next;
+    int Count;
+
+    for (Count = 0; Count < FORMAT_CACHE_SIZE; Count++) {
+        for (Compiled = pc->FormatCache[Count]; Compiled != NULL;
+                Compiled = Next) {
+            Next = Compiled->Next;
+            HeapFreeMem(pc, Compiled);
+        }
+
+        pc->FormatCache[Count] = NULL;
+    }
+
+    pc->FormatCacheCount = 0;
+}
+
+/* find a format in the cache, or compile it. formats are nearly always
+    string literals, so they're looked up by address, but the text is
+    checked too in case it's a buffer which has changed since. sets
+    Cached to false if the caller has to free the format afterwards */
+static struct StdioFormat *StdioGetFormat(struct ParseState *Parser,
+    const char *Format, int *Cached)
+{
+    Picoc *pc = Parser->pc;
+    int Bucket = ((uintptr_t)Format ^ ((uintptr_t)Format >> 6)) &
+        (FORMAT_CACHE_SIZE-1);
+    struct StdioFormat *Compiled;
+    int Changed = false;
+
+    for (Compiled = FORMAT_CACHE_READ(pc->FormatCache[Bucket]);
+            Compiled != NULL; Compiled = Compiled->Next) {
+        if (Compiled->Format == Format) {
+            if (strcmp(Compiled->Text, Format) == 0) {
+                *Cached = true;
+                return Compiled;
+            }
+
+            Changed = true;
+        }
+    }
+
+    Compiled = StdioCompileFormat(Parser, Format);
+    *Cached = false;
+
+    /* a format that's been changed in place isn't worth keeping */
+    if (Changed)
+        return Compiled;
+
+    ThreadLock(pc);
+
+    /* once it's full it can only be emptied while no other thread might
+        be using it */
+#ifdef UNIX_HOST
+    if (pc->FormatCacheCount >= FORMAT_CACHE_MAX && !pc->Threaded)
+#else
+    if (pc->FormatCacheCount >= FORMAT_CACHE_MAX)
+#endif
+        StdioFreeFormats(pc);
+
+    if (pc->FormatCacheCount < FORMAT_CACHE_MAX) {
+        Compiled->Next = pc->FormatCache[Bucket];
+        FORMAT_CACHE_PUBLISH(pc->FormatCache[Bucket], Compiled);
+        pc->FormatCacheCount++;
+        *Cached = true;
+    }
+
+    ThreadUnlock(pc);
+    return Compiled;
+}
+
+/* output a run of characters to either a FILE * or a string */
+static void StdioOutWrite(const char *Str, int Len, StdOutStream *Stream)
+{
+    if (Stream->FilePtr != NULL) {
+        fwrite(Str, 1, Len, Stream->FilePtr);
+        Stream->CharCount += Len;
     } else {
-        int CCount = sprintf(Stream->StrOutPtr, Format, Value);
-        Stream->CharCount += CCount;
-        Stream->StrOutPtr += CCount;
+        for (; Len > 0; Len--, Str++)
+            StdioOutPutc(*Str, Stream);
+    }
+}
+
+/* output an integer without going through libc */
+static void StdioOutInteger(StdOutStream *Stream, uint64_t Value, int Negative,
+    int Base, const char *Digits)
+{
+    char Buf[24];
+    char *Pos = &Buf[sizeof(Buf)];
+
+    do {
+        *--Pos = Digits[Value % Base];
+        Value /= Base;
+    } while (Value != 0);
+
+    if (Negative)
+        *--Pos = '-';
+
+    StdioOutWrite(Pos, &Buf[sizeof(Buf)] - Pos, Stream);
+}
+
+/* print one argument for a plain conversion like %d or %s. returns false
+    if it has to go through libc after all */
+static int StdioPrintFast(StdOutStream *Stream, struct StdioFormatOp *Op,
+    struct Value *ThisArg)
+{
+    unsigned int Word;
+    int64_t Long;
+    char Ch;
+    char *Str;
+
+    switch (Op->Kind) {
+    case StdioOpInt:
+        Word = (unsigned int)ExpressionCoerceUnsignedInteger(ThisArg);
+        switch (Op->Conv) {
+        case 'd':
+        case 'i':
+            if ((int)Word < 0)
+                StdioOutInteger(Stream, -(int64_t)(int)Word, true, 10,
+                    "0123456789");
+            else
+                StdioOutInteger(Stream, Word, false, 10, "0123456789");
+            break;
+        case 'u':
+            StdioOutInteger(Stream, Word, false, 10, "0123456789");
+            break;
+        case 'o':
+            StdioOutInteger(Stream, Word, false, 8, "01234567");
+            break;
+        case 'x':
+            StdioOutInteger(Stream, Word, false, 16, "0123456789abcdef");
+            break;
+        case 'X':
+            StdioOutInteger(Stream, Word, false, 16, "0123456789ABCDEF");
+            break;
+        case 'c':
+            Ch = (char)Word;
+            StdioOutWrite(&Ch, 1, Stream);
+            break;
+        }
+        return true;
+
+    case StdioOpLong:
+        Long = ThisArg->Val->LongInteger;
+        if (Long < 0)
+            StdioOutInteger(Stream, -(uint64_t)Long, true, 10, "0123456789");
+        else
+            StdioOutInteger(Stream, Long, false, 10, "0123456789");
+        return true;
+
+    case StdioOpUnsignedLong:
+        StdioOutInteger(Stream, ThisArg->Val->UnsignedLongInteger, false, 10,
+            "0123456789");
+        return true;
+
+    case StdioOpString:
+        if (ThisArg->Typ->Base == TypePointer)
+            Str = ThisArg->Val->Pointer;
+        else
+            Str = (char *)&ThisArg->Val->ArrayMem[0];
+
+        /* leave libc to say what it does with NULL */
+        if (Str == NULL)
+            return false;
+
+        StdioOutWrite(Str, strlen(Str), Stream);
+        return true;
+    }
+
+    return false;
+}
+
+/* print one argument for a conversion */
+static void StdioPrintArg(StdOutStream *Stream, struct StdioFormat *Compiled,
+    struct StdioFormatOp *Op, struct Value *ThisArg)
+{
+    char *Spec = &Compiled->Specs[Op->Start];
+
+    switch (Op->Kind) {
+    case StdioOpInt:
+    case StdioOpLong:
+    case StdioOpUnsignedLong:
+    case StdioOpFP:
+        if (!IS_NUMERIC_COERCIBLE(ThisArg)) {
+            StdioOutPuts("XXX", Stream);
+            return;
+        }
+        break;
+    case StdioOpString:
+        if (ThisArg->Typ->Base != TypePointer &&
+                !(ThisArg->Typ->Base == TypeArray &&
+                    ThisArg->Typ->FromType->Base == TypeChar)) {
+            StdioOutPuts("XXX", Stream);
+            return;
+        }
+        break;
+    case StdioOpPointer:
+        if (ThisArg->Typ->Base != TypePointer &&
+                ThisArg->Typ->Base != TypeArray) {
+            StdioOutPuts("XXX", Stream);
+            return;
+        }
+        break;
+    default:
+        return;
+    }
+
+    /* snprintf() is left to libc, which knows how to count what didn't fit */
+    if (Op->Fast && (Stream->FilePtr != NULL || Stream->Unbounded) &&
+            StdioPrintFast(Stream, Op, ThisArg))
+        return;
+
+    switch (Op->Kind) {
+    case StdioOpInt:
+        StdioFprintfWord(Stream, Spec,
+            (unsigned int)ExpressionCoerceUnsignedInteger(ThisArg));
+        break;
+    case StdioOpLong:
+        StdioFprintfLong(Stream, Spec, ThisArg->Val->LongInteger);
+        break;
+    case StdioOpUnsignedLong:
+        StdioFprintfLong(Stream, Spec, ThisArg->Val->UnsignedLongInteger);
+        break;
+    case StdioOpFP:
+        StdioFprintfFP(Stream, Spec, ExpressionCoerceFP(ThisArg));
+        break;
+    case StdioOpString:
+    case StdioOpPointer:
+        if (ThisArg->Typ->Base == TypePointer)
+            StdioFprintfPointer(Stream, Spec, ThisArg->Val->Pointer);
+        else
+            StdioFprintfPointer(Stream, Spec, &ThisArg->Val->ArrayMem[0]);
+        break;
     }
 }
 
 /* internal do-anything v[s][n]printf() formatting system with output
-    to strings or FILE * */
+    to strings or FILE *. the format is compiled the first time it's
+    used and kept in the format cache */
 int StdioBasePrintf(struct ParseState *Parser, FILE *Stream, char *StrOut,
-    int StrOutLen, char *Format, struct StdVararg *Args)
+    int StrOutLen, int Unbounded, char *Format, struct StdVararg *Args)
 {
     struct Value *ThisArg = Args->Param[0];
     int ArgCount = 0;
-    char *FPos;
-    char OneFormatBuf[MAX_FORMAT+1];
-    int OneFormatCount;
-	int ShowLong = 0;
-    struct ValueType *ShowType;
+    struct StdioFormat *Compiled;
+    struct StdioFormatOp *Op;
+    int Cached;
     StdOutStream SOStream;
-    Picoc *pc = Parser->pc;
 
     if (Format == NULL)
         Format = "[null format]\n";
 
-    FPos = Format;
+    Compiled = StdioGetFormat(Parser, Format, &Cached);
     SOStream.FilePtr = Stream;
     SOStream.StrOutPtr = StrOut;
-    SOStream.StrOutLen = StrOutLen;
+    SOStream.StrOutLen = (StrOutLen > 0) ? StrOutLen : 0;
+    SOStream.Unbounded = Unbounded;
     SOStream.CharCount = 0;
 
-    while (*FPos != '\0') {
-        if (*FPos == '%') {
-            /* work out what type we're printing */
-            FPos++;
-            ShowType = NULL;
-            OneFormatBuf[0] = '%';
-            OneFormatCount = 1;
-
-            do {
-                switch (*FPos) {
-                case 'd':
-                case 'i':
-                    if (ShowLong) {
-                        ShowLong = 0;
-                        ShowType = &pc->LongType;
-                    } else {
-                        ShowType = &pc->IntType;
-                    }
-                    break;
-                case 'u':
-                    if (ShowLong) {
-                        ShowLong = 0;
-                        ShowType = &pc->UnsignedLongType;
-                        break;
-                    }
-                case 'o':
-                case 'x':
-                case 'X':
-                    ShowType = &pc->IntType;
-                    break; /* integer base conversions */
-                case 'l':
-                    ShowLong = 1;
-                    break; /* long integer */
-                case 'e':
-                case 'E':
-                    ShowType = &pc->FPType;
-                    break;      /* double, exponent form */
-                case 'f':
-                case 'F':
-                    ShowType = &pc->FPType;
-                    break;      /* double, fixed-point */
-                case 'g':
-                case 'G':
-                    ShowType = &pc->FPType;
-                    break;      /* double, flexible format */
-                case 'a':
-                case 'A':
-                    ShowType = &pc->IntType;
-                    break;     /* hexadecimal, 0x- format */
-                case 'c':
-                    ShowType = &pc->IntType;
-                break;     /* character */
-                case 's':
-                    ShowType = pc->CharPtrType;
-                    break;  /* string */
-                case 'p':
-                    ShowType = pc->VoidPtrType;
-                    break;  /* pointer */
-                case 'n':
-                    ShowType = &pc->VoidType;
-                    break;    /* number of characters written */
-                case 'm':
-                    ShowType = &pc->VoidType;
-                    break;    /* strerror(errno) */
-                case '%':
-                    ShowType = &pc->VoidType;
-                    break;    /* just a '%' character */
-                case '\0':
-                    ShowType = &pc->VoidType;
-                    break;    /* end of format string */
-                }
-
-                /* copy one character of format across to the OneFormatBuf */
-                if (*FPos != 'l') {
-                    OneFormatBuf[OneFormatCount] = *FPos;
-                    OneFormatCount++;
-                }
-                /* do special actions depending on the conversion type */
-                if (ShowType == &pc->VoidType) {
-                    switch (*FPos) {
-                    case 'm':
-                        StdioOutPuts(strerror(errno), &SOStream);
-                        break;
-                    case '%':
-                        StdioOutPutc(*FPos, &SOStream);
-                        break;
-                    case '\0':
-                        OneFormatBuf[OneFormatCount] = '\0';
-                        StdioOutPutc(*FPos, &SOStream);
-                        break;
-                    case 'n':
-                        ThisArg = (struct Value*)((char*)ThisArg +
-                            MEM_ALIGN(sizeof(struct Value) + TypeStackSizeValue(ThisArg)));
-                        if (ThisArg->Typ->Base == TypeArray &&
-                                        ThisArg->Typ->FromType->Base == TypeInt)
-                            *(int *)ThisArg->Val->Pointer = SOStream.CharCount;
-                        break;
-                    }
-                }
+#ifdef UNIX_HOST
+    /* keep the whole line together if other threads are printing too, and
+        so the pieces don't each have to take the stream's lock */
+    if (Stream != NULL)
+        flockfile(Stream);
+#endif
 
-                FPos++;
+    for (Op = Compiled->Ops; Op < &Compiled->Ops[Compiled->NumOps]; Op++) {
+        switch (Op->Kind) {
+        case StdioOpText:
+            StdioOutWrite(&Compiled->Text[Op->Start], Op->Len, &SOStream);
+            break;
 
-            } while (ShowType == NULL && OneFormatCount < MAX_FORMAT);
-
-            if (ShowType != &pc->VoidType) {
-                if (ArgCount >= Args->NumArgs)
-                    StdioOutPuts("XXX", &SOStream);
-                else {
-                    /* null-terminate the buffer */
-                    OneFormatBuf[OneFormatCount] = '\0';
-
-                    /* print this argument */
-                    ThisArg = (struct Value*)((char*)ThisArg +
-                        MEM_ALIGN(sizeof(struct Value)+TypeStackSizeValue(ThisArg)));
-
-                    if (ShowType == &pc->LongType) {
-                        /* show a signed long */
-                        if (IS_NUMERIC_COERCIBLE(ThisArg))
-                                StdioFprintfLong(&SOStream, OneFormatBuf, ThisArg->Val->LongInteger);
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    } else if (ShowType == &pc->UnsignedLongType) {
-                         /* show a unsigned long */
-                        if (IS_NUMERIC_COERCIBLE(ThisArg))
-                                StdioFprintfLong(&SOStream, OneFormatBuf, ThisArg->Val->UnsignedLongInteger);
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    } else if (ShowType == &pc->IntType) {
-                        /* show a signed integer */
-                        if (IS_NUMERIC_COERCIBLE(ThisArg))
-                                StdioFprintfWord(&SOStream, OneFormatBuf, (unsigned int)ExpressionCoerceUnsignedInteger(ThisArg));
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    } else if (ShowType == &pc->FPType) {
-                        /* show a floating point number */
-                        if (IS_NUMERIC_COERCIBLE(ThisArg))
-                            StdioFprintfFP(&SOStream, OneFormatBuf,
-                                ExpressionCoerceFP(ThisArg));
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    } else if (ShowType == pc->CharPtrType) {
-                        if (ThisArg->Typ->Base == TypePointer)
-                            StdioFprintfPointer(&SOStream, OneFormatBuf,
-                                ThisArg->Val->Pointer);
-                        else if (ThisArg->Typ->Base == TypeArray &&
-                                    ThisArg->Typ->FromType->Base == TypeChar)
-                            StdioFprintfPointer(&SOStream, OneFormatBuf,
-                                &ThisArg->Val->ArrayMem[0]);
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    } else if (ShowType == pc->VoidPtrType) {
-                        if (ThisArg->Typ->Base == TypePointer)
-                            StdioFprintfPointer(&SOStream, OneFormatBuf,
-                                ThisArg->Val->Pointer);
-                        else if (ThisArg->Typ->Base == TypeArray)
-                            StdioFprintfPointer(&SOStream, OneFormatBuf,
-                                &ThisArg->Val->ArrayMem[0]);
-                        else
-                            StdioOutPuts("XXX", &SOStream);
-                    }
-
-                    ArgCount++;
-                }
+        case StdioOpError:
+            StdioOutPuts(strerror(errno), &SOStream);
+            break;
+
+        case StdioOpCount:
+            ThisArg = (struct Value*)((char*)ThisArg +
+                MEM_ALIGN(sizeof(struct Value) + TypeStackSizeValue(ThisArg)));
+            if (ThisArg->Typ->Base == TypeArray &&
+                            ThisArg->Typ->FromType->Base == TypeInt)
+                *(int *)ThisArg->Val->Pointer = SOStream.CharCount;
+            break;
+
+        default:
+            if (ArgCount >= Args->NumArgs) {
+                StdioOutPuts("XXX", &SOStream);
+                break;
             }
-        } else {
-            /* just output a normal character */
-            StdioOutPutc(*FPos, &SOStream);
-            FPos++;
+
+            /* print this argument */
+            ThisArg = (struct Value*)((char*)ThisArg +
+                MEM_ALIGN(sizeof(struct Value)+TypeStackSizeValue(ThisArg)));
+            StdioPrintArg(&SOStream, Compiled, Op, ThisArg);
+            ArgCount++;
+            break;
         }
     }
 
-    /* null-terminate */
-    if (SOStream.StrOutPtr != NULL && SOStream.StrOutLen > 0)
+#ifdef UNIX_HOST
+    if (Stream != NULL)
+        funlockfile(Stream);
+#endif
+
+    if (!Cached)
+        HeapFreeMem(Parser->pc, Compiled);
+
+    /* null-terminate, if there's room for it */
+    if (SOStream.StrOutPtr != NULL &&
+            (SOStream.Unbounded || SOStream.StrOutLen > 0))
         *SOStream.StrOutPtr = '\0';
 
     return SOStream.CharCount;
@@ -625,7 +961,8 @@ void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = putchar(Param[0]->Val->Integer);
+    ReturnValue->Val->Integer = putc(Param[0]->Val->Integer,
+        Parser->pc->CStdOut);
 }
 
 void StdioSetbuf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -651,7 +988,12 @@ void StdioUngetc(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioPuts(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = puts(Param[0]->Val->Pointer);
+    IOFILE *Stream = Parser->pc->CStdOut;
+
+    if (fputs(Param[0]->Val->Pointer, Stream) == EOF)
+        ReturnValue->Val->Integer = EOF;
+    else
+        ReturnValue->Val->Integer = putc('\n', Stream);
 }
 
 void StdioGets(struct ParseState *Parser, struct Value *ReturnValue,
@@ -679,15 +1021,15 @@ void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue,
 
     PrintfArgs.Param = Param;
     PrintfArgs.NumArgs = NumArgs - 1;
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0,
-        Param[0]->Val->Pointer, &PrintfArgs);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->CStdOut,
+        NULL, 0, false, Param[0]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioVprintf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0,
-        Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser, Parser->pc->CStdOut,
+        NULL, 0, false, Param[0]->Val->Pointer, Param[1]->Val->Pointer);
 }
 
 void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -698,14 +1040,14 @@ void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue,
     PrintfArgs.Param = Param + 1;
     PrintfArgs.NumArgs = NumArgs - 2;
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, Param[0]->Val->Pointer,
-        NULL, 0, Param[1]->Val->Pointer, &PrintfArgs);
+        NULL, 0, false, Param[1]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioVfprintf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, Param[0]->Val->Pointer,
-        NULL, 0, Param[1]->Val->Pointer, Param[2]->Val->Pointer);
+        NULL, 0, false, Param[1]->Val->Pointer, Param[2]->Val->Pointer);
 }
 
 void StdioSprintf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -716,7 +1058,7 @@ void StdioSprintf(struct ParseState *Parser, struct Value *ReturnValue,
     PrintfArgs.Param = Param + 1;
     PrintfArgs.NumArgs = NumArgs - 2;
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, NULL,
-        Param[0]->Val->Pointer, -1, Param[1]->Val->Pointer, &PrintfArgs);
+        Param[0]->Val->Pointer, 0, true, Param[1]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioSnprintf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -727,8 +1069,8 @@ void StdioSnprintf(struct ParseState *Parser, struct Value *ReturnValue,
     PrintfArgs.Param = Param + 2;
     PrintfArgs.NumArgs = NumArgs - 3;
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, NULL,
-        Param[0]->Val->Pointer, Param[1]->Val->Integer, Param[2]->Val->Pointer,
-        &PrintfArgs);
+        Param[0]->Val->Pointer, Param[1]->Val->Integer, false,
+        Param[2]->Val->Pointer, &PrintfArgs);
 }
 
 void StdioScanf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -768,7 +1110,7 @@ void StdioVsprintf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, NULL,
-        Param[0]->Val->Pointer, -1, Param[1]->Val->Pointer,
+        Param[0]->Val->Pointer, 0, true, Param[1]->Val->Pointer,
         Param[2]->Val->Pointer);
 }
 
@@ -776,8 +1118,8 @@ void StdioVsnprintf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
     ReturnValue->Val->Integer = StdioBasePrintf(Parser, NULL,
-        Param[0]->Val->Pointer, Param[1]->Val->Integer, Param[2]->Val->Pointer,
-        Param[3]->Val->Pointer);
+        Param[0]->Val->Pointer, Param[1]->Val->Integer, false,
+        Param[2]->Val->Pointer, Param[3]->Val->Pointer);
 }
 
 void StdioVscanf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -904,13 +1246,14 @@ void StdioSetupFunc(Picoc *pc)
     VariableDefinePlatformVar(pc, NULL, "GETS_MAX", &pc->IntType,
         (union AnyValue*)&GETS_MAXValue, false);
 
-    /* define stdin, stdout and stderr */
+    /* define stdin, stdout and stderr. they're the interpreter's own
+        so the host can redirect them */
     VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType,
-        (union AnyValue*)&stdinValue, false);
+        (union AnyValue*)&pc->CStdIn, false);
     VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType,
-        (union AnyValue*)&stdoutValue, false);
+        (union AnyValue*)&pc->CStdOut, false);
     VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType,
-        (union AnyValue*)&stderrValue, false);
+        (union AnyValue*)&pc->CStdErr, false);
 
     /* define NULL, true and false */
     if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
@@ -48,27 +48,41 @@ void StdlibStrtoul(struct ParseState *Parser, struct Value *ReturnValue,
 void StdlibMalloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = malloc(Param[0]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapAllocCategory(Parser->pc,
+        Param[0]->Val->Integer, MemProgram);
+    if (ReturnValue->Val->Pointer == NULL)
+        BudgetCheckMemory(Parser);
 }
 
 void StdlibCalloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = calloc(Param[0]->Val->Integer,
-        Param[1]->Val->Integer);
+    int Count = Param[0]->Val->Integer;
+    int Size = Param[1]->Val->Integer;
+
+    if (Count < 0 || Size < 0 || (Size != 0 && Count > INT_MAX / Size))
+        ReturnValue->Val->Pointer = NULL;
+    else
+        ReturnValue->Val->Pointer = HeapAllocCategory(Parser->pc, Count * Size,
+            MemProgram);
+
+    if (ReturnValue->Val->Pointer == NULL)
+        BudgetCheckMemory(Parser);
 }
 
 void StdlibRealloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = realloc(Param[0]->Val->Pointer,
-        Param[1]->Val->Integer);
+    ReturnValue->Val->Pointer = HeapReallocMem(Parser->pc,
+        Param[0]->Val->Pointer, Param[1]->Val->Integer);
+    if (ReturnValue->Val->Pointer == NULL)
+        BudgetCheckMemory(Parser);
 }
 
 void StdlibFree(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    free(Param[0]->Val->Pointer);
+    HeapFreeMem(Parser->pc, Param[0]->Val->Pointer);
 }
 
 void StdlibRand(struct ParseState *Parser, struct Value *ReturnValue,
@@ -107,15 +121,78 @@ void StdlibSystem(struct ParseState *Parser, struct Value *ReturnValue,
     ReturnValue->Val->Integer = system(Param[0]->Val->Pointer);
 }
 
-#if 0
+/* the comparison function qsort() and bsearch() are calling back to */
+struct StdlibCompare {
+    struct ParseState *Parser;
+    struct Value *Func;
+};
+
+static THREAD_LOCAL struct StdlibCompare *StdlibCompareWith;
+
+static int StdlibCompareCallback(const void *Left, const void *Right)
+{
+    union AnyValue Args[2];
+    union AnyValue Result;
+    struct Value ResultValue;
+
+    Args[0].Pointer = (void *)Left;
+    Args[1].Pointer = (void *)Right;
+    ExpressionCallback(StdlibCompareWith->Parser, StdlibCompareWith->Func,
+        Args, 2, &Result);
+
+    /* the result is whatever type the comparison function returns, so only
+        its sign can be passed back as an int */
+    ResultValue.Typ = StdlibCompareWith->Func->Val->FuncDef.ReturnType;
+    ResultValue.Val = &Result;
+    if (IS_FP(&ResultValue)) {
+        return (Result.FP > 0) - (Result.FP < 0);
+    } else {
+        long Sign = ExpressionCoerceInteger(&ResultValue);
+        return (Sign > 0) - (Sign < 0);
+    }
+}
+
+/* find the comparison function and check it returns a number */
+static struct Value *StdlibGetCompare(struct ParseState *Parser, void *Func)
+{
+    struct Value *FuncValue = LibraryGetCallback(Parser, Func);
+
+    if (!IS_INTEGER_NUMERIC_TYPE(FuncValue->Val->FuncDef.ReturnType) &&
+            FuncValue->Val->FuncDef.ReturnType->Base != TypeFP)
+        ProgramFail(Parser, "comparison function %s() doesn't return a number",
+            FuncValue->Val->FuncDef.Name);
+
+    return FuncValue;
+}
+
+void StdlibQsort(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct StdlibCompare Compare;
+    struct StdlibCompare *OldCompare = StdlibCompareWith;
+
+    Compare.Parser = Parser;
+    Compare.Func = StdlibGetCompare(Parser, Param[3]->Val->Pointer);
+    StdlibCompareWith = &Compare;
+    qsort(Param[0]->Val->Pointer, Param[1]->Val->Integer,
+        Param[2]->Val->Integer, StdlibCompareCallback);
+    StdlibCompareWith = OldCompare;
+}
+
 void StdlibBsearch(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
+    struct StdlibCompare Compare;
+    struct StdlibCompare *OldCompare = StdlibCompareWith;
+
+    Compare.Parser = Parser;
+    Compare.Func = StdlibGetCompare(Parser, Param[4]->Val->Pointer);
+    StdlibCompareWith = &Compare;
     ReturnValue->Val->Pointer = bsearch(Param[0]->Val->Pointer,
         Param[1]->Val->Pointer, Param[2]->Val->Integer, Param[3]->Val->Integer,
-        (int (*)())Param[4]->Val->Pointer);
+        StdlibCompareCallback);
+    StdlibCompareWith = OldCompare;
 }
-#endif
 
 void StdlibAbs(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
@@ -177,8 +254,8 @@ struct LibraryFunction StdlibFunctions[] =
     {StdlibExit, "void exit(int);"},
     {StdlibGetenv, "char *getenv(char *);"},
     {StdlibSystem, "int system(char *);"},
-/*    {StdlibBsearch, "void *bsearch(void *,void *,int,int,int (*)());"}, */
-/*    {StdlibQsort, "void *qsort(void *,int,int,int (*)());"}, */
+    {StdlibBsearch, "void *bsearch(void *,void *,int,int,void *);"},
+    {StdlibQsort, "void qsort(void *,int,int,void *);"},
     {StdlibAbs, "int abs(int);"},
     {StdlibLabs, "int labs(int);"},
 #if 0
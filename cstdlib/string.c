@@ -178,7 +178,15 @@ void StringStrxfrm(struct ParseState *Parser, struct Value *ReturnValue,
 void StringStrdup(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = (void*)strdup(Param[0]->Val->Pointer);
+    const char *Str = Param[0]->Val->Pointer;
+    char *Copy = HeapAllocCategory(Parser->pc, strlen(Str) + 1, MemProgram);
+
+    if (Copy != NULL)
+        strcpy(Copy, Str);
+    else
+        BudgetCheckMemory(Parser);
+
+    ReturnValue->Val->Pointer = Copy;
 }
 
 void StringStrtok_r(struct ParseState *Parser, struct Value *ReturnValue,
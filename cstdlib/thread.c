@@ -0,0 +1,443 @@
+/* thread.h - lets a program run its functions on several threads at once.
+ * the threads share the program's globals but each has its own stack */
+#include "../interpreter.h"
+
+#ifdef UNIX_HOST
+
+/* a thread the program started with thread_create() */
+struct ScriptThread {
+    struct ThreadState State;
+    pthread_t Thread;
+    struct Value *Func;
+    union AnyValue Arg;
+    int First;                  /* the indexes a parallel_for() worker runs */
+    int Last;
+    int *Stop;                  /* set when a parallel_for() worker fails */
+    int Started;
+    int Failed;
+    jmp_buf ExitBuf;
+    int ExitValue;
+};
+
+
+/* set up the lock threads use when changing anything they share */
+void ThreadInit(Picoc *pc)
+{
+    pthread_mutexattr_t Attr;
+
+    /* a recursive lock, since eg. defining a library function can need
+        a new type */
+    pthread_mutexattr_init(&Attr);
+    pthread_mutexattr_settype(&Attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&pc->SharedLock, &Attr);
+    pthread_mutexattr_destroy(&Attr);
+}
+
+/* take the shared lock. it's only needed once the program has started
+    a thread */
+void ThreadLock(Picoc *pc)
+{
+    if (!pc->Threaded)
+        return;
+
+    pthread_mutex_lock(&pc->SharedLock);
+    THREAD(pc)->LockDepth++;
+}
+
+void ThreadUnlock(Picoc *pc)
+{
+    struct ThreadState *Thread = THREAD(pc);
+
+    if (Thread->LockDepth == 0)
+        return;
+
+    Thread->LockDepth--;
+    pthread_mutex_unlock(&pc->SharedLock);
+}
+
+/* a thread starts here. exit() and errors end just this thread */
+static void *ThreadMain(void *Arg)
+{
+    struct ScriptThread *NewThread = Arg;
+    Picoc *pc = NewThread->State.pc;
+    struct FuncDef *Func = &NewThread->Func->Val->FuncDef;
+    struct ParseState Parser;
+    union AnyValue Result;
+    char StackMarker;
+
+    NewThread->State.NativeStackBase = &StackMarker;
+    ThreadCurrent = &NewThread->State;
+    if (!setjmp(NewThread->ExitBuf)) {
+        LexInitParser(&Parser, pc, NULL, NULL, (char*)Func->Name, true, false);
+        ExpressionCallback(&Parser, NewThread->Func, &NewThread->Arg,
+            Func->NumParams, &Result);
+        if (Func->ReturnType != &pc->VoidType)
+            NewThread->ExitValue = Result.Integer;
+    }
+
+    BudgetThreadEnd(&NewThread->State);
+    ThreadCurrent = NULL;
+    return NULL;
+}
+
+/* call a parallel_for() function for each index from First up to Last */
+static void ThreadParallelRange(struct ParseState *Parser, struct Value *Func,
+    int First, int Last, void *Context)
+{
+    union AnyValue Args[2];
+    int Index;
+
+    Args[1].Pointer = Context;
+    for (Index = First; Index < Last; Index++) {
+        Args[0].Integer = Index;
+        ExpressionCallback(Parser, Func, Args, Func->Val->FuncDef.NumParams,
+            NULL);
+    }
+}
+
+/* a parallel_for() worker starts here. it calls the function for each of
+    its indexes in turn, and stops early if another worker has failed */
+static void *ThreadParallelMain(void *Arg)
+{
+    struct ScriptThread *Worker = Arg;
+    Picoc *pc = Worker->State.pc;
+    struct FuncDef *Func = &Worker->Func->Val->FuncDef;
+    struct ParseState Parser;
+    int Index;
+    char StackMarker;
+
+    Worker->State.NativeStackBase = &StackMarker;
+    ThreadCurrent = &Worker->State;
+    if (!setjmp(Worker->ExitBuf)) {
+        LexInitParser(&Parser, pc, NULL, NULL, (char*)Func->Name, true, false);
+        for (Index = Worker->First; Index < Worker->Last &&
+                !__atomic_load_n(Worker->Stop, __ATOMIC_RELAXED); Index++)
+            ThreadParallelRange(&Parser, Worker->Func, Index, Index + 1,
+                Worker->Arg.Pointer);
+    } else {
+        Worker->Failed = true;
+        __atomic_store_n(Worker->Stop, true, __ATOMIC_RELAXED);
+    }
+
+    BudgetThreadEnd(&Worker->State);
+    ThreadCurrent = NULL;
+    return NULL;
+}
+
+/* give a thread its own heap stack and start it running Main. returns
+    false if it couldn't be started */
+static int ThreadStart(Picoc *pc, struct ScriptThread *NewThread,
+    void *(*Main)(void *))
+{
+    pthread_attr_t Attr;
+    int Started;
+
+    /* the new thread gets a stack the same size as ours */
+    HeapInitStack(&NewThread->State, pc->MainThread.StackSize);
+    if (NewThread->State.HeapMemory == NULL)
+        return false;
+
+    NewThread->State.pc = pc;
+    NewThread->State.NativeStackLimit = PlatformNativeStackSize();
+    NewThread->State.ExitBuf = &NewThread->ExitBuf;
+    NewThread->State.ExitValue = &NewThread->ExitValue;
+    LexInitThread(&NewThread->State);
+
+    /* from now on anything shared has to be changed under the lock */
+    if (!pc->Threaded)
+        pc->Threaded = true;
+
+    pthread_attr_init(&Attr);
+    pthread_attr_setstacksize(&Attr,
+        PlatformNativeStackSize() + NATIVE_STACK_MARGIN);
+    Started = pthread_create(&NewThread->Thread, &Attr, Main, NewThread) == 0;
+    pthread_attr_destroy(&Attr);
+
+    if (!Started) {
+        free(NewThread->State.HeapMemory);
+        NewThread->State.HeapMemory = NULL;
+    }
+
+    return Started;
+}
+
+/* wait for a thread to finish and free its heap stack */
+static void ThreadFinish(struct ScriptThread *Thread)
+{
+    pthread_join(Thread->Thread, NULL);
+    free(Thread->State.HeapMemory);
+}
+
+/* thread_t thread_create(void *func, void *arg); */
+void ThreadCreate(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    Picoc *pc = Parser->pc;
+    struct Value *Func = LibraryGetCallback(Parser, Param[0]->Val->Pointer);
+    struct ScriptThread *NewThread;
+
+    if (Func->Val->FuncDef.NumParams > 1)
+        ProgramFail(Parser, "%s() can only take one argument to run as a thread",
+            Func->Val->FuncDef.Name);
+
+    ReturnValue->Val->Pointer = NULL;
+    NewThread = HeapAllocMem(pc, sizeof(struct ScriptThread));
+    if (NewThread == NULL)
+        return;
+
+    NewThread->Func = Func;
+    NewThread->Arg.Pointer = Param[1]->Val->Pointer;
+    if (!ThreadStart(pc, NewThread, ThreadMain)) {
+        HeapFreeMem(pc, NewThread);
+        return;
+    }
+
+    ReturnValue->Val->Pointer = NewThread;
+}
+
+/* int thread_join(thread_t thread); */
+void ThreadJoin(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ScriptThread *Thread = Param[0]->Val->Pointer;
+
+    if (Thread == NULL)
+        ProgramFail(Parser, "can't join a thread which didn't start");
+
+    ThreadFinish(Thread);
+    ReturnValue->Val->Integer = Thread->ExitValue;
+    HeapFreeMem(Parser->pc, Thread);
+}
+
+/* void parallel_for(int start, int end, void *func, void *ctx); calls
+    func(i, ctx) for each i from start up to end, splitting the range
+    between one worker per cpu. if func fails or exits the whole loop
+    does too, once all the workers have stopped */
+void ThreadParallelFor(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    Picoc *pc = Parser->pc;
+    int Start = Param[0]->Val->Integer;
+    int End = Param[1]->Val->Integer;
+    struct Value *Func = LibraryGetCallback(Parser, Param[2]->Val->Pointer);
+    struct ScriptThread *Workers;
+    long NumWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    int Stop = false;
+    int ExitValue;
+    int Count;
+
+    if (Func->Val->FuncDef.NumParams < 1 || Func->Val->FuncDef.NumParams > 2)
+        ProgramFail(Parser, "%s() should take an index and optionally a "
+            "context to run in parallel_for()", Func->Val->FuncDef.Name);
+
+    if (End <= Start)
+        return;
+
+    if (NumWorkers < 1)
+        NumWorkers = 1;
+    if (NumWorkers > End - Start)
+        NumWorkers = End - Start;
+
+    Workers = HeapAllocMem(pc, sizeof(struct ScriptThread) * NumWorkers);
+    if (Workers == NULL)
+        ProgramFail(Parser, "out of memory");
+
+    /* each worker gets an even share of the range, in order */
+    for (Count = 0; Count < NumWorkers; Count++) {
+        Workers[Count].Func = Func;
+        Workers[Count].Arg.Pointer = Param[3]->Val->Pointer;
+        Workers[Count].First = Start + (int)((long long)(End - Start) * Count / NumWorkers);
+        Workers[Count].Last = Start + (int)((long long)(End - Start) * (Count + 1) / NumWorkers);
+        Workers[Count].Stop = &Stop;
+        Workers[Count].Failed = false;
+        Workers[Count].ExitValue = 0;
+        Workers[Count].Started = ThreadStart(pc, &Workers[Count],
+            ThreadParallelMain);
+    }
+
+    for (Count = 0; Count < NumWorkers; Count++) {
+        if (Workers[Count].Started)
+            ThreadFinish(&Workers[Count]);
+    }
+
+    for (Count = 0; Count < NumWorkers; Count++) {
+        if (Workers[Count].Failed) {
+            ExitValue = Workers[Count].ExitValue;
+            HeapFreeMem(pc, Workers);
+            PlatformExit(pc, ExitValue);
+        }
+    }
+
+    /* a share whose worker couldn't be started is done here instead */
+    for (Count = 0; Count < NumWorkers; Count++) {
+        if (!Workers[Count].Started)
+            ThreadParallelRange(Parser, Func, Workers[Count].First,
+                Workers[Count].Last, Param[3]->Val->Pointer);
+    }
+
+    HeapFreeMem(pc, Workers);
+}
+
+/* int cpu_count(); */
+void ThreadCpuCount(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    ReturnValue->Val->Integer = (Count > 0) ? (int)Count : 1;
+}
+
+void ThreadMutexCreate(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_mutex_t *Mutex = HeapAllocMem(Parser->pc, sizeof(pthread_mutex_t));
+
+    if (Mutex != NULL)
+        pthread_mutex_init(Mutex, NULL);
+
+    ReturnValue->Val->Pointer = Mutex;
+}
+
+void ThreadMutexDestroy(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_mutex_destroy(Param[0]->Val->Pointer);
+    HeapFreeMem(Parser->pc, Param[0]->Val->Pointer);
+}
+
+void ThreadMutexLock(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_mutex_lock(Param[0]->Val->Pointer);
+}
+
+void ThreadMutexTrylock(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = pthread_mutex_trylock(Param[0]->Val->Pointer) == 0;
+}
+
+void ThreadMutexUnlock(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_mutex_unlock(Param[0]->Val->Pointer);
+}
+
+void ThreadCondCreate(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_cond_t *Cond = HeapAllocMem(Parser->pc, sizeof(pthread_cond_t));
+
+    if (Cond != NULL)
+        pthread_cond_init(Cond, NULL);
+
+    ReturnValue->Val->Pointer = Cond;
+}
+
+void ThreadCondDestroy(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_cond_destroy(Param[0]->Val->Pointer);
+    HeapFreeMem(Parser->pc, Param[0]->Val->Pointer);
+}
+
+void ThreadCondWait(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_cond_wait(Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+}
+
+void ThreadCondSignal(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_cond_signal(Param[0]->Val->Pointer);
+}
+
+void ThreadCondBroadcast(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    pthread_cond_broadcast(Param[0]->Val->Pointer);
+}
+
+void ThreadAtomicLoad(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = __atomic_load_n((int*)Param[0]->Val->Pointer,
+        __ATOMIC_SEQ_CST);
+}
+
+void ThreadAtomicStore(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    __atomic_store_n((int*)Param[0]->Val->Pointer, Param[1]->Val->Integer,
+        __ATOMIC_SEQ_CST);
+}
+
+void ThreadAtomicAdd(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = __atomic_add_fetch((int*)Param[0]->Val->Pointer,
+        Param[1]->Val->Integer, __ATOMIC_SEQ_CST);
+}
+
+void ThreadAtomicExchange(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = __atomic_exchange_n((int*)Param[0]->Val->Pointer,
+        Param[1]->Val->Integer, __ATOMIC_SEQ_CST);
+}
+
+void ThreadAtomicCas(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    int Expected = Param[1]->Val->Integer;
+
+    ReturnValue->Val->Integer = __atomic_compare_exchange_n(
+        (int*)Param[0]->Val->Pointer, &Expected, Param[2]->Val->Integer, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/* handy structure definitions */
+const char ThreadDefs[] = "\
+typedef struct __ThreadStruct *thread_t; \
+typedef struct __MutexStruct *mutex_t; \
+typedef struct __CondStruct *cond_t; \
+";
+
+/* all thread.h functions */
+struct LibraryFunction ThreadFunctions[] =
+{
+    {ThreadCreate, "thread_t thread_create(void *,void *);"},
+    {ThreadJoin, "int thread_join(thread_t);"},
+    {ThreadCpuCount, "int cpu_count();"},
+    {ThreadParallelFor, "void parallel_for(int,int,void *,void *);"},
+    {ThreadMutexCreate, "mutex_t mutex_create();"},
+    {ThreadMutexDestroy, "void mutex_destroy(mutex_t);"},
+    {ThreadMutexLock, "void mutex_lock(mutex_t);"},
+    {ThreadMutexTrylock, "int mutex_trylock(mutex_t);"},
+    {ThreadMutexUnlock, "void mutex_unlock(mutex_t);"},
+    {ThreadCondCreate, "cond_t cond_create();"},
+    {ThreadCondDestroy, "void cond_destroy(cond_t);"},
+    {ThreadCondWait, "void cond_wait(cond_t,mutex_t);"},
+    {ThreadCondSignal, "void cond_signal(cond_t);"},
+    {ThreadCondBroadcast, "void cond_broadcast(cond_t);"},
+    {ThreadAtomicLoad, "int atomic_load(int *);"},
+    {ThreadAtomicStore, "void atomic_store(int *,int);"},
+    {ThreadAtomicAdd, "int atomic_add(int *,int);"},
+    {ThreadAtomicExchange, "int atomic_exchange(int *,int);"},
+    {ThreadAtomicCas, "int atomic_cas(int *,int,int);"},
+    {NULL, NULL}
+};
+
+/* creates the opaque types the handles point to */
+void ThreadSetupFunc(Picoc *pc)
+{
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "__ThreadStruct"),
+        sizeof(struct ScriptThread));
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "__MutexStruct"),
+        sizeof(pthread_mutex_t));
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "__CondStruct"),
+        sizeof(pthread_cond_t));
+}
+
+#endif /* UNIX_HOST */
@@ -137,8 +137,26 @@ void UnistdFtruncate(struct ParseState *Parser, struct Value *ReturnValue,
 void UnistdGetcwd(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = getcwd(Param[0]->Val->Pointer,
-        Param[1]->Val->Integer);
+    char *Buf = Param[0]->Val->Pointer;
+    int Size = Param[1]->Val->Integer;
+
+    /* getcwd(NULL, size) malloc()s the buffer, so it has to come from the
+        heap for the program to free() it */
+    if (Buf == NULL) {
+        if (Size <= 0)
+            Size = PATH_MAX;
+
+        Buf = HeapAllocCategory(Parser->pc, Size, MemProgram);
+        if (Buf == NULL) {
+            BudgetCheckMemory(Parser);
+            ReturnValue->Val->Pointer = NULL;
+            return;
+        }
+    }
+
+    ReturnValue->Val->Pointer = getcwd(Buf, Size);
+    if (ReturnValue->Val->Pointer == NULL && Buf != Param[0]->Val->Pointer)
+        HeapFreeMem(Parser->pc, Buf);
 }
 
 void UnistdGetdtablesize(struct ParseState *Parser, struct Value *ReturnValue,
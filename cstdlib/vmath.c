@@ -0,0 +1,253 @@
+/* vmath.h - math on whole arrays of doubles at once. a kernel written as a
+ * few of these calls runs as native loops instead of an interpreted loop
+ * making a library call for every element */
+#include <math.h>
+
+#include "../interpreter.h"
+
+#ifndef NO_FP
+
+/* check an array length passed to one of the vec_ functions */
+static void VmathCheckLength(struct ParseState *Parser, int Len, int Min)
+{
+    if (Len < Min)
+        ProgramFail(Parser, "array length %d is too small", Len);
+}
+
+/* void vec_xxx(double *out, double *in, int n); out[i] = xxx(in[i]). out
+    may be the same array as in */
+#define VMATH_MAP(Name, Func) \
+static void Name(struct ParseState *Parser, struct Value *ReturnValue, \
+    struct Value **Param, int NumArgs) \
+{ \
+    double *Out = Param[0]->Val->Pointer; \
+    double *In = Param[1]->Val->Pointer; \
+    int Len = Param[2]->Val->Integer; \
+    int Count; \
+    \
+    VmathCheckLength(Parser, Len, 0); \
+    for (Count = 0; Count < Len; Count++) \
+        Out[Count] = Func(In[Count]); \
+}
+
+/* void vec_xxx(double *out, double *a, double *b, int n);
+    out[i] = a[i] op b[i] */
+#define VMATH_OP(Name, Op) \
+static void Name(struct ParseState *Parser, struct Value *ReturnValue, \
+    struct Value **Param, int NumArgs) \
+{ \
+    double *Out = Param[0]->Val->Pointer; \
+    double *A = Param[1]->Val->Pointer; \
+    double *B = Param[2]->Val->Pointer; \
+    int Len = Param[3]->Val->Integer; \
+    int Count; \
+    \
+    VmathCheckLength(Parser, Len, 0); \
+    for (Count = 0; Count < Len; Count++) \
+        Out[Count] = A[Count] Op B[Count]; \
+}
+
+VMATH_MAP(VmathSin, sin)
+VMATH_MAP(VmathCos, cos)
+VMATH_MAP(VmathTan, tan)
+VMATH_MAP(VmathAsin, asin)
+VMATH_MAP(VmathAcos, acos)
+VMATH_MAP(VmathAtan, atan)
+VMATH_MAP(VmathSinh, sinh)
+VMATH_MAP(VmathCosh, cosh)
+VMATH_MAP(VmathTanh, tanh)
+VMATH_MAP(VmathExp, exp)
+VMATH_MAP(VmathLog, log)
+VMATH_MAP(VmathLog10, log10)
+VMATH_MAP(VmathSqrt, sqrt)
+VMATH_MAP(VmathFabs, fabs)
+VMATH_MAP(VmathFloor, floor)
+VMATH_MAP(VmathCeil, ceil)
+VMATH_MAP(VmathRound, round)
+
+VMATH_OP(VmathAdd, +)
+VMATH_OP(VmathSub, -)
+VMATH_OP(VmathMul, *)
+VMATH_OP(VmathDiv, /)
+
+/* void vec_pow(double *out, double *in, double p, int n); */
+static void VmathPow(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *Out = Param[0]->Val->Pointer;
+    double *In = Param[1]->Val->Pointer;
+    double Power = Param[2]->Val->FP;
+    int Len = Param[3]->Val->Integer;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count < Len; Count++)
+        Out[Count] = pow(In[Count], Power);
+}
+
+/* void vec_scale(double *out, double *in, double a, int n); out = a*in */
+static void VmathScale(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *Out = Param[0]->Val->Pointer;
+    double *In = Param[1]->Val->Pointer;
+    double Scale = Param[2]->Val->FP;
+    int Len = Param[3]->Val->Integer;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count < Len; Count++)
+        Out[Count] = Scale * In[Count];
+}
+
+/* void vec_axpy(double *y, double a, double *x, int n); y += a*x */
+static void VmathAxpy(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *Y = Param[0]->Val->Pointer;
+    double Scale = Param[1]->Val->FP;
+    double *X = Param[2]->Val->Pointer;
+    int Len = Param[3]->Val->Integer;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count < Len; Count++)
+        Y[Count] += Scale * X[Count];
+}
+
+/* void vec_fill(double *out, double value, int n); */
+static void VmathFill(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *Out = Param[0]->Val->Pointer;
+    double Fill = Param[1]->Val->FP;
+    int Len = Param[2]->Val->Integer;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count < Len; Count++)
+        Out[Count] = Fill;
+}
+
+/* double vec_dot(double *a, double *b, int n); the products are added up
+    in four running sums, which lets the loop overlap its additions */
+static void VmathDot(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *A = Param[0]->Val->Pointer;
+    double *B = Param[1]->Val->Pointer;
+    int Len = Param[2]->Val->Integer;
+    double Sum[4] = {0.0, 0.0, 0.0, 0.0};
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count + 4 <= Len; Count += 4) {
+        Sum[0] += A[Count] * B[Count];
+        Sum[1] += A[Count+1] * B[Count+1];
+        Sum[2] += A[Count+2] * B[Count+2];
+        Sum[3] += A[Count+3] * B[Count+3];
+    }
+
+    for (; Count < Len; Count++)
+        Sum[0] += A[Count] * B[Count];
+
+    ReturnValue->Val->FP = (Sum[0] + Sum[1]) + (Sum[2] + Sum[3]);
+}
+
+/* double vec_sum(double *in, int n); added up the same way as vec_dot() */
+static void VmathSum(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *In = Param[0]->Val->Pointer;
+    int Len = Param[1]->Val->Integer;
+    double Sum[4] = {0.0, 0.0, 0.0, 0.0};
+    int Count;
+
+    VmathCheckLength(Parser, Len, 0);
+    for (Count = 0; Count + 4 <= Len; Count += 4) {
+        Sum[0] += In[Count];
+        Sum[1] += In[Count+1];
+        Sum[2] += In[Count+2];
+        Sum[3] += In[Count+3];
+    }
+
+    for (; Count < Len; Count++)
+        Sum[0] += In[Count];
+
+    ReturnValue->Val->FP = (Sum[0] + Sum[1]) + (Sum[2] + Sum[3]);
+}
+
+/* double vec_min(double *in, int n); */
+static void VmathMin(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *In = Param[0]->Val->Pointer;
+    int Len = Param[1]->Val->Integer;
+    double Min;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 1);
+    Min = In[0];
+    for (Count = 1; Count < Len; Count++) {
+        if (In[Count] < Min)
+            Min = In[Count];
+    }
+
+    ReturnValue->Val->FP = Min;
+}
+
+/* double vec_max(double *in, int n); */
+static void VmathMax(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    double *In = Param[0]->Val->Pointer;
+    int Len = Param[1]->Val->Integer;
+    double Max;
+    int Count;
+
+    VmathCheckLength(Parser, Len, 1);
+    Max = In[0];
+    for (Count = 1; Count < Len; Count++) {
+        if (In[Count] > Max)
+            Max = In[Count];
+    }
+
+    ReturnValue->Val->FP = Max;
+}
+
+/* all vmath.h functions */
+struct LibraryFunction VmathFunctions[] =
+{
+    {VmathSin, "void vec_sin(double *,double *,int);"},
+    {VmathCos, "void vec_cos(double *,double *,int);"},
+    {VmathTan, "void vec_tan(double *,double *,int);"},
+    {VmathAsin, "void vec_asin(double *,double *,int);"},
+    {VmathAcos, "void vec_acos(double *,double *,int);"},
+    {VmathAtan, "void vec_atan(double *,double *,int);"},
+    {VmathSinh, "void vec_sinh(double *,double *,int);"},
+    {VmathCosh, "void vec_cosh(double *,double *,int);"},
+    {VmathTanh, "void vec_tanh(double *,double *,int);"},
+    {VmathExp, "void vec_exp(double *,double *,int);"},
+    {VmathLog, "void vec_log(double *,double *,int);"},
+    {VmathLog10, "void vec_log10(double *,double *,int);"},
+    {VmathSqrt, "void vec_sqrt(double *,double *,int);"},
+    {VmathFabs, "void vec_fabs(double *,double *,int);"},
+    {VmathFloor, "void vec_floor(double *,double *,int);"},
+    {VmathCeil, "void vec_ceil(double *,double *,int);"},
+    {VmathRound, "void vec_round(double *,double *,int);"},
+    {VmathPow, "void vec_pow(double *,double *,double,int);"},
+    {VmathAdd, "void vec_add(double *,double *,double *,int);"},
+    {VmathSub, "void vec_sub(double *,double *,double *,int);"},
+    {VmathMul, "void vec_mul(double *,double *,double *,int);"},
+    {VmathDiv, "void vec_div(double *,double *,double *,int);"},
+    {VmathScale, "void vec_scale(double *,double *,double,int);"},
+    {VmathAxpy, "void vec_axpy(double *,double,double *,int);"},
+    {VmathFill, "void vec_fill(double *,double,int);"},
+    {VmathDot, "double vec_dot(double *,double *,int);"},
+    {VmathSum, "double vec_sum(double *,int);"},
+    {VmathMin, "double vec_min(double *,int);"},
+    {VmathMax, "double vec_max(double *,int);"},
+    {NULL, NULL}
+};
+
+#endif /* !NO_FP */
@@ -124,7 +124,7 @@ static void ExpressionParseFunctionCall(struct ParseState *Parser, struct Expres
 /* show the contents of the expression stack */
 void ExpressionStackShow(Picoc *pc, struct ExpressionStack *StackTop)
 {
-    printf("Expression stack [0x%lx,0x%lx]: ", (long)pc->HeapStackTop, (long)StackTop);
+    printf("Expression stack [0x%lx,0x%lx]: ", (long)THREAD(pc)->HeapStackTop, (long)StackTop);
 
     while (StackTop != NULL) {
         if (StackTop->Order == OrderNone) {
@@ -488,6 +488,10 @@ void ExpressionAssignToPointer(struct ParseState *Parser, struct Value *ToValue,
         /* the form is: blah *x = pointer to array of blah */
         ToValue->Val->Pointer = VariableDereferencePointer(FromValue, NULL,
             NULL, NULL, NULL);
+    } else if (ToValue->Typ == Parser->pc->VoidPtrType &&
+            FromValue->Typ->Base == TypeFunction) {
+        /* a function passed as a callback, see LibraryGetCallback() */
+        ToValue->Val->Pointer = (void *)FromValue->Val;
     } else if (IS_NUMERIC_COERCIBLE(FromValue) &&
             ExpressionCoerceInteger(FromValue) == 0) {
         /* null pointer assignment */
@@ -1437,11 +1441,13 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
     printf("ExpressionParse():\n");
 #endif
 
+    VariableCheckNativeStack(Parser);
+
     do {
         struct ParseState PreState;
         enum LexToken Token;
 
-        ParserCopy(&PreState, Parser);
+        ParserCopyPos(&PreState, Parser);
         Token = LexGetToken(Parser, &LexValue, true);
         if ((((int)Token > TokenComma && (int)Token <= (int)TokenOpenBracket) ||
                (Token == TokenCloseBracket && BracketPrecedence != 0)) &&
@@ -1520,7 +1526,7 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                         if (BracketPrecedence == 0) {
                             /* assume this bracket is after the end of the
                                 expression */
-                            ParserCopy(Parser, &PreState);
+                            ParserCopyPos(Parser, &PreState);
                             Done = true;
                         } else {
                             /* collapse to the bracket precedence */
@@ -1663,7 +1669,7 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
                 ProgramFail(Parser, "type not expected here");
 
             PrefixState = false;
-            ParserCopy(Parser, &PreState);
+            ParserCopyPos(Parser, &PreState);
             TypeParse(Parser, &Typ, &Identifier, NULL);
             TypeValue = VariableAllocValueFromType(Parser->pc, Parser,
                 &Parser->pc->TypeType, false, NULL, false);
@@ -1671,7 +1677,7 @@ int ExpressionParse(struct ParseState *Parser, struct Value **Result)
             ExpressionStackPushValueNode(Parser, &StackTop, TypeValue);
         } else {
             /* it isn't a token from an expression */
-            ParserCopy(Parser, &PreState);
+            ParserCopyPos(Parser, &PreState);
             Done = true;
         }
     } while (!Done);
@@ -1771,8 +1777,8 @@ void ExpressionParseMacroCall(struct ParseState *Parser,
         ParserCopy(&MacroParser, &MDef->Body);
         MacroParser.Mode = Parser->Mode;
         VariableStackFrameAdd(Parser, MacroName, 0);
-        Parser->pc->TopStackFrame->NumParams = ArgCount;
-        Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
+        THREAD(Parser->pc)->TopStackFrame->NumParams = ArgCount;
+        THREAD(Parser->pc)->TopStackFrame->ReturnValue = ReturnValue;
         for (Count = 0; Count < MDef->NumParams; Count++)
             VariableDefine(Parser->pc, Parser, MDef->ParamName[Count],
                 ParamArray[Count], NULL, true);
@@ -1784,6 +1790,116 @@ void ExpressionParseMacroCall(struct ParseState *Parser,
     }
 }
 
+/* run a function whose arguments have already been evaluated into
+    ParamArray. the result goes in ReturnValue */
+void ExpressionCallFunction(struct ParseState *Parser, struct Value *FuncValue,
+    const char *FuncName, struct Value *ReturnValue, struct Value **ParamArray,
+    int ArgCount)
+{
+    if (FuncValue->Val->FuncDef.Intrinsic == NULL) {
+        /* run a user-defined function */
+        int Count;
+        int OldScopeID = Parser->ScopeID;
+        struct ParseState FuncParser;
+
+        if (FuncValue->Val->FuncDef.Body.Pos == NULL)
+            ProgramFail(Parser,
+                "ExpressionParseFunctionCall FuncName: '%s' is undefined",
+                FuncName);
+
+        BUDGET_CHECKPOINT(Parser);
+        ParserCopy(&FuncParser, &FuncValue->Val->FuncDef.Body);
+        VariableStackFrameAdd(Parser, FuncName,
+            FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
+        THREAD(Parser->pc)->TopStackFrame->NumParams = ArgCount;
+        THREAD(Parser->pc)->TopStackFrame->ReturnValue = ReturnValue;
+
+        /* Function parameters should not go out of scope */
+        Parser->ScopeID = -1;
+
+        for (Count = 0; Count < FuncValue->Val->FuncDef.NumParams; Count++)
+            VariableDefine(Parser->pc, Parser,
+                FuncValue->Val->FuncDef.ParamName[Count], ParamArray[Count],
+                NULL, true);
+
+        Parser->ScopeID = OldScopeID;
+
+        if (ParseStatement(&FuncParser, true) != ParseResultOk)
+            ProgramFail(&FuncParser, "function body expected");
+
+        if (FuncParser.Mode == RunModeRun &&
+                FuncValue->Val->FuncDef.ReturnType != &Parser->pc->VoidType)
+            ProgramFail(&FuncParser,
+                "no value returned from a function returning %t",
+                FuncValue->Val->FuncDef.ReturnType);
+
+        else if (FuncParser.Mode == RunModeGoto)
+            ProgramFail(&FuncParser, "couldn't find goto label '%s'",
+                FuncParser.SearchGotoLabel);
+
+        VariableStackFramePop(Parser);
+    } else {
+        // FIXME: too many parameters?
+        FuncValue->Val->FuncDef.Intrinsic(Parser, ReturnValue, ParamArray,
+                                          ArgCount);
+    }
+}
+
+/* call an interpreted function with native arguments, for the host and
+    for library functions which take callbacks. each of Args holds a value
+    of the matching parameter's type and the result goes in ReturnValue
+    unless it's NULL. structs and unions can't be passed */
+void ExpressionCallback(struct ParseState *Parser, struct Value *FuncValue,
+    union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue)
+{
+    int Count;
+    struct Value *Result;
+    struct Value *Arg;
+    struct Value **ParamArray;
+    struct FuncDef *Func = &FuncValue->Val->FuncDef;
+    Picoc *pc = Parser->pc;
+
+    if (NumArgs != Func->NumParams)
+        ProgramFail(Parser, "%s() takes %d arguments, not %d", Func->Name,
+            Func->NumParams, NumArgs);
+
+    if (Func->ReturnType->Base == TypeStruct ||
+            Func->ReturnType->Base == TypeUnion)
+        ProgramFail(Parser, "can't return a struct from %s() to native code",
+            Func->Name);
+
+    HeapPushStackFrame(pc);
+    Result = VariableAllocValueFromType(pc, Parser, Func->ReturnType, false,
+        NULL, false);
+    ParamArray = HeapAllocStack(pc, sizeof(struct Value*) * NumArgs);
+    if (ParamArray == NULL && NumArgs > 0)
+        VariableStackOverflow(pc, Parser);
+
+    for (Count = 0; Count < NumArgs; Count++) {
+        if (Func->ParamType[Count]->Base == TypeStruct ||
+                Func->ParamType[Count]->Base == TypeUnion)
+            ProgramFail(Parser, "can't pass a struct to %s() from native code",
+                Func->Name);
+
+        ParamArray[Count] = VariableAllocValueFromType(pc, Parser,
+            Func->ParamType[Count], false, NULL, false);
+        Arg = VariableAllocValueFromExistingData(Parser, Func->ParamType[Count],
+            &Args[Count], false, NULL);
+        ExpressionAssign(Parser, ParamArray[Count], Arg, true, Func->Name,
+            Count+1, false);
+        VariableStackPop(Parser, Arg);
+    }
+
+    ExpressionCallFunction(Parser, FuncValue, Func->Name, Result, ParamArray,
+        NumArgs);
+
+    if (ReturnValue != NULL && Func->ReturnType != &pc->VoidType)
+        memcpy((void*)ReturnValue, (void*)Result->Val,
+            TypeSizeValue(Result, true));
+
+    HeapPopStackFrame(pc);
+}
+
 /* do a function call */
 void ExpressionParseFunctionCall(struct ParseState *Parser,
     struct ExpressionStack **StackTop, const char *FuncName, int RunIt)
@@ -1818,7 +1934,7 @@ void ExpressionParseFunctionCall(struct ParseState *Parser,
         ParamArray = HeapAllocStack(Parser->pc,
             sizeof(struct Value*)*FuncValue->Val->FuncDef.NumParams);
         if (ParamArray == NULL)
-            ProgramFail(Parser, "(ExpressionParseFunctionCall) out of memory");
+            VariableStackOverflow(Parser->pc, Parser);
     } else {
         ExpressionPushInt(Parser, StackTop, 0);
         Parser->Mode = RunModeSkip;
@@ -1861,55 +1977,8 @@ void ExpressionParseFunctionCall(struct ParseState *Parser,
         if (ArgCount < FuncValue->Val->FuncDef.NumParams)
             ProgramFail(Parser, "not enough arguments to '%s'", FuncName);
 
-        if (FuncValue->Val->FuncDef.Intrinsic == NULL) {
-            /* run a user-defined function */
-            int Count;
-            int OldScopeID = Parser->ScopeID;
-            struct ParseState FuncParser;
-
-            if (FuncValue->Val->FuncDef.Body.Pos == NULL)
-                ProgramFail(Parser,
-                    "ExpressionParseFunctionCall FuncName: '%s' is undefined",
-                    FuncName);
-
-            ParserCopy(&FuncParser, &FuncValue->Val->FuncDef.Body);
-            VariableStackFrameAdd(Parser, FuncName,
-                FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
-            Parser->pc->TopStackFrame->NumParams = ArgCount;
-            Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
-
-            /* Function parameters should not go out of scope */
-            Parser->ScopeID = -1;
-
-            for (Count = 0; Count < FuncValue->Val->FuncDef.NumParams; Count++)
-                VariableDefine(Parser->pc, Parser,
-                    FuncValue->Val->FuncDef.ParamName[Count], ParamArray[Count],
-                    NULL, true);
-
-            Parser->ScopeID = OldScopeID;
-
-            if (ParseStatement(&FuncParser, true) != ParseResultOk)
-                ProgramFail(&FuncParser, "function body expected");
-
-            if (RunIt) {
-                if (FuncParser.Mode == RunModeRun &&
-                        FuncValue->Val->FuncDef.ReturnType != &Parser->pc->VoidType)
-                    ProgramFail(&FuncParser,
-                        "no value returned from a function returning %t",
-                        FuncValue->Val->FuncDef.ReturnType);
-
-                else if (FuncParser.Mode == RunModeGoto)
-                    ProgramFail(&FuncParser, "couldn't find goto label '%s'",
-                        FuncParser.SearchGotoLabel);
-            }
-
-            VariableStackFramePop(Parser);
-        } else {
-            // FIXME: too many parameters?
-            FuncValue->Val->FuncDef.Intrinsic(Parser, ReturnValue, ParamArray,
-                                              ArgCount);
-        }
-
+        ExpressionCallFunction(Parser, FuncValue, FuncName, ReturnValue,
+            ParamArray, ArgCount);
         HeapPopStackFrame(Parser->pc);
     }
 
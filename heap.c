@@ -4,13 +4,37 @@
     the top of heap space */
 #include "interpreter.h"
 
+/* each heap allocation starts with its size and what it's for, so freeing
+    it can take it off the statistics */
+union HeapHeader {
+    struct {
+        size_t Size;
+        enum MemCategory Category;
+    } Info;
+    ALIGN_TYPE Align;
+};
+
+/* the heap statistics are shared by all the program's threads */
+#ifdef UNIX_HOST
+#define HeapStatAdd(Stat, Amount) __atomic_add_fetch(&(Stat), (Amount), __ATOMIC_RELAXED)
+#define HeapStatSub(Stat, Amount) __atomic_sub_fetch(&(Stat), (Amount), __ATOMIC_RELAXED)
+#define HeapStatLoad(Stat) __atomic_load_n(&(Stat), __ATOMIC_RELAXED)
+#define HeapStatSwap(Stat, Old, New) __atomic_compare_exchange_n(&(Stat), &(Old), \
+    (New), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+#define HeapStatAdd(Stat, Amount) ((Stat) += (Amount))
+#define HeapStatSub(Stat, Amount) ((Stat) -= (Amount))
+#define HeapStatLoad(Stat) (Stat)
+#define HeapStatSwap(Stat, Old, New) ((Stat) = (New), true)
+#endif
+
 #ifdef DEBUG_HEAP
 void ShowBigList(Picoc *pc)
 {
     struct AllocNode *LPos;
 
-    printf("Heap: bottom=0x%lx 0x%lx-0x%lx, big freelist=", (long)pc->HeapBottom,
-        (long)&(pc->HeapMemory)[0], (long)&(pc->HeapMemory)[HEAP_SIZE]);
+    printf("Heap: bottom=0x%lx 0x%lx-0x%lx, big freelist=", (long)pc->MainThread.HeapBottom,
+        (long)&(pc->MainThread.HeapMemory)[0], (long)&(pc->MainThread.HeapMemory)[HEAP_SIZE]);
     for (LPos = pc->FreeListBig; LPos != NULL; LPos = LPos->NextFree)
         printf("0x%lx:%d ", (long)LPos, LPos->Size);
 
@@ -18,25 +42,37 @@ void ShowBigList(Picoc *pc)
 }
 #endif
 
-/* initialize the stack and heap storage */
-void HeapInit(Picoc *pc, int StackOrHeapSize)
+/* set up a thread's stack */
+void HeapInitStack(struct ThreadState *Thread, int StackSize)
 {
-    int Count;
     int AlignOffset = 0;
 
-    pc->HeapMemory = malloc(StackOrHeapSize);
-    pc->HeapBottom = NULL;  /* the bottom of the (downward-growing) heap */
-    pc->StackFrame = NULL;  /* the current stack frame */
-    pc->HeapStackTop = NULL;  /* the top of the stack */
+    Thread->HeapMemory = malloc(StackSize);
+    Thread->StackSize = StackSize;
+    Thread->HeapBottom = NULL;  /* the end of the stack memory */
+    Thread->StackFrame = NULL;  /* the current stack frame */
+    Thread->HeapStackTop = NULL;  /* the top of the stack */
+    Thread->HeapStackPeak = NULL;
+    if (Thread->HeapMemory == NULL)
+        return;
 
-    while (((unsigned long)&pc->HeapMemory[AlignOffset] & (sizeof(ALIGN_TYPE)-1)) != 0)
+    while (((unsigned long)&Thread->HeapMemory[AlignOffset] & (sizeof(ALIGN_TYPE)-1)) != 0)
         AlignOffset++;
 
-    pc->StackFrame = &(pc->HeapMemory)[AlignOffset];
-    pc->HeapStackTop = &(pc->HeapMemory)[AlignOffset];
-    *(void**)(pc->StackFrame) = NULL;
-    pc->HeapBottom =
-        &(pc->HeapMemory)[StackOrHeapSize-sizeof(ALIGN_TYPE)+AlignOffset];
+    Thread->StackFrame = &(Thread->HeapMemory)[AlignOffset];
+    Thread->HeapStackTop = &(Thread->HeapMemory)[AlignOffset];
+    Thread->HeapStackPeak = Thread->HeapStackTop;
+    *(void**)(Thread->StackFrame) = NULL;
+    Thread->HeapBottom =
+        &(Thread->HeapMemory)[StackSize-sizeof(ALIGN_TYPE)+AlignOffset];
+}
+
+/* initialize the stack and heap storage */
+void HeapInit(Picoc *pc, int StackOrHeapSize)
+{
+    int Count;
+
+    HeapInitStack(&pc->MainThread, StackOrHeapSize);
     pc->FreeListBig = NULL;
     for (Count = 0; Count < FREELIST_BUCKETS; Count++)
         pc->FreeListBucket[Count] = NULL;
@@ -44,23 +80,27 @@ void HeapInit(Picoc *pc, int StackOrHeapSize)
 
 void HeapCleanup(Picoc *pc)
 {
-    free(pc->HeapMemory);
+    free(pc->MainThread.HeapMemory);
 }
 
 /* allocate some space on the stack, in the current stack frame
  * clears memory. can return NULL if out of stack space */
 void *HeapAllocStack(Picoc *pc, int Size)
 {
-    char *NewMem = pc->HeapStackTop;
-    char *NewTop = (char*)pc->HeapStackTop + MEM_ALIGN(Size);
+    struct ThreadState *Thread = THREAD(pc);
+    char *NewMem = Thread->HeapStackTop;
+    char *NewTop = (char*)Thread->HeapStackTop + MEM_ALIGN(Size);
 #ifdef DEBUG_HEAP
     printf("HeapAllocStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size),
-        (unsigned long)pc->HeapStackTop);
+        (unsigned long)Thread->HeapStackTop);
 #endif
-    if (NewTop > (char*)pc->HeapBottom)
+    if (NewTop > (char*)Thread->HeapBottom)
         return NULL;
 
-    pc->HeapStackTop = (void*)NewTop;
+    Thread->HeapStackTop = (void*)NewTop;
+    if (NewTop > (char*)Thread->HeapStackPeak)
+        Thread->HeapStackPeak = (void*)NewTop;
+
     memset((void*)NewMem, '\0', Size);
     return NewMem;
 }
@@ -68,26 +108,30 @@ void *HeapAllocStack(Picoc *pc, int Size)
 /* allocate some space on the stack, in the current stack frame */
 void HeapUnpopStack(Picoc *pc, int Size)
 {
+    struct ThreadState *Thread = THREAD(pc);
 #ifdef DEBUG_HEAP
     printf("HeapUnpopStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size),
-        (unsigned long)pc->HeapStackTop);
+        (unsigned long)Thread->HeapStackTop);
 #endif
-    pc->HeapStackTop = (void*)((char*)pc->HeapStackTop + MEM_ALIGN(Size));
+    Thread->HeapStackTop = (void*)((char*)Thread->HeapStackTop + MEM_ALIGN(Size));
+    if (Thread->HeapStackTop > Thread->HeapStackPeak)
+        Thread->HeapStackPeak = Thread->HeapStackTop;
 }
 
 /* free some space at the top of the stack */
 int HeapPopStack(Picoc *pc, void *Addr, int Size)
 {
+    struct ThreadState *Thread = THREAD(pc);
     int ToLose = MEM_ALIGN(Size);
-    if (ToLose > ((char*)pc->HeapStackTop - (char*)&(pc->HeapMemory)[0]))
+    if (ToLose > ((char*)Thread->HeapStackTop - (char*)&(Thread->HeapMemory)[0]))
         return false;
 
 #ifdef DEBUG_HEAP
     printf("HeapPopStack(0x%lx, %ld) back to 0x%lx\n", (unsigned long)Addr,
-        (unsigned long)MEM_ALIGN(Size), (unsigned long)pc->HeapStackTop - ToLose);
+        (unsigned long)MEM_ALIGN(Size), (unsigned long)Thread->HeapStackTop - ToLose);
 #endif
-    pc->HeapStackTop = (void*)((char*)pc->HeapStackTop - ToLose);
-    assert(Addr == NULL || pc->HeapStackTop == Addr);
+    Thread->HeapStackTop = (void*)((char*)Thread->HeapStackTop - ToLose);
+    assert(Addr == NULL || Thread->HeapStackTop == Addr);
 
     return true;
 }
@@ -95,41 +139,197 @@ int HeapPopStack(Picoc *pc, void *Addr, int Size)
 /* push a new stack frame on to the stack */
 void HeapPushStackFrame(Picoc *pc)
 {
+    struct ThreadState *Thread = THREAD(pc);
 #ifdef DEBUG_HEAP
-    printf("Adding stack frame at 0x%lx\n", (unsigned long)pc->HeapStackTop);
+    printf("Adding stack frame at 0x%lx\n", (unsigned long)Thread->HeapStackTop);
 #endif
-    *(void**)pc->HeapStackTop = pc->StackFrame;
-    pc->StackFrame = pc->HeapStackTop;
-    pc->HeapStackTop = (void*)((char*)pc->HeapStackTop +
+    *(void**)Thread->HeapStackTop = Thread->StackFrame;
+    Thread->StackFrame = Thread->HeapStackTop;
+    Thread->HeapStackTop = (void*)((char*)Thread->HeapStackTop +
         MEM_ALIGN(sizeof(ALIGN_TYPE)));
+    if (Thread->HeapStackTop > Thread->HeapStackPeak)
+        Thread->HeapStackPeak = Thread->HeapStackTop;
 }
 
 /* pop the current stack frame, freeing all memory in the
     frame. can return NULL */
 int HeapPopStackFrame(Picoc *pc)
 {
-    if (*(void**)pc->StackFrame != NULL) {
-        pc->HeapStackTop = pc->StackFrame;
-        pc->StackFrame = *(void**)pc->StackFrame;
+    struct ThreadState *Thread = THREAD(pc);
+
+    if (*(void**)Thread->StackFrame != NULL) {
+        Thread->HeapStackTop = Thread->StackFrame;
+        Thread->StackFrame = *(void**)Thread->StackFrame;
 #ifdef DEBUG_HEAP
         printf("Popping stack frame back to 0x%lx\n",
-            (unsigned long)pc->HeapStackTop);
+            (unsigned long)Thread->HeapStackTop);
 #endif
         return true;
     } else
         return false;
 }
 
+/* raise the peak heap use to InUse if it's higher. other threads may be
+    raising it at the same time */
+static void HeapStatPeak(struct PicocMemStats *Stats, size_t InUse)
+{
+    size_t Peak = HeapStatLoad(Stats->PeakHeapBytes);
+
+    while (InUse > Peak && !HeapStatSwap(Stats->PeakHeapBytes, Peak, InUse)) {
+    }
+}
+
 /* allocate some dynamically allocated memory. memory is cleared.
     can return NULL if out of memory */
 void *HeapAllocMem(Picoc *pc, int Size)
 {
-    return calloc(Size, 1);
+    return HeapAllocCategory(pc, Size, MemOther);
+}
+
+/* the program can't have more memory once it's over its limit. the
+    allocation fails, and the library function which asked for it stops
+    the program with BudgetCheckMemory() */
+static int HeapOverLimit(Picoc *pc, size_t Size)
+{
+    if (pc->Limits.MaxHeapBytes == 0 || pc->MemStats.HeapBytes +
+            pc->MemStats.MappedBytes + Size <= pc->Limits.MaxHeapBytes)
+        return false;
+
+    pc->OverMemLimit = true;
+    return true;
+}
+
+/* allocate some dynamically allocated memory, counting it in the
+    statistics as being for Category */
+void *HeapAllocCategory(Picoc *pc, int Size, enum MemCategory Category)
+{
+    struct PicocMemStats *Stats = &pc->MemStats;
+    union HeapHeader *Header;
+    size_t InUse;
+
+    if (Size < 0 || (Category == MemProgram && HeapOverLimit(pc, Size)))
+        return NULL;
+
+    Header = calloc(sizeof(union HeapHeader) + Size, 1);
+    if (Header == NULL)
+        return NULL;
+
+    Header->Info.Size = Size;
+    Header->Info.Category = Category;
+    HeapStatAdd(Stats->Allocs[Category], 1);
+    HeapStatAdd(Stats->Live[Category], 1);
+    HeapStatAdd(Stats->Bytes[Category], Size);
+    InUse = HeapStatAdd(Stats->HeapBytes, Size);
+    HeapStatPeak(Stats, InUse);
+
+    return Header + 1;
 }
 
 /* free some dynamically allocated memory */
 void HeapFreeMem(Picoc *pc, void *Mem)
 {
-    free(Mem);
+    struct PicocMemStats *Stats = &pc->MemStats;
+    union HeapHeader *Header;
+
+    if (Mem == NULL)
+        return;
+
+    Header = (union HeapHeader *)Mem - 1;
+    HeapStatSub(Stats->Live[Header->Info.Category], 1);
+    HeapStatSub(Stats->Bytes[Header->Info.Category], Header->Info.Size);
+    HeapStatSub(Stats->HeapBytes, Header->Info.Size);
+    free(Header);
+}
+
+/* resize some memory the program malloc()ed. anything new isn't cleared */
+void *HeapReallocMem(Picoc *pc, void *Mem, int Size)
+{
+    struct PicocMemStats *Stats = &pc->MemStats;
+    union HeapHeader *Header;
+    size_t OldSize;
+    size_t InUse;
+
+    if (Mem == NULL)
+        return HeapAllocCategory(pc, Size, MemProgram);
+
+    Header = (union HeapHeader *)Mem - 1;
+    OldSize = Header->Info.Size;
+    if (Size < 0 || ((size_t)Size > OldSize &&
+            HeapOverLimit(pc, Size - OldSize)))
+        return NULL;
+
+    Header = realloc(Header, sizeof(union HeapHeader) + Size);
+    if (Header == NULL)
+        return NULL;
+
+    Header->Info.Size = Size;
+    HeapStatAdd(Stats->Bytes[Header->Info.Category], Size);
+    HeapStatSub(Stats->Bytes[Header->Info.Category], OldSize);
+    HeapStatSub(Stats->HeapBytes, OldSize);
+    InUse = HeapStatAdd(Stats->HeapBytes, Size);
+    HeapStatPeak(Stats, InUse);
+
+    return Header + 1;
+}
+
+/* count memory the program is mapping with mmap(). returns false, and
+    it mustn't be mapped, if it would go over the memory limit */
+int HeapAddMapped(Picoc *pc, size_t Size)
+{
+    if (HeapOverLimit(pc, Size))
+        return false;
+
+    HeapStatAdd(pc->MemStats.MappedBytes, Size);
+    return true;
+}
+
+/* the program has unmapped some memory */
+void HeapSubMapped(Picoc *pc, size_t Size)
+{
+    HeapStatSub(pc->MemStats.MappedBytes, Size);
+}
+
+/* get the memory use statistics. the heap figures cover every thread, the
+    stack and call depth figures are the interpreter's own thread's */
+void PicocGetMemStats(Picoc *pc, struct PicocMemStats *Stats)
+{
+    struct ThreadState *Thread = &pc->MainThread;
+
+    *Stats = pc->MemStats;
+    Stats->StackSize = Thread->StackSize;
+    Stats->StackBytes = (char*)Thread->HeapStackTop - (char*)Thread->HeapMemory;
+    Stats->PeakStackBytes = (char*)Thread->HeapStackPeak - (char*)Thread->HeapMemory;
+    Stats->FrameDepth = (Thread->TopStackFrame != NULL) ?
+        Thread->TopStackFrame->Depth : 0;
+    Stats->PeakFrameDepth = Thread->PeakFrameDepth;
 }
 
+/* print the memory use statistics */
+void PicocMemStatsReport(Picoc *pc, FILE *Report)
+{
+    static const char *CategoryNames[MemNumCategories] = {
+        "tokens", "types", "values", "tables", "strings", "program", "other"
+    };
+    struct PicocMemStats Stats;
+    int Count;
+
+    PicocGetMemStats(pc, &Stats);
+    fprintf(Report, "memory:\n");
+    fprintf(Report, "  heap      %10lu bytes in use, peak %lu\n",
+        (unsigned long)Stats.HeapBytes, (unsigned long)Stats.PeakHeapBytes);
+    fprintf(Report, "  mapped    %10lu bytes\n",
+        (unsigned long)Stats.MappedBytes);
+    fprintf(Report, "  stack     %10lu bytes in use, peak %lu of %lu\n",
+        (unsigned long)Stats.StackBytes, (unsigned long)Stats.PeakStackBytes,
+        (unsigned long)Stats.StackSize);
+    fprintf(Report, "  calls     %10d deep, peak %d\n", Stats.FrameDepth,
+        Stats.PeakFrameDepth);
+    fprintf(Report, "%-10s %12s %10s %10s\n", "category", "bytes", "live",
+        "allocs");
+    for (Count = 0; Count < MemNumCategories; Count++)
+        fprintf(Report, "%-10s %12lu %10lu %10lu\n", CategoryNames[Count],
+            (unsigned long)Stats.Bytes[Count], Stats.Live[Count],
+            Stats.Allocs[Count]);
+
+    fflush(Report);
+}
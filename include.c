@@ -8,19 +8,33 @@
 /* initialize the built-in include libraries */
 void IncludeInit(Picoc *pc)
 {
+    TableInitTable(&pc->IncludeNameTable, &pc->IncludeNameHashTable[0],
+        INCLUDE_NAME_TABLE_SIZE);
+    IncludeRegister(pc, "collections.h", &CollectionsSetupFunc,
+        &CollectionsFunctions[0], CollectionsDefs);
     IncludeRegister(pc, "ctype.h", NULL, &StdCtypeFunctions[0], NULL);
     IncludeRegister(pc, "errno.h", &StdErrnoSetupFunc, NULL, NULL);
 # ifndef NO_FP
     IncludeRegister(pc, "math.h", &MathSetupFunc, &MathFunctions[0], NULL);
+    IncludeRegister(pc, "vmath.h", NULL, &VmathFunctions[0], NULL);
 # endif
     IncludeRegister(pc, "stdbool.h", &StdboolSetupFunc, NULL, StdboolDefs);
     IncludeRegister(pc, "stdio.h", &StdioSetupFunc, &StdioFunctions[0], StdioDefs);
     IncludeRegister(pc, "stdlib.h", &StdlibSetupFunc, &StdlibFunctions[0], NULL);
     IncludeRegister(pc, "string.h", &StringSetupFunc, &StringFunctions[0], NULL);
+# ifdef UNIX_HOST
+    IncludeRegister(pc, "sys/mman.h", &MmanSetupFunc, &MmanFunctions[0], NULL);
+# endif
+# ifdef UNIX_HOST
+    IncludeRegister(pc, "thread.h", &ThreadSetupFunc, &ThreadFunctions[0], ThreadDefs);
+# endif
     IncludeRegister(pc, "time.h", &StdTimeSetupFunc, &StdTimeFunctions[0], StdTimeDefs);
 # ifndef WIN32
     IncludeRegister(pc, "unistd.h", &UnistdSetupFunc, &UnistdFunctions[0], UnistdDefs);
 # endif
+# ifdef UNIX_HOST
+    IncludeRegister(pc, "coroutine.h", NULL, &CoroutineFunctions[0], NULL);
+# endif
 }
 
 /* clean up space used by the include system */
@@ -36,6 +50,7 @@ void IncludeCleanup(Picoc *pc)
     }
 
     pc->IncludeLibList = NULL;
+    TableFree(pc, &pc->IncludeNameTable);
 }
 
 /* register a new build-in include file */
@@ -61,6 +76,139 @@ void PicocIncludeAllSystemHeaders(Picoc *pc)
         IncludeFile(pc, ThisInclude->IncludeName);
 }
 
+/* add the names of the types a header's setup source defines to the index */
+static void IncludeIndexSetupSource(Picoc *pc, struct IncludeLibrary *Lib)
+{
+    int Depth = 0;
+    int InTypedef = false;
+    char *LastIdentifier = NULL;
+    enum LexToken Token;
+    struct Value *LexValue;
+    struct ParseState Parser;
+    void *Tokens = LexAnalyse(pc, Lib->IncludeName, Lib->SetupCSource,
+        strlen(Lib->SetupCSource), NULL);
+
+    LexInitParser(&Parser, pc, Lib->SetupCSource, Tokens, Lib->IncludeName,
+        false, false);
+    while ((Token = LexGetToken(&Parser, &LexValue, true)) != TokenEOF) {
+        switch (Token) {
+        case TokenTypedef:
+            InTypedef = true;
+            break;
+        case TokenLeftBrace:
+            Depth++;
+            break;
+        case TokenRightBrace:
+            Depth--;
+            break;
+        case TokenIdentifier:
+            LastIdentifier = LexValue->Val->Identifier;
+            break;
+        case TokenSemicolon:
+            if (InTypedef && Depth == 0 && LastIdentifier != NULL) {
+                TableSetPtr(pc, &pc->IncludeNameTable, LastIdentifier, Lib);
+                InTypedef = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    HeapFreeMem(pc, Tokens);
+}
+
+/* make the system headers available without including them. each one is
+    loaded the first time a name it defines is looked up, so a short
+    script only pays for the headers it actually uses */
+void PicocIncludeSystemHeadersOnDemand(Picoc *pc)
+{
+    int Count;
+    struct IncludeLibrary *ThisInclude = pc->IncludeLibList;
+
+    if (pc->IncludeOnDemand)
+        return;
+
+    for (; ThisInclude != NULL; ThisInclude = ThisInclude->NextLib) {
+        if (ThisInclude->FuncList != NULL) {
+            for (Count = 0; ThisInclude->FuncList[Count].Prototype != NULL;
+                    Count++)
+                TableSetPtr(pc, &pc->IncludeNameTable, LibraryFunctionName(pc,
+                    ThisInclude->FuncList[Count].Prototype), ThisInclude);
+        }
+
+        if (ThisInclude->SetupCSource != NULL)
+            IncludeIndexSetupSource(pc, ThisInclude);
+    }
+
+    pc->IncludeOnDemand = true;
+}
+
+/* load a built-in library unless it's already been included. returns
+    TRUE if it was loaded */
+static int IncludeLibraryLoad(Picoc *pc, struct IncludeLibrary *LInclude)
+{
+    /* protect against multiple inclusion */
+    if (VariableDefined(pc, LInclude->IncludeName))
+        return false;
+
+    VariableDefine(pc, NULL, LInclude->IncludeName, NULL, &pc->VoidType,
+        false);
+
+    /* run an extra startup function if there is one */
+    if (LInclude->SetupFunction != NULL)
+        (*LInclude->SetupFunction)(pc);
+
+    /* parse the setup C source code - may define types etc. */
+    if (LInclude->SetupCSource != NULL)
+        PicocParse(pc, LInclude->IncludeName, LInclude->SetupCSource,
+            strlen(LInclude->SetupCSource), true, true, false, false);
+
+    /* set up the library functions */
+    if (LInclude->FuncList != NULL)
+        LibraryAdd(pc, LInclude->FuncList);
+
+    return true;
+}
+
+/* load the system header which defines Ident when headers are loaded on
+    demand. if no header is known to define it and LoadAll is set, load
+    every header which hasn't been loaded yet. returns TRUE if a header
+    was loaded. Ident must be registered */
+int IncludeResolve(Picoc *pc, const char *Ident, int LoadAll)
+{
+    int Loaded = false;
+    struct IncludeLibrary *LInclude;
+    struct ThreadState *Thread = THREAD(pc);
+    struct StackFrame *TopStackFrame = Thread->TopStackFrame;
+    struct Value LexValue = Thread->LexValue;
+    union AnyValue LexAnyValue = Thread->LexAnyValue;
+
+    if (!pc->IncludeOnDemand)
+        return false;
+
+    /* headers look names up as they load, don't go loading more. what
+        they define is global even if we're in a function */
+    pc->IncludeOnDemand = false;
+    Thread->TopStackFrame = NULL;
+    LInclude = TableGetPtr(&pc->IncludeNameTable, Ident);
+    if (LInclude != NULL)
+        Loaded = IncludeLibraryLoad(pc, LInclude);
+
+    if (!Loaded && LoadAll) {
+        for (LInclude = pc->IncludeLibList; LInclude != NULL;
+                LInclude = LInclude->NextLib)
+            Loaded |= IncludeLibraryLoad(pc, LInclude);
+    }
+
+    /* the caller may still be looking at the token it was given */
+    Thread->TopStackFrame = TopStackFrame;
+    Thread->LexValue = LexValue;
+    Thread->LexAnyValue = LexAnyValue;
+    pc->IncludeOnDemand = true;
+    return Loaded;
+}
+
 /* include one of a number of predefined libraries, or perhaps an actual file */
 void IncludeFile(Picoc *pc, char *FileName)
 {
@@ -71,24 +219,8 @@ void IncludeFile(Picoc *pc, char *FileName)
     for (LInclude = pc->IncludeLibList; LInclude != NULL;
             LInclude = LInclude->NextLib) {
         if (strcmp(LInclude->IncludeName, FileName) == 0) {
-            /* found it - protect against multiple inclusion */
-            if (!VariableDefined(pc, FileName)) {
-                VariableDefine(pc, NULL, FileName, NULL, &pc->VoidType, false);
-
-                /* run an extra startup function if there is one */
-                if (LInclude->SetupFunction != NULL)
-                    (*LInclude->SetupFunction)(pc);
-
-                /* parse the setup C source code - may define types etc. */
-                if (LInclude->SetupCSource != NULL)
-                    PicocParse(pc, FileName, LInclude->SetupCSource,
-                        strlen(LInclude->SetupCSource), true, true, false, false);
-
-                /* set up the library functions */
-                if (LInclude->FuncList != NULL)
-                    LibraryAdd(pc, LInclude->FuncList);
-            }
-
+            /* found it */
+            IncludeLibraryLoad(pc, LInclude);
             return;
         }
     }
@@ -96,4 +228,3 @@ void IncludeFile(Picoc *pc, char *FileName)
     /* not a predefined file, read a real file */
     PicocPlatformScanFile(pc, FileName);
 }
-
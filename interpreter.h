@@ -57,6 +57,43 @@
 
 typedef FILE IOFILE;
 
+/* where an embedder wants the program's output to go, see PicocSetOutput() */
+typedef void PicocWriter(void *Context, const char *Data, size_t Len);
+
+/* what heap memory is being used for, see PicocGetMemStats() */
+enum MemCategory {
+    MemTokens,          /* lexed source and function bodies */
+    MemTypes,           /* types and struct members */
+    MemValues,          /* global variables and other values on the heap */
+    MemTables,          /* hash table entries */
+    MemStrings,         /* the shared string table */
+    MemProgram,         /* what the program malloc()ed */
+    MemOther,           /* everything else, eg. library data */
+    MemNumCategories
+};
+
+/* memory use statistics, see PicocGetMemStats() */
+struct PicocMemStats {
+    size_t HeapBytes;                   /* heap memory in use */
+    size_t PeakHeapBytes;
+    size_t Bytes[MemNumCategories];     /* heap memory in use for each category */
+    unsigned long Live[MemNumCategories];   /* allocations not freed yet */
+    unsigned long Allocs[MemNumCategories]; /* allocations ever made */
+    size_t MappedBytes;                 /* memory the program has mmap()ed */
+    size_t StackBytes;                  /* the interpreter's stack in use */
+    size_t PeakStackBytes;
+    size_t StackSize;
+    int FrameDepth;                     /* function calls on the stack */
+    int PeakFrameDepth;
+};
+
+/* limits on what a program can use, see PicocSetLimits(). 0 is no limit */
+struct PicocLimits {
+    unsigned long MaxSteps;             /* loop iterations and function calls */
+    unsigned long MaxMilliseconds;      /* wall time */
+    size_t MaxHeapBytes;                /* heap memory, including what the program malloc()s and mmap()s */
+};
+
 /* coercion of numeric types to other numeric types */
 #define IS_FP(v) ((v)->Typ->Base == TypeFP)
 #define FP_VAL(v) ((v)->Val->FP)
@@ -196,21 +233,24 @@ enum RunMode {
 
 /* parser state - has all this detail so we can parse nested files */
 struct ParseState {
-    Picoc *pc;                  /* the picoc instance this parser is a part of */
+    /* where we're at - this is all ParserCopyPos() needs to save and restore */
     const unsigned char *Pos;   /* the character position in the source text */
-    char *FileName;             /* what file we're executing (registered string) */
     short int Line;             /* line number we're executing */
     short int CharacterPos;     /* character/column in the line we're executing */
-    enum RunMode Mode;          /* whether to skip or run code */
-    int SearchLabel;            /* what case label we're searching for */
-    const char *SearchGotoLabel;/* what goto label we're searching for */
-    const char *SourceText;     /* the entire source text */
     short int HashIfLevel;      /* how many "if"s we're nested down */
     short int HashIfEvaluateToLevel;    /* if we're not evaluating an if branch,
                                           what the last evaluated level was */
-    char DebugMode;             /* debugging mode */
+    enum RunMode Mode;          /* whether to skip or run code */
     int ScopeID;   /* for keeping track of local variables (free them after t
                       hey go out of scope) */
+
+    /* the rest rarely changes once a parser is set up */
+    Picoc *pc;                  /* the picoc instance this parser is a part of */
+    char *FileName;             /* what file we're executing (registered string) */
+    const char *SourceText;     /* the entire source text */
+    const char *SearchGotoLabel;/* what goto label we're searching for */
+    int SearchLabel;            /* what case label we're searching for */
+    char DebugMode;             /* debugging mode */
 };
 
 /* values */
@@ -249,10 +289,13 @@ struct ValueType {
     struct Table *Members;          /* members of a struct or union */
     int OnHeap;                     /* true if allocated on the heap */
     int StaticQualifier;            /* true if it's a static */
+    int InSnapshot;                 /* existed when the snapshot was taken */
+    int SnapshotIncomplete;         /* was an undefined struct or union then */
 };
 
 /* function definition */
 struct FuncDef {
+    const char *Name;               /* the name it was defined with */
     struct ValueType *ReturnType;   /* the return value type */
     int NumParams;                  /* the number of parameters */
     int VarArgs;                    /* has a variable number of arguments after
@@ -296,43 +339,84 @@ struct Value {
     struct ValueType *Typ;      /* the type of this value */
     union AnyValue *Val;        /* pointer to the AnyValue which holds the actual content */
     struct Value *LValueFrom;   /* if an LValue, this is a Value our LValue is contained within (or NULL) */
-    char ValOnHeap;             /* this Value is on the heap */
-    char ValOnStack;            /* the AnyValue is on the stack along with this Value */
-    char AnyValOnHeap;          /* the AnyValue is separately allocated from the Value on the heap */
-    char IsLValue;              /* is modifiable and is allocated somewhere we can usefully modify it */
     int ScopeID;                /* to know when it goes out of scope */
-    char OutOfScope;
+    bool ValOnHeap:1;           /* this Value is on the heap */
+    bool ValOnStack:1;          /* the AnyValue is on the stack along with this Value */
+    bool AnyValOnHeap:1;        /* the AnyValue is separately allocated from the Value on the heap */
+    bool IsLValue:1;            /* is modifiable and is allocated somewhere we can usefully modify it */
+    bool OutOfScope:1;
+    bool InSnapshot:1;          /* the snapshot can bring it back so don't free it */
 };
 
-/* hash table data structure */
+/* hash table data structure. entries are stored inline in an open
+    addressed array, a slot with a NULL Key is free (or deleted if its
+    Val is set) */
 struct TableEntry {
-    struct TableEntry *Next;        /* next item in this hash chain */
+    char *Key;                      /* points to the shared string table */
+    union {
+        struct Value *Val;          /* the value we're storing */
+        void *Ptr;                  /* or what a table of other things holds */
+    };
     const char *DeclFileName;       /* where the variable was declared */
     unsigned short DeclLine;
     unsigned short DeclColumn;
+    unsigned int Hash;              /* the hash of Key, kept for regrowing */
+};
+
+struct Table {
+    int Size;                       /* number of slots, a power of two */
+    int Count;                      /* number of slots holding an entry */
+    int Used;                       /* number of slots holding an entry or deleted */
+    int OnHeap;                     /* HashTable has been grown onto the heap */
+    unsigned int Version;           /* odd while HashTable and Size are changing */
+    struct TableEntry *HashTable;
+};
 
-    union TableEntryPayload {
-        struct ValueEntry {
-            char *Key;              /* points to the shared string table */
-            struct Value *Val;      /* the value we're storing */
-        } v;                        /* used for tables of values */
+/* a chunk of the arena interned strings are packed into */
+struct StringChunk {
+    struct StringChunk *Next;       /* the previously filled chunk */
+    size_t Size;                    /* how many bytes of Data there are */
+    size_t Used;                    /* how many bytes of Data are taken */
+    char Data[];
+};
 
-        char Key[1];                /* dummy size - used for the shared string table */
+/* a table's old slots, kept while other threads might be searching them */
+struct RetiredSlots {
+    struct RetiredSlots *Next;
+    struct TableEntry *HashTable;
+};
 
-        /* defines a breakpoint */
-        struct BreakpointEntry {
-            const char *FileName;
-            short int Line;
-            short int CharacterPos;
-        } b;
+/* a copy of a table's slots kept by a snapshot */
+struct SavedTable {
+    struct Table Tbl;               /* the table as it was */
+    struct TableEntry *HashTable;   /* a copy of its slots */
+};
 
-    } p;
+/* the state PicocRestoreSnapshot() returns an interpreter to */
+struct Snapshot {
+    struct SavedTable GlobalTable;
+    struct SavedTable StringLiteralTable;
+    struct SavedTable StaticTable;
+    struct SavedTable StringTable;
+    struct SavedTable LibraryTable;
+    struct SavedTable IncludeNameTable;
+    int IncludeOnDemand;
+    struct StringChunk *StringChunk;    /* the newest string chunk */
+    struct StringChunk *StringChunkNext;
+    size_t StringChunkUsed;             /* and how full it was */
+    struct CleanupTokenNode *CleanupTokenList;
+    void *StackFrame;
+    void *HeapStackTop;
+    unsigned char *GlobalData;          /* the contents of the global variables */
+    size_t GlobalDataSize;
 };
 
-struct Table {
-    short Size;
-    short OnHeap;
-    struct TableEntry **HashTable;
+/* a breakpoint in the debugger's breakpoint table */
+struct Breakpoint {
+    struct Breakpoint *Next;        /* next item in this hash chain */
+    const char *FileName;
+    short int Line;
+    short int CharacterPos;
 };
 
 /* stack frame for function calls */
@@ -342,8 +426,9 @@ struct StackFrame {
     struct Value *ReturnValue;              /* copy the return value here */
     struct Value **Parameter;               /* array of parameter values */
     int NumParams;                          /* the number of parameters */
+    int Depth;                              /* how many frames there are, this one included */
     struct Table LocalTable;                /* the local variables and parameters */
-    struct TableEntry *LocalHashTable[LOCAL_TABLE_SIZE];
+    struct TableEntry LocalHashTable[LOCAL_TABLE_SIZE];
     struct StackFrame *PreviousStackFrame;  /* the next lower stack frame */
 };
 
@@ -417,6 +502,31 @@ struct IncludeLibrary {
     struct IncludeLibrary *NextLib;
 };
 
+/* what each thread running the program has to itself. the interpreter's
+    own thread uses MainThread, threads the program starts have their own */
+struct ThreadState {
+    Picoc *pc;
+    struct StackFrame *TopStackFrame;   /* the innermost function call */
+    unsigned char *HeapMemory;          /* memory for the stack */
+    void *HeapBottom;                   /* the end of the stack memory */
+    void *StackFrame;                   /* the current stack frame */
+    void *HeapStackTop;                 /* the top of the stack */
+    void *HeapStackPeak;                /* the highest the top has been */
+    int PeakFrameDepth;                 /* the most frames there have been */
+    int StackSize;                      /* how big the stack memory is */
+    char *NativeStackBase;              /* where the host called in on the native C stack, used to catch runaway recursion */
+    size_t NativeStackLimit;
+#if defined(UNIX_HOST) || defined(WIN32)
+    jmp_buf *ExitBuf;                   /* where exit() and errors go */
+#endif
+    int *ExitValue;
+    int LockDepth;                      /* how many times we hold the shared lock */
+    long BudgetTicks;                   /* checkpoints left before looking at the limits again, see budget.c */
+    long BudgetGranted;                 /* what BudgetTicks was last set to */
+    struct Value LexValue;              /* the value of the last token read */
+    union AnyValue LexAnyValue;
+};
+
 #define FREELIST_BUCKETS (8)        /* freelists for 4, 8, 12 ... 32 byte allocs */
 #define SPLIT_MEM_THRESHOLD (16)    /* don't split memory which is close in size */
 #define BREAKPOINT_TABLE_SIZE (21)
@@ -427,39 +537,48 @@ struct Picoc_Struct {
     /* parser global data */
     struct Table GlobalTable;
     struct CleanupTokenNode *CleanupTokenList;
-    struct TableEntry *GlobalHashTable[GLOBAL_TABLE_SIZE];
+    struct TableEntry GlobalHashTable[GLOBAL_TABLE_SIZE];
 
     /* lexer global data */
     struct TokenLine *InteractiveHead;
     struct TokenLine *InteractiveTail;
     struct TokenLine *InteractiveCurrentLine;
     int LexUseStatementPrompt;
-    union AnyValue LexAnyValue;
-    struct Value LexValue;
     struct Table ReservedWordTable;
-    struct TableEntry *ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
+    struct TableEntry ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
 
     /* the table of string literal values */
     struct Table StringLiteralTable;
-    struct TableEntry *StringLiteralHashTable[STRING_LITERAL_TABLE_SIZE];
+    struct TableEntry StringLiteralHashTable[STRING_LITERAL_TABLE_SIZE];
+
+    /* static locals, keyed by where they're declared */
+    struct Table StaticTable;
+    struct TableEntry StaticHashTable[STATIC_TABLE_SIZE];
 
-    /* the stack */
-    struct StackFrame *TopStackFrame;
+    /* the interpreter's own thread - its stack, exit point and so on */
+    struct ThreadState MainThread;
 
     /* the value passed to exit() */
     int PicocExitValue;
 
+    /* what PicocRestoreSnapshot() goes back to */
+    struct Snapshot *Snapshot;
+
+    /* the function running as a coroutine, if there is one */
+    struct Coroutine *Coroutine;
+
     /* a list of libraries we can include */
     struct IncludeLibrary *IncludeLibList;
 
-    /* heap memory */
-    unsigned char *HeapMemory;  /* stack memory since our heap is malloc()ed */
-    void *HeapBottom;           /* the bottom of the (downward-growing) heap */
-    void *StackFrame;           /* the current stack frame */
-    void *HeapStackTop;         /* the top of the stack */
+    /* which system header defines each name, when they're loaded on demand */
+    struct Table IncludeNameTable;
+    struct TableEntry IncludeNameHashTable[INCLUDE_NAME_TABLE_SIZE];
+    int IncludeOnDemand;
 
+    /* heap memory */
     struct AllocNode *FreeListBucket[FREELIST_BUCKETS]; /* we keep a pool of freelist buckets to reduce fragmentation */
     struct AllocNode *FreeListBig;    /* free memory which doesn't fit in a bucket */
+    struct PicocMemStats MemStats;    /* the heap figures, the rest are worked out when asked for */
 
     /* types */
     struct ValueType UberType;
@@ -484,18 +603,41 @@ struct Picoc_Struct {
     struct ValueType *VoidPtrType;
 
     /* debugger */
-    struct Table BreakpointTable;
-    struct TableEntry *BreakpointHashTable[BREAKPOINT_TABLE_SIZE];
+    struct Breakpoint *BreakpointHashTable[BREAKPOINT_TABLE_SIZE];
     int BreakpointCount;
     int DebugManualBreak;
+    unsigned char *BreakpointLines;     /* a bit for each line with a breakpoint, in any file */
+    int BreakpointLinesSize;            /* how many lines the bits cover */
 
     /* C library */
+    struct Table LibraryTable;  /* library functions whose prototypes haven't been parsed yet */
+    struct TableEntry LibraryHashTable[LIBRARY_TABLE_SIZE];
     int BigEndian;
     int LittleEndian;
 
+    IOFILE *CStdIn;             /* the program's stdin, stdout and stderr */
     IOFILE *CStdOut;
+    IOFILE *CStdErr;
     IOFILE CStdOutBase;
 
+    /* output the embedder is capturing, see PicocSetOutput() */
+    PicocWriter *OutputWriter;
+    void *OutputContext;
+    IOFILE *OutputStream;       /* the buffered stream in front of the writer */
+
+    /* printf formats compiled the first time they're used, see stdio.c */
+    struct StdioFormat *FormatCache[FORMAT_CACHE_SIZE];
+    int FormatCacheCount;
+
+    /* what the profiler has seen, or NULL if it's off */
+    struct Profile *Profile;
+
+    /* execution limits, see budget.c */
+    struct PicocLimits Limits;
+    unsigned long StepsUsed;    /* what every thread's used, up to its last BudgetCheck() */
+    uint64_t BudgetStart;       /* when the clock started */
+    int OverMemLimit;           /* an allocation was refused */
+
     /* the picoc version string */
     const char *VersionString;
 
@@ -504,29 +646,54 @@ struct Picoc_Struct {
     jmp_buf PicocExitBuf;
 #endif
 
+    /* threads the program has started, see thread.h */
+#ifdef UNIX_HOST
+    pthread_mutex_t SharedLock; /* held while changing anything threads share */
+    int Threaded;               /* the program has started a thread */
+    struct RetiredSlots *RetiredSlots;
+#endif
+
     /* string table */
     struct Table StringTable;
-    struct TableEntry *StringHashTable[STRING_TABLE_SIZE];
+    struct TableEntry StringHashTable[STRING_TABLE_SIZE];
+    struct StringChunk *StringChunks;   /* the arena, newest chunk first */
     char *StrEmpty;
 };
 
+/* the thread running on this interpreter. it's the interpreter's own
+    thread unless the program started this one */
+extern THREAD_LOCAL struct ThreadState *ThreadCurrent;
+#define THREAD(p) ((ThreadCurrent != NULL && ThreadCurrent->pc == (p)) ? \
+    ThreadCurrent : &(p)->MainThread)
+
 /* table.c */
 extern void TableInit(Picoc *pc);
 extern char *TableStrRegister(Picoc *pc, const char *Str);
 extern char *TableStrRegister2(Picoc *pc, const char *Str, int Len);
-extern void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable,
-    int Size, int OnHeap);
+extern void TableInitTable(struct Table *Tbl, struct TableEntry *HashTable,
+    int Size);
+extern void TableFree(Picoc *pc, struct Table *Tbl);
 extern int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val,
     const char *DeclFileName, int DeclLine, int DeclColumn);
 extern int TableGet(struct Table *Tbl, const char *Key, struct Value **Val,
     const char **DeclFileName, int *DeclLine, int *DeclColumn);
 extern struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key);
+extern int TableSetPtr(Picoc *pc, struct Table *Tbl, char *Key, void *Ptr);
+extern void *TableGetPtr(struct Table *Tbl, const char *Key);
+extern void *TableDeletePtr(Picoc *pc, struct Table *Tbl, const char *Key);
 extern char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident,
     int IdentLen);
 extern void TableStrFree(Picoc *pc);
+extern unsigned int TableHash(const char *Key, int Len);
+extern void TableSave(Picoc *pc, struct Table *Tbl, struct SavedTable *Saved);
+extern void TableRestore(Picoc *pc, struct Table *Tbl, struct SavedTable *Saved);
+extern void TableSavedFree(Picoc *pc, struct SavedTable *Saved);
+extern void TableStrSnapshot(Picoc *pc, struct Snapshot *Snap);
+extern void TableStrRestore(Picoc *pc, struct Snapshot *Snap);
 
 /* lex.c */
 extern void LexInit(Picoc *pc);
+extern void LexInitThread(struct ThreadState *Thread);
 extern void LexCleanup(Picoc *pc);
 extern void *LexAnalyse(Picoc *pc, const char *FileName, const char *Source,
     int SourceLen, int *TokenLen);
@@ -535,6 +702,7 @@ extern void LexInitParser(struct ParseState *Parser, Picoc *pc,
 extern enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value,
     int IncPos);
 extern enum LexToken LexRawPeekToken(struct ParseState *Parser);
+extern int LexPeekLine(struct ParseState *Parser);
 extern void LexToEndOfMacro(struct ParseState *Parser);
 extern void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser);
 extern void LexInteractiveClear(Picoc *pc, struct ParseState *Parser);
@@ -551,12 +719,19 @@ extern enum ParseResult ParseStatement(struct ParseState *Parser,
 extern struct Value *ParseFunctionDefinition(struct ParseState *Parser,
     struct ValueType *ReturnType, char *Identifier);
 extern void ParseCleanup(Picoc *pc);
+extern void ParseRestore(Picoc *pc, struct Snapshot *Snap);
 extern void ParserCopyPos(struct ParseState *To, struct ParseState *From);
 extern void ParserCopy(struct ParseState *To, struct ParseState *From);
 
 /* expression.c */
 extern int ExpressionParse(struct ParseState *Parser, struct Value **Result);
 extern long ExpressionParseInt(struct ParseState *Parser);
+extern void ExpressionCallFunction(struct ParseState *Parser,
+    struct Value *FuncValue, const char *FuncName, struct Value *ReturnValue,
+    struct Value **ParamArray, int ArgCount);
+extern void ExpressionCallback(struct ParseState *Parser,
+    struct Value *FuncValue, union AnyValue *Args, int NumArgs,
+    union AnyValue *ReturnValue);
 extern void ExpressionAssign(struct ParseState *Parser, struct Value *DestValue,
     struct Value *SourceValue, int Force, const char *FuncName, int ParamNo, int AllowPointerCoercion);
 extern long ExpressionCoerceInteger(struct Value *Val);
@@ -566,6 +741,9 @@ extern double ExpressionCoerceFP(struct Value *Val);
 /* type.c */
 extern void TypeInit(Picoc *pc);
 extern void TypeCleanup(Picoc *pc);
+extern void TypeSnapshot(Picoc *pc);
+extern void TypeRestore(Picoc *pc);
+extern void TypeSnapshotFree(Picoc *pc);
 extern int TypeSize(struct ValueType *Typ, int ArraySize, int Compact);
 extern int TypeSizeValue(struct Value *Val, int Compact);
 extern int TypeStackSizeValue(struct Value *Val);
@@ -587,6 +765,7 @@ extern int TypeIsForwardDeclared(struct ParseState *Parser, struct ValueType *Ty
 extern void ShowBigList(Picoc *pc);
 #endif
 extern void HeapInit(Picoc *pc, int StackSize);
+extern void HeapInitStack(struct ThreadState *Thread, int StackSize);
 extern void HeapCleanup(Picoc *pc);
 extern void *HeapAllocStack(Picoc *pc, int Size);
 extern int HeapPopStack(Picoc *pc, void *Addr, int Size);
@@ -594,14 +773,23 @@ extern void HeapUnpopStack(Picoc *pc, int Size);
 extern void HeapPushStackFrame(Picoc *pc);
 extern int HeapPopStackFrame(Picoc *pc);
 extern void *HeapAllocMem(Picoc *pc, int Size);
+extern void *HeapAllocCategory(Picoc *pc, int Size, enum MemCategory Category);
+extern void *HeapReallocMem(Picoc *pc, void *Mem, int Size);
+extern int HeapAddMapped(Picoc *pc, size_t Size);
+extern void HeapSubMapped(Picoc *pc, size_t Size);
 extern void HeapFreeMem(Picoc *pc, void *Mem);
 
 /* variable.c */
 extern void VariableInit(Picoc *pc);
 extern void VariableCleanup(Picoc *pc);
+extern void VariableSnapshot(Picoc *pc, struct Snapshot *Snap);
+extern void VariableRestore(Picoc *pc, struct Snapshot *Snap);
+extern void VariableSnapshotFree(Picoc *pc, struct Snapshot *Snap);
 extern void VariableFree(Picoc *pc, struct Value *Val);
 extern void VariableTableCleanup(Picoc *pc, struct Table *HashTable);
 extern void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap);
+extern void *VariableAllocHeap(Picoc *pc, struct ParseState *Parser, int Size,
+    enum MemCategory Category);
 extern void VariableStackPop(struct ParseState *Parser, struct Value *Var);
 extern struct Value *VariableAllocValueAndData(Picoc *pc, struct ParseState *Parser,
     int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap);
@@ -629,6 +817,11 @@ extern void VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser,
 extern void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName,
     int NumParams);
 extern void VariableStackFramePop(struct ParseState *Parser);
+extern void VariableStackUnwind(struct ThreadState *Thread,
+    struct StackFrame *TopStackFrame, void *StackFrame, void *HeapStackTop);
+extern int VariableStackFrameDepth(Picoc *pc);
+extern void VariableStackOverflow(Picoc *pc, struct ParseState *Parser);
+extern void VariableCheckNativeStack(struct ParseState *Parser);
 extern struct Value *VariableStringLiteralGet(Picoc *pc, char *Ident);
 extern void VariableStringLiteralDefine(Picoc *pc, char *Ident, struct Value *Val);
 extern void *VariableDereferencePointer(struct Value *PointerValue,
@@ -640,7 +833,12 @@ extern void VariableScopeEnd(struct ParseState *Parser, int ScopeID, int PrevSco
 /* clibrary.c */
 extern void BasicIOInit(Picoc *pc);
 extern void LibraryInit(Picoc *pc);
+extern void LibraryCleanup(Picoc *pc);
 extern void LibraryAdd(Picoc *pc, struct LibraryFunction *FuncList);
+extern int LibraryResolve(Picoc *pc, const char *Ident);
+extern char *LibraryFunctionName(Picoc *pc, const char *Prototype);
+extern struct Value *LibraryGetCallback(struct ParseState *Parser,
+    void *FuncPointer);
 extern void CLibraryInit(Picoc *pc);
 extern void PrintCh(char OutCh, IOFILE *Stream);
 extern void PrintSimpleInt(long Num, IOFILE *Stream);
@@ -658,10 +856,16 @@ extern void LibPrintf(struct ParseState *Parser, struct Value *ReturnValue,
  * int PicocPlatformSetExitPoint();
  * void PicocInitialize(int StackSize);
  * void PicocCleanup();
+ * void PicocSnapshot();
+ * void PicocRestoreSnapshot();
+ * struct Value *PicocGetFunction(const char *FuncName);
+ * void PicocCallFunction(struct Value *FuncValue, union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue);
  * void PicocPlatformScanFile(const char *FileName);
  * extern int PicocExitValue; */
 extern void ProgramFail(struct ParseState *Parser, const char *Message, ...);
 extern void ProgramFailNoParser(Picoc *pc, const char *Message, ...);
+extern void ProgramFailExit(struct ParseState *Parser, int ExitValue,
+    const char *Message, ...);
 extern void AssignFail(struct ParseState *Parser, const char *Format,
     struct ValueType *Type1, struct ValueType *Type2, int Num1, int Num2,
     const char *FuncName, int ParamNo);
@@ -674,9 +878,47 @@ extern void PlatformPutc(unsigned char OutCh, union OutputStreamInfo *);
 extern void PlatformPrintf(IOFILE *Stream, const char *Format, ...);
 extern void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args);
 extern void PlatformExit(Picoc *pc, int ExitVal);
+extern IOFILE *PlatformOpenWriter(Picoc *pc);
+extern size_t PlatformNativeStackSize(void);
+extern size_t PlatformNativeStackLeft(char *StackMarker);
+extern void PlatformNativeStackEnter(Picoc *pc, char *StackMarker);
+extern uint64_t PlatformClock(void);
 extern char *PlatformMakeTempName(Picoc *pc, char *TempNameBuffer);
 extern void PlatformLibraryInit(Picoc *pc);
 
+/* coroutine.c */
+#ifdef UNIX_HOST
+extern struct LibraryFunction CoroutineFunctions[];
+#endif
+/* the following are defined in picoc.h:
+ * int PicocStartCoroutine(struct Value *FuncValue, union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue, int StackSize);
+ * int PicocResumeCoroutine();
+ * void PicocYield();
+ * void PicocStopCoroutine(); */
+
+/* profile.c */
+extern void ProfileCleanup(Picoc *pc);
+extern void ProfileEnter(Picoc *pc, const char *FuncName, struct StackFrame *Frame);
+extern void ProfileLeave(Picoc *pc, struct StackFrame *Frame);
+extern void ProfileStatement(struct ParseState *Parser);
+/* the following are defined in picoc.h:
+ * void PicocProfileStart();
+ * void PicocProfileReport(FILE *Report, FILE *Folded); */
+
+/* budget.c */
+extern void BudgetCheck(struct ParseState *Parser);
+extern void BudgetCheckMemory(struct ParseState *Parser);
+extern void BudgetThreadEnd(struct ThreadState *Thread);
+/* the following are defined in picoc.h:
+ * void PicocSetLimits(const struct PicocLimits *Limits); */
+
+/* count a loop iteration or function call against the program's limits.
+    it only has to look at them when the ticks run out */
+#define BUDGET_CHECKPOINT(Parser) do { \
+        if (--THREAD((Parser)->pc)->BudgetTicks <= 0) \
+            BudgetCheck(Parser); \
+    } while (0)
+
 /* include.c */
 extern void IncludeInit(Picoc *pc);
 extern void IncludeCleanup(Picoc *pc);
@@ -684,8 +926,10 @@ extern void IncludeRegister(Picoc *pc, const char *IncludeName,
     void (*SetupFunction)(Picoc *pc), struct LibraryFunction *FuncList,
     const char *SetupCSource);
 extern void IncludeFile(Picoc *pc, char *Filename);
-/* the following is defined in picoc.h:
- * void PicocIncludeAllSystemHeaders(); */
+extern int IncludeResolve(Picoc *pc, const char *Ident, int LoadAll);
+/* the following are defined in picoc.h:
+ * void PicocIncludeAllSystemHeaders();
+ * void PicocIncludeSystemHeadersOnDemand(); */
 
 #ifdef DEBUGGER
 /* debug.c */
@@ -694,18 +938,33 @@ extern void DebugCleanup(Picoc *pc);
 extern void DebugCheckStatement(struct ParseState *Parser);
 extern void DebugSetBreakpoint(struct ParseState *Parser);
 extern int DebugClearBreakpoint(struct ParseState *Parser);
-extern void DebugStep(void)
+extern void DebugStep(void);
+
+/* is there anything for the debugger to do before this statement? it's
+    only worth looking in the breakpoint table if the line's bit is set */
+#define DEBUG_CHECK_NEEDED(Parser) ((Parser)->pc->DebugManualBreak || \
+    ((unsigned int)(Parser)->Line < (unsigned int)(Parser)->pc->BreakpointLinesSize && \
+    ((Parser)->pc->BreakpointLines[(Parser)->Line >> 3] & (1 << ((Parser)->Line & 7)))))
 #endif
 
 /* stdio.c */
 extern const char StdioDefs[];
 extern struct LibraryFunction StdioFunctions[];
 extern void StdioSetupFunc(Picoc *pc);
+extern void StdioFreeFormats(Picoc *pc);
 
 /* math.c */
 extern struct LibraryFunction MathFunctions[];
 extern void MathSetupFunc(Picoc *pc);
 
+/* vmath.c */
+extern struct LibraryFunction VmathFunctions[];
+
+/* collections.c */
+extern const char CollectionsDefs[];
+extern struct LibraryFunction CollectionsFunctions[];
+extern void CollectionsSetupFunc(Picoc *pc);
+
 /* string.c */
 extern struct LibraryFunction StringFunctions[];
 extern void StringSetupFunc(Picoc *pc);
@@ -734,4 +993,23 @@ extern const char UnistdDefs[];
 extern struct LibraryFunction UnistdFunctions[];
 extern void UnistdSetupFunc(Picoc *pc);
 
+/* thread.c */
+#ifdef UNIX_HOST
+extern const char ThreadDefs[];
+extern struct LibraryFunction ThreadFunctions[];
+extern void ThreadSetupFunc(Picoc *pc);
+extern void ThreadInit(Picoc *pc);
+extern void ThreadLock(Picoc *pc);
+extern void ThreadUnlock(Picoc *pc);
+#else
+#define ThreadLock(pc)
+#define ThreadUnlock(pc)
+#endif
+
+/* mman.c */
+#ifdef UNIX_HOST
+extern struct LibraryFunction MmanFunctions[];
+extern void MmanSetupFunc(Picoc *pc);
+#endif
+
 #endif /* INTERPRETER_H */
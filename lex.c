@@ -104,7 +104,7 @@ void LexInit(Picoc *pc)
     int Count;
 
     TableInitTable(&pc->ReservedWordTable, &pc->ReservedWordHashTable[0],
-        sizeof(ReservedWords) / sizeof(struct ReservedWord)*2, true);
+        RESERVED_WORD_TABLE_SIZE);
 
     for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord);
             Count++) {
@@ -113,26 +113,26 @@ void LexInit(Picoc *pc)
             (struct Value*)&ReservedWords[Count], NULL, 0, 0);
     }
 
-    pc->LexValue.Typ = NULL;
-    pc->LexValue.Val = &pc->LexAnyValue;
-    pc->LexValue.LValueFrom = false;
-    pc->LexValue.ValOnHeap = false;
-    pc->LexValue.ValOnStack = false;
-    pc->LexValue.AnyValOnHeap = false;
-    pc->LexValue.IsLValue = false;
+    LexInitThread(&pc->MainThread);
+}
+
+/* set up the value a thread's tokens are returned in */
+void LexInitThread(struct ThreadState *Thread)
+{
+    Thread->LexValue.Typ = NULL;
+    Thread->LexValue.Val = &Thread->LexAnyValue;
+    Thread->LexValue.LValueFrom = false;
+    Thread->LexValue.ValOnHeap = false;
+    Thread->LexValue.ValOnStack = false;
+    Thread->LexValue.AnyValOnHeap = false;
+    Thread->LexValue.IsLValue = false;
 }
 
 /* deallocate */
 void LexCleanup(Picoc *pc)
 {
-    int Count;
-
     LexInteractiveClear(pc, NULL);
-
-    for (Count = 0; Count < sizeof(ReservedWords) / sizeof(struct ReservedWord);
-            Count++)
-        TableDelete(pc, &pc->ReservedWordTable,
-            TableStrRegister(pc, ReservedWords[Count].Word));
+    TableFree(pc, &pc->ReservedWordTable);
 }
 
 /* check if a word is a reserved word - used while scanning */
@@ -468,7 +468,7 @@ enum LexToken LexScanGetToken(Picoc *pc, struct LexState *Lexer,
 
     /* scan for a token */
     do {
-        *Value = &pc->LexValue;
+        *Value = &THREAD(pc)->LexValue;
         while (Lexer->Pos != Lexer->End && isspace((int)*Lexer->Pos)) {
             if (*Lexer->Pos == '\n') {
                 Lexer->Line++;
@@ -664,7 +664,7 @@ void *LexTokenize(Picoc *pc, struct LexState *Lexer, int *TokenLen)
 
     } while (Token != TokenEOF);
 
-    HeapMem = HeapAllocMem(pc, MemUsed);
+    HeapMem = HeapAllocCategory(pc, MemUsed, MemTokens);
     if (HeapMem == NULL)
         LexFail(pc, Lexer, "(LexTokenize HeapMem == NULL) out of memory");
 
@@ -717,6 +717,7 @@ void LexInitParser(struct ParseState *Parser, Picoc *pc, const char *SourceText,
     Parser->HashIfLevel = 0;
     Parser->HashIfEvaluateToLevel = 0;
     Parser->CharacterPos = 0;
+    Parser->ScopeID = 0;
     Parser->SourceText = SourceText;
     Parser->DebugMode = EnableDebugger;
 }
@@ -767,8 +768,8 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
                 /* put the new line at the end of the linked list of interactive lines */
                 LineTokens = LexAnalyse(pc, pc->StrEmpty, &LineBuffer[0],
                     strlen(LineBuffer), &LineBytes);
-                LineNode = VariableAlloc(pc, Parser,
-                    sizeof(struct TokenLine), true);
+                LineNode = VariableAllocHeap(pc, Parser,
+                    sizeof(struct TokenLine), MemTokens);
                 LineNode->Tokens = LineTokens;
                 LineNode->NumBytes = LineBytes;
                 if (pc->InteractiveHead == NULL) {
@@ -809,33 +810,35 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
     if (ValueSize > 0) {
         /* this token requires a value - unpack it */
         if (Value != NULL) {
+            struct Value *LexValue = &THREAD(pc)->LexValue;
+
             switch (Token) {
             case TokenStringConstant:
-                pc->LexValue.Typ = pc->CharPtrType;
+                LexValue->Typ = pc->CharPtrType;
                 break;
             case TokenIdentifier:
-                pc->LexValue.Typ = NULL;
+                LexValue->Typ = NULL;
                 break;
             case TokenIntegerConstant:
-                pc->LexValue.Typ = &pc->LongType;
+                LexValue->Typ = &pc->LongType;
                 break;
             case TokenCharacterConstant:
-                pc->LexValue.Typ = &pc->CharType;
+                LexValue->Typ = &pc->CharType;
                 break;
             case TokenFPConstant:
-                pc->LexValue.Typ = &pc->FPType;
+                LexValue->Typ = &pc->FPType;
                 break;
             default:
                 break;
             }
 
-            memcpy((void*)pc->LexValue.Val,
+            memcpy((void*)LexValue->Val,
                 (void*)((char*)Parser->Pos+TOKEN_DATA_OFFSET), ValueSize);
-            pc->LexValue.ValOnHeap = false;
-            pc->LexValue.ValOnStack = false;
-            pc->LexValue.IsLValue = false;
-            pc->LexValue.LValueFrom = NULL;
-            *Value = &pc->LexValue;
+            LexValue->ValOnHeap = false;
+            LexValue->ValOnStack = false;
+            LexValue->IsLValue = false;
+            LexValue->LValueFrom = NULL;
+            *Value = LexValue;
         }
 
         if (IncPos)
@@ -1101,6 +1104,24 @@ enum LexToken LexRawPeekToken(struct ParseState *Parser)
     return (enum LexToken)*(unsigned char*)Parser->Pos;
 }
 
+/* the line the next token is on. Parser->Line only catches up with it
+    when the token is read */
+int LexPeekLine(struct ParseState *Parser)
+{
+    const unsigned char *Pos = (const unsigned char *)Parser->Pos;
+    int Line = Parser->Line;
+
+    if (Pos == NULL || Parser->FileName == Parser->pc->StrEmpty)
+        return Line;
+
+    while (*Pos == TokenEndOfLine) {
+        Line++;
+        Pos += TOKEN_DATA_OFFSET;
+    }
+
+    return Line;
+}
+
 /* find the end of the line */
 void LexToEndOfMacro(struct ParseState *Parser)
 {
@@ -1136,7 +1157,8 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
     if (pc->InteractiveHead == NULL) {
         /* non-interactive mode - copy the tokens */
         MemSize = EndParser->Pos - StartParser->Pos;
-        NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
+        NewTokens = VariableAllocHeap(pc, StartParser, MemSize + TOKEN_DATA_OFFSET,
+            MemTokens);
         memcpy(NewTokens, (void*)StartParser->Pos, MemSize);
     } else {
         /* we're in interactive mode - add up line by line */
@@ -1151,7 +1173,8 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
                 EndParser->Pos < &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes]) {
             /* all on a single line */
             MemSize = EndParser->Pos - StartParser->Pos;
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
+            NewTokens = VariableAllocHeap(pc, StartParser, MemSize + TOKEN_DATA_OFFSET,
+                MemTokens);
             memcpy(NewTokens, (void*)StartParser->Pos, MemSize);
         } else {
             /* it's spread across multiple lines */
@@ -1165,7 +1188,8 @@ void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser
 
             assert(ILine != NULL);
             MemSize += EndParser->Pos - &ILine->Tokens[0];
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
+            NewTokens = VariableAllocHeap(pc, StartParser, MemSize + TOKEN_DATA_OFFSET,
+                MemTokens);
 
             CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
             memcpy(NewTokens, Pos, CopySize);
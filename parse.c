@@ -24,21 +24,34 @@ static int gEnableDebugger = false;
 #endif
 
 
-/* deallocate any memory */
-void ParseCleanup(Picoc *pc)
+/* free the token lists parsed since Until was the newest */
+static void ParseCleanupUntil(Picoc *pc, struct CleanupTokenNode *Until)
 {
-    while (pc->CleanupTokenList != NULL) {
+    while (pc->CleanupTokenList != Until) {
         struct CleanupTokenNode *Next = pc->CleanupTokenList->Next;
 
         HeapFreeMem(pc, pc->CleanupTokenList->Tokens);
+        /* the source is the caller's malloc()ed text, not from the heap */
         if (pc->CleanupTokenList->SourceText != NULL)
-            HeapFreeMem(pc, (void *)pc->CleanupTokenList->SourceText);
+            free((void *)pc->CleanupTokenList->SourceText);
 
         HeapFreeMem(pc, pc->CleanupTokenList);
         pc->CleanupTokenList = Next;
     }
 }
 
+/* deallocate any memory */
+void ParseCleanup(Picoc *pc)
+{
+    ParseCleanupUntil(pc, NULL);
+}
+
+/* free the token lists of anything parsed since the snapshot */
+void ParseRestore(Picoc *pc, struct Snapshot *Snap)
+{
+    ParseCleanupUntil(pc, Snap->CleanupTokenList);
+}
+
 /* parse a statement, but only run it if Condition is true */
 enum ParseResult ParseStatementMaybeRun(struct ParseState *Parser,
     int Condition, int CheckTrailingSemicolon)
@@ -87,9 +100,12 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser,
     struct ParseState FuncBody;
     Picoc *pc = Parser->pc;
 
-    if (pc->TopStackFrame != NULL)
+    if (THREAD(pc)->TopStackFrame != NULL)
         ProgramFail(Parser, "nested function definitions are not allowed");
 
+    /* a library function has to be defined before it can be overridden */
+    LibraryResolve(pc, Identifier);
+
     LexGetToken(Parser, NULL, true);  /* open bracket */
     ParserCopy(&ParamParser, Parser);
     ParamCount = ParseCountParams(Parser);
@@ -101,6 +117,7 @@ struct Value *ParseFunctionDefinition(struct ParseState *Parser,
         sizeof(const char*)*ParamCount,
         false, NULL, true);
     FuncValue->Typ = &pc->FunctionType;
+    FuncValue->Val->FuncDef.Name = Identifier;
     FuncValue->Val->FuncDef.ReturnType = ReturnType;
     FuncValue->Val->FuncDef.NumParams = ParamCount;
     FuncValue->Val->FuncDef.VarArgs = false;
@@ -444,6 +461,7 @@ void ParseMacroDefinition(struct ParseState *Parser)
     MacroValue->Val->MacroDef.Body.Pos =
         LexCopyTokens(&MacroValue->Val->MacroDef.Body, Parser);
 
+    LibraryResolve(Parser->pc, MacroNameStr);
     if (!TableSet(Parser->pc, &Parser->pc->GlobalTable, MacroNameStr, MacroValue,
                 (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
         ProgramFail(Parser, "'%s' is already defined", MacroNameStr);
@@ -510,6 +528,7 @@ void ParseFor(struct ParseState *Parser)
     ParserCopyPos(&After, Parser);
 
     while (Condition && Parser->Mode == RunModeRun) {
+        BUDGET_CHECKPOINT(Parser);
         ParserCopyPos(Parser, &PreIncrement);
         ParseStatement(Parser, false);
 
@@ -541,8 +560,10 @@ enum RunMode ParseBlock(struct ParseState *Parser, int AbsorbOpenBrace,
     int Condition)
 {
     int PrevScopeID = 0;
-    int ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
+    int ScopeID;
 
+    VariableCheckNativeStack(Parser);
+    ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
     if (AbsorbOpenBrace && LexGetToken(Parser, NULL, true) != TokenLeftBrace)
         ProgramFail(Parser, "'{' expected");
 
@@ -598,13 +619,17 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
 
 #ifdef DEBUGGER
     /* if we're debugging, check for a breakpoint */
-    if (Parser->DebugMode && Parser->Mode == RunModeRun)
+    if (Parser->DebugMode && Parser->Mode == RunModeRun &&
+            DEBUG_CHECK_NEEDED(Parser))
         DebugCheckStatement(Parser);
 #endif
 
+    if (Parser->pc->Profile != NULL && Parser->Mode == RunModeRun)
+        ProfileStatement(Parser);
+
     /* take note of where we are and then grab a token to see what
         statement we have */
-    ParserCopy(&PreState, Parser);
+    ParserCopyPos(&PreState, Parser);
     Token = LexGetToken(Parser, &LexerValue, true);
 
     switch (Token) {
@@ -617,7 +642,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
             VariableGet(Parser->pc, Parser, LexerValue->Val->Identifier,
                 &VarValue);
             if (VarValue->Typ->Base == Type_Type) {
-                *Parser = PreState;
+                ParserCopyPos(Parser, &PreState);
                 ParseDeclaration(Parser, Token);
                 CheckTrailingSemicolon = false;
                 break;
@@ -642,7 +667,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
     case TokenIncrement:
     case TokenDecrement:
     case TokenOpenBracket:
-        *Parser = PreState;
+        ParserCopyPos(Parser, &PreState);
         ExpressionParse(Parser, &CValue);
         if (Parser->Mode == RunModeRun)
             VariableStackPop(Parser, CValue);
@@ -682,6 +707,8 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
                     ProgramFail(Parser, "statement expected");
                 if (Parser->Mode == RunModeContinue)
                     Parser->Mode = PreMode;
+                if (Parser->Mode == RunModeRun && Condition)
+                    BUDGET_CHECKPOINT(Parser);
             } while (Parser->Mode == RunModeRun && Condition);
             if (Parser->Mode == RunModeBreak)
                 Parser->Mode = PreMode;
@@ -706,6 +733,8 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
                 Condition = ExpressionParseInt(Parser);
                 if (LexGetToken(Parser, NULL, true) != TokenCloseBracket)
                     ProgramFail(Parser, "')' expected");
+                if (Condition && Parser->Mode == RunModeRun)
+                    BUDGET_CHECKPOINT(Parser);
             } while (Condition && Parser->Mode == RunModeRun);
             if (Parser->Mode == RunModeBreak)
                 Parser->Mode = PreMode;
@@ -734,7 +763,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
     case TokenAutoType:
     case TokenRegisterType:
     case TokenExternType:
-        *Parser = PreState;
+        ParserCopyPos(Parser, &PreState);
         CheckTrailingSemicolon = ParseDeclaration(Parser, Token);
         break;
     case TokenHashDefine:
@@ -799,15 +828,15 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
         break;
     case TokenReturn:
         if (Parser->Mode == RunModeRun) {
-            if (!Parser->pc->TopStackFrame ||
-                    Parser->pc->TopStackFrame->ReturnValue->Typ->Base != TypeVoid) {
+            if (!THREAD(Parser->pc)->TopStackFrame ||
+                    THREAD(Parser->pc)->TopStackFrame->ReturnValue->Typ->Base != TypeVoid) {
                 if (!ExpressionParse(Parser, &CValue))
                     ProgramFail(Parser, "value required in return");
-                if (!Parser->pc->TopStackFrame) /* return from top-level program? */
+                if (!THREAD(Parser->pc)->TopStackFrame) /* return from top-level program? */
                     PlatformExit(Parser->pc, ExpressionCoerceInteger(CValue));
                 else
                     ExpressionAssign(Parser,
-                        Parser->pc->TopStackFrame->ReturnValue, CValue, true,
+                        THREAD(Parser->pc)->TopStackFrame->ReturnValue, CValue, true,
                         NULL, 0, false);
                 VariableStackPop(Parser, CValue);
             } else {
@@ -849,7 +878,7 @@ enum ParseResult ParseStatement(struct ParseState *Parser,
             break;
         }
     default:
-        *Parser = PreState;
+        ParserCopyPos(Parser, &PreState);
         return ParseResultError;
     }
 
@@ -866,16 +895,20 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source,
     int SourceLen, int RunIt, int CleanupNow, int CleanupSource,
     int EnableDebugger)
 {
+    char StackMarker;
     char *RegFileName = TableStrRegister(pc, FileName);
     enum ParseResult Ok;
     struct ParseState Parser;
     struct CleanupTokenNode *NewCleanupNode;
+    void *Tokens;
 
-    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
+    PlatformNativeStackEnter(pc, &StackMarker);
+    Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
 
     /* allocate a cleanup node so we can clean up the tokens later */
     if (!CleanupNow) {
-        NewCleanupNode = HeapAllocMem(pc, sizeof(struct CleanupTokenNode));
+        NewCleanupNode = HeapAllocCategory(pc, sizeof(struct CleanupTokenNode),
+            MemTokens);
         if (NewCleanupNode == NULL)
             ProgramFailNoParser(pc, "(PicocParse) out of memory");
 
@@ -908,9 +941,11 @@ void PicocParse(Picoc *pc, const char *FileName, const char *Source,
 /* parse interactively */
 void PicocParseInteractiveNoStartPrompt(Picoc *pc, int EnableDebugger)
 {
+    char StackMarker;
     enum ParseResult Ok;
     struct ParseState Parser;
 
+    PlatformNativeStackEnter(pc, &StackMarker);
     LexInitParser(&Parser, pc, NULL, NULL, pc->StrEmpty, true, EnableDebugger);
     PicocPlatformSetExitPoint(pc);
     LexInteractiveClear(pc, &Parser);
@@ -18,10 +18,285 @@
 /* Override via STACKSIZE environment variable */
 #define PICOC_STACK_SIZE (128000*4)
 
+#ifdef UNIX_HOST
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+/* free the jobs read from a batch file */
+static void FreeBatchJobs(struct PicocBatchJob *Jobs, int NumJobs)
+{
+    int Count;
+    int ArgCount;
+
+    for (Count = 0; Count < NumJobs; Count++) {
+        for (ArgCount = 0; ArgCount < Jobs[Count].argc; ArgCount++)
+            free(Jobs[Count].argv[ArgCount]);
+        free(Jobs[Count].argv);
+    }
+
+    free(Jobs);
+}
+
+/* add a job with the words of a batch file line. returns false if
+    there's no memory for it */
+static int AddBatchJob(struct PicocBatchJob **Jobs, int *NumJobs,
+    int *AllocJobs, char **Words, int NumWords)
+{
+    struct PicocBatchJob *Job;
+
+    if (*NumJobs == *AllocJobs) {
+        int NewAlloc = *AllocJobs ? *AllocJobs*2 : 64;
+        struct PicocBatchJob *NewJobs = realloc(*Jobs,
+            sizeof(**Jobs) * NewAlloc);
+
+        if (NewJobs == NULL)
+            return false;
+
+        *Jobs = NewJobs;
+        *AllocJobs = NewAlloc;
+    }
+
+    Job = &(*Jobs)[*NumJobs];
+    Job->argv = malloc(sizeof(char *) * NumWords);
+    if (Job->argv == NULL)
+        return false;
+
+    for (Job->argc = 0; Job->argc < NumWords; Job->argc++) {
+        Job->argv[Job->argc] = strdup(Words[Job->argc]);
+        if (Job->argv[Job->argc] == NULL)
+            break;
+    }
+
+    /* it's counted even if it's incomplete, so it gets freed */
+    (*NumJobs)++;
+    return Job->argc == NumWords;
+}
+
+/* read a batch file. each line is a job, written the same way as a
+    picoc command line: source files, then "-" and the arguments. lines
+    can be any length. returns false with errno set if the file can't be
+    read or there's no memory for it. a file with no jobs in is fine */
+static int ReadBatchFile(const char *FileName, struct PicocBatchJob **Jobs,
+    int *NumJobs)
+{
+    int AllocJobs = 0;
+    char *Line = NULL;
+    size_t LineSize = 0;
+    ssize_t LineLen;
+    char **Words = NULL;
+    size_t AllocWords = 0;
+    int NumWords;
+    int Ok = true;
+    int Error = 0;
+    FILE *InFile;
+
+    *Jobs = NULL;
+    *NumJobs = 0;
+    InFile = strcmp(FileName, "-") == 0 ? stdin : fopen(FileName, "r");
+    if (InFile == NULL)
+        return false;
+
+    while (Ok && (LineLen = getline(&Line, &LineSize, InFile)) != -1) {
+        /* words are separated, so there can't be more than this */
+        if (AllocWords < (size_t)LineLen/2 + 2) {
+            char **NewWords = realloc(Words, sizeof(char *) * (LineLen/2 + 2));
+
+            if (NewWords == NULL) {
+                Ok = false;
+                break;
+            }
+
+            Words = NewWords;
+            AllocWords = LineLen/2 + 2;
+        }
+
+        NumWords = 0;
+        for (Words[0] = strtok(Line, " \t\r\n"); Words[NumWords] != NULL;
+                Words[NumWords] = strtok(NULL, " \t\r\n"))
+            NumWords++;
+
+        if (NumWords == 0 || Words[0][0] == '#')
+            continue;
+
+        Ok = AddBatchJob(Jobs, NumJobs, &AllocJobs, Words, NumWords);
+    }
+
+    if (!Ok)
+        Error = ENOMEM;
+    else if (ferror(InFile)) {
+        Ok = false;
+        Error = errno;      /* set by getline() */
+    }
+
+    free(Line);
+    free(Words);
+    if (InFile != stdin)
+        fclose(InFile);
+
+    if (!Ok) {
+        FreeBatchJobs(*Jobs, *NumJobs);
+        *Jobs = NULL;
+        *NumJobs = 0;
+        errno = Error;
+    }
+
+    return Ok;
+}
+
+/* run every job in a batch file and print their output in order */
+static int RunBatch(int argc, char **argv, int ParamCount, int StackSize)
+{
+    int NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int RunScripts = false;
+    struct PicocBatchJob *Jobs;
+    int NumJobs;
+    int Count;
+    int Failed;
+
+    for (; ParamCount < argc - 1; ParamCount++) {
+        if (strcmp(argv[ParamCount], "-j") == 0 && ParamCount < argc - 2)
+            NumThreads = atoi(argv[++ParamCount]);
+        else if (strcmp(argv[ParamCount], "-s") == 0)
+            RunScripts = true;
+        else
+            break;
+    }
+
+    if (ParamCount != argc - 1) {
+        fprintf(stderr, "picoc: --batch needs one batch file\n");
+        return 1;
+    }
+
+    if (!ReadBatchFile(argv[ParamCount], &Jobs, &NumJobs)) {
+        fprintf(stderr, "picoc: can't read batch file %s: %s\n",
+            argv[ParamCount], strerror(errno));
+        return 1;
+    }
+
+    if (NumJobs == 0)
+        return 0;
+
+    if (NumThreads < 1)
+        NumThreads = 1;
+
+    Failed = PicocRunBatch(Jobs, NumJobs, NumThreads, StackSize, RunScripts);
+
+    for (Count = 0; Count < NumJobs; Count++) {
+        fwrite(Jobs[Count].Output, 1, Jobs[Count].OutputLen, stdout);
+        if (Jobs[Count].ExitValue != 0) {
+            fflush(stdout);
+            fprintf(stderr, "picoc: %s exited with %d\n", Jobs[Count].argv[0],
+                Jobs[Count].ExitValue);
+        }
+
+        free(Jobs[Count].Output);
+    }
+
+    FreeBatchJobs(Jobs, NumJobs);
+    return Failed != 0;
+}
+
+/* keep programs ready to run for clients on a unix domain socket */
+static int RunServer(int argc, char **argv, int ParamCount, int StackSize)
+{
+    int NumThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *SocketPath;
+
+    if (ParamCount >= argc) {
+        fprintf(stderr, "picoc: --serve needs a socket\n");
+        return 1;
+    }
+
+    SocketPath = argv[ParamCount++];
+    if (ParamCount < argc - 1 && strcmp(argv[ParamCount], "-j") == 0)
+        NumThreads = atoi(argv[ParamCount+1]);
+
+    PicocServe(SocketPath, NumThreads, StackSize);
+    perror(SocketPath);
+    return 1;
+}
+
+/* ask a server to run a program, or one of its functions */
+static int RunClient(int argc, char **argv, int ParamCount)
+{
+    const char *SocketPath;
+    const char *FuncName = NULL;
+    char FilePath[PATH_MAX];
+    int ExitValue;
+    int Count;
+
+    if (ParamCount >= argc) {
+        fprintf(stderr, "picoc: --connect needs a socket\n");
+        return 1;
+    }
+
+    SocketPath = argv[ParamCount++];
+    if (ParamCount < argc - 1 && strcmp(argv[ParamCount], "-f") == 0) {
+        FuncName = argv[ParamCount+1];
+        ParamCount += 2;
+    }
+
+    if (ParamCount >= argc) {
+        fprintf(stderr, "picoc: --connect needs a file to run\n");
+        return 1;
+    }
+
+    /* the server has its own working directory */
+    if (realpath(argv[ParamCount], FilePath) == NULL) {
+        perror(argv[ParamCount]);
+        return 1;
+    }
+
+    /* skip the "-" before the arguments */
+    Count = ParamCount+1;
+    if (Count < argc && strcmp(argv[Count], "-") == 0)
+        Count++;
+
+    ExitValue = PicocServerRequest(SocketPath, FilePath, FuncName, argc - Count,
+        &argv[Count], stdout);
+    if (ExitValue < 0) {
+        perror(SocketPath);
+        return 1;
+    }
+
+    return ExitValue;
+}
+#endif
+
+/* write the profile report on stderr, and the folded stacks to a file if
+    they were asked for */
+static void WriteProfile(Picoc *pc, const char *FoldedName)
+{
+    FILE *Folded = NULL;
+
+    if (FoldedName != NULL) {
+        Folded = fopen(FoldedName, "w");
+        if (Folded == NULL)
+            perror(FoldedName);
+    }
+
+    fflush(stdout);
+    PicocProfileReport(pc, stderr, Folded);
+    if (Folded != NULL)
+        fclose(Folded);
+}
+
+/* write the memory statistics on stderr */
+static void WriteMemStats(Picoc *pc)
+{
+    fflush(stdout);
+    PicocMemStatsReport(pc, stderr);
+}
+
 int main(int argc, char **argv)
 {
     int ParamCount = 1;
     int DontRunMain = false;
+    int Profile = false;
+    int MemStats = false;
+    struct PicocLimits Limits = {0, 0, 0};
+    const char *FoldedName = NULL;
     int StackSize = getenv("STACKSIZE") ? atoi(getenv("STACKSIZE")) : PICOC_STACK_SIZE;
     Picoc pc;
 
@@ -31,6 +306,20 @@ int main(int argc, char **argv)
                "> picoc <file1.c>... [- <arg1>...]    : run a program, calls main() as the entry point\n"
                "> picoc -s <file1.c>... [- <arg1>...] : run a script, runs the program without calling main()\n"
                "> picoc -i                            : interactive mode, Ctrl+d to exit\n"
+#ifdef UNIX_HOST
+               "> picoc --batch [-j <n>] [-s] <file>  : run each line of a batch file as a program, <n> at a time\n"
+               "> picoc --serve <socket> [-j <n>]     : keep programs ready to run for clients, <n> at a time\n"
+               "> picoc --connect <socket> [-f <function>] <file.c> [- <arg1>...]\n"
+               "                                      : have a server run a program, or call one of its functions\n"
+#endif
+               "> picoc --profile [--profile-folded <file>] <file1.c>... [- <arg1>...]\n"
+               "                                      : run a program, then report where it spent its time\n"
+               "> picoc --mem-stats <file1.c>... [- <arg1>...]\n"
+               "                                      : run a program, then report how much memory it used\n"
+               "> picoc [--max-steps <n>] [--max-time <ms>] [--max-mem <bytes>] <file1.c>... [- <arg1>...]\n"
+               "                                      : run a program, stopping it with exit status 124 if it\n"
+               "                                        loops or calls more than <n> times, runs too long or\n"
+               "                                        uses too much memory\n"
                "> picoc -c                            : copyright info\n"
                "> picoc -h                            : this help message\n");
         return 0;
@@ -41,19 +330,65 @@ int main(int argc, char **argv)
         return 0;
     }
 
+#ifdef UNIX_HOST
+    if (strcmp(argv[ParamCount], "--batch") == 0)
+        return RunBatch(argc, argv, ParamCount+1, StackSize);
+
+    if (strcmp(argv[ParamCount], "--serve") == 0)
+        return RunServer(argc, argv, ParamCount+1, StackSize);
+
+    if (strcmp(argv[ParamCount], "--connect") == 0)
+        return RunClient(argc, argv, ParamCount+1);
+#endif
+
+    for (; ParamCount < argc; ParamCount++) {
+        if (strcmp(argv[ParamCount], "--profile") == 0)
+            Profile = true;
+        else if (strcmp(argv[ParamCount], "--profile-folded") == 0 &&
+                ParamCount < argc - 1) {
+            Profile = true;
+            FoldedName = argv[++ParamCount];
+        } else if (strcmp(argv[ParamCount], "--mem-stats") == 0)
+            MemStats = true;
+        else if (strcmp(argv[ParamCount], "--max-steps") == 0 &&
+                ParamCount < argc - 1)
+            Limits.MaxSteps = strtoul(argv[++ParamCount], NULL, 10);
+        else if (strcmp(argv[ParamCount], "--max-time") == 0 &&
+                ParamCount < argc - 1)
+            Limits.MaxMilliseconds = strtoul(argv[++ParamCount], NULL, 10);
+        else if (strcmp(argv[ParamCount], "--max-mem") == 0 &&
+                ParamCount < argc - 1)
+            Limits.MaxHeapBytes = strtoul(argv[++ParamCount], NULL, 10);
+        else
+            break;
+    }
+
     PicocInitialize(&pc, StackSize);
+    PicocSetLimits(&pc, &Limits);
+    if (Profile)
+        PicocProfileStart(&pc);
+
+    if (ParamCount >= argc) {
+        fprintf(stderr, "picoc: no program to run\n");
+        PicocCleanup(&pc);
+        return 1;
+    }
 
     if (strcmp(argv[ParamCount], "-s") == 0) {
         DontRunMain = true;
-        PicocIncludeAllSystemHeaders(&pc);
+        PicocIncludeSystemHeadersOnDemand(&pc);
         ParamCount++;
     }
 
     if (argc > ParamCount && strcmp(argv[ParamCount], "-i") == 0) {
-        PicocIncludeAllSystemHeaders(&pc);
+        PicocIncludeSystemHeadersOnDemand(&pc);
         PicocParseInteractive(&pc);
     } else {
         if (PicocPlatformSetExitPoint(&pc)) {
+            if (Profile)
+                WriteProfile(&pc, FoldedName);
+            if (MemStats)
+                WriteMemStats(&pc);
             PicocCleanup(&pc);
             return pc.PicocExitValue;
         }
@@ -65,6 +400,10 @@ int main(int argc, char **argv)
             PicocCallMain(&pc, argc - ParamCount, &argv[ParamCount]);
     }
 
+    if (Profile)
+        WriteProfile(&pc, FoldedName);
+    if (MemStats)
+        WriteMemStats(&pc);
     PicocCleanup(&pc);
     return pc.PicocExitValue;
 }
@@ -28,9 +28,68 @@ extern void PicocParseInteractive(Picoc *pc);
 extern void PicocCallMain(Picoc *pc, int argc, char **argv);
 extern void PicocInitialize(Picoc *pc, int StackSize);
 extern void PicocCleanup(Picoc *pc);
+extern void PicocSnapshot(Picoc *pc);
+extern void PicocRestoreSnapshot(Picoc *pc);
+extern struct Value *PicocGetFunction(Picoc *pc, const char *FuncName);
+extern void PicocCallFunction(Picoc *pc, struct Value *FuncValue,
+	union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue);
 extern void PicocPlatformScanFile(Picoc *pc, const char *FileName);
+extern int PicocSetOutput(Picoc *pc, PicocWriter *Writer, void *Context);
+extern void PicocFlushOutput(Picoc *pc);
+
+/* heap.c */
+extern void PicocGetMemStats(Picoc *pc, struct PicocMemStats *Stats);
+extern void PicocMemStatsReport(Picoc *pc, FILE *Report);
+
+/* budget.c */
+/* the exit status of a program stopped by PicocSetLimits() */
+#define PICOC_LIMIT_EXIT 124
+
+extern void PicocSetLimits(Picoc *pc, const struct PicocLimits *Limits);
 
 /* include.c */
 extern void PicocIncludeAllSystemHeaders(Picoc *pc);
+extern void PicocIncludeSystemHeadersOnDemand(Picoc *pc);
+
+/* coroutine.c */
+#ifdef UNIX_HOST
+/* what PicocStartCoroutine() and PicocResumeCoroutine() return */
+#define PICOC_FINISHED 0
+#define PICOC_YIELDED 1
+
+extern int PicocStartCoroutine(Picoc *pc, struct Value *FuncValue,
+	union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue,
+	int StackSize);
+extern int PicocResumeCoroutine(Picoc *pc);
+extern void PicocYield(Picoc *pc);
+extern void PicocStopCoroutine(Picoc *pc);
+#endif
+
+/* profile.c */
+extern void PicocProfileStart(Picoc *pc);
+extern void PicocProfileReport(Picoc *pc, FILE *Report, FILE *Folded);
+
+/* batch.c */
+#ifdef UNIX_HOST
+/* one program for PicocRunBatch() to run */
+struct PicocBatchJob
+{
+    int argc;                   /* source files, then "-" and the program's arguments */
+    char **argv;
+    char *Output;               /* what the program wrote to stdout, free() it when done */
+    size_t OutputLen;
+    int ExitValue;
+};
+
+extern int PicocRunBatch(struct PicocBatchJob *Jobs, int NumJobs, int NumThreads,
+	int StackSize, int RunScripts);
+#endif
+
+/* server.c */
+#ifdef UNIX_HOST
+extern int PicocServe(const char *SocketPath, int NumThreads, int StackSize);
+extern int PicocServerRequest(const char *SocketPath, const char *FileName,
+	const char *FuncName, int NumArgs, char **Args, FILE *Output);
+#endif
 
 #endif /* PICOC_H */
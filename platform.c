@@ -14,11 +14,21 @@ static int gEnableDebugger = true;
 static int gEnableDebugger = false;
 #endif
 
+/* the program's thread running on this OS thread, or NULL if it's the
+    interpreter's own. see cstdlib/thread.c */
+THREAD_LOCAL struct ThreadState *ThreadCurrent = NULL;
+
 
 /* initialize everything */
 void PicocInitialize(Picoc *pc, int StackSize)
 {
     memset(pc, '\0', sizeof(*pc));
+    pc->MainThread.pc = pc;
+    pc->MainThread.ExitBuf = &pc->PicocExitBuf;
+    pc->MainThread.ExitValue = &pc->PicocExitValue;
+#ifdef UNIX_HOST
+    ThreadInit(pc);
+#endif
     PlatformInit(pc);
     BasicIOInit(pc);
     HeapInit(pc, StackSize);
@@ -34,74 +44,229 @@ void PicocInitialize(Picoc *pc, int StackSize)
 #endif
 }
 
+/* let go of the snapshot, if there is one */
+static void PicocFreeSnapshot(Picoc *pc)
+{
+    struct Snapshot *Snap = pc->Snapshot;
+
+    if (Snap == NULL)
+        return;
+
+    VariableSnapshotFree(pc, Snap);
+    TypeSnapshotFree(pc);
+    TableSavedFree(pc, &Snap->StringTable);
+    TableSavedFree(pc, &Snap->LibraryTable);
+    TableSavedFree(pc, &Snap->IncludeNameTable);
+    HeapFreeMem(pc, Snap);
+    pc->Snapshot = NULL;
+}
+
+/* remember the interpreter's state so PicocRestoreSnapshot() can go back
+    to it. this lets an interpreter which has had its headers and any
+    common code loaded be reused for many programs without setting it
+    all up again. it must be taken between programs, not while one's running */
+void PicocSnapshot(Picoc *pc)
+{
+    struct Snapshot *Snap;
+
+    PicocFreeSnapshot(pc);
+    Snap = HeapAllocMem(pc, sizeof(struct Snapshot));
+    if (Snap == NULL)
+        ProgramFailNoParser(pc, "(PicocSnapshot) out of memory");
+
+    LexInteractiveClear(pc, NULL);
+    VariableSnapshot(pc, Snap);
+    TypeSnapshot(pc);
+    TableStrSnapshot(pc, Snap);
+    TableSave(pc, &pc->LibraryTable, &Snap->LibraryTable);
+    TableSave(pc, &pc->IncludeNameTable, &Snap->IncludeNameTable);
+    Snap->IncludeOnDemand = pc->IncludeOnDemand;
+    Snap->CleanupTokenList = pc->CleanupTokenList;
+    Snap->StackFrame = pc->MainThread.StackFrame;
+    Snap->HeapStackTop = pc->MainThread.HeapStackTop;
+    pc->Snapshot = Snap;
+}
+
+/* go back to the state saved by PicocSnapshot(), forgetting everything
+    defined since. it's also fine to call this after a program fails */
+void PicocRestoreSnapshot(Picoc *pc)
+{
+    struct Snapshot *Snap = pc->Snapshot;
+
+#ifdef UNIX_HOST
+    PicocStopCoroutine(pc);
+#endif
+    if (Snap == NULL)
+        return;
+
+    LexInteractiveClear(pc, NULL);
+    pc->MainThread.StackFrame = Snap->StackFrame;
+    pc->MainThread.HeapStackTop = Snap->HeapStackTop;
+    VariableRestore(pc, Snap);
+    TypeRestore(pc);
+    ParseRestore(pc, Snap);
+    TableRestore(pc, &pc->LibraryTable, &Snap->LibraryTable);
+    TableRestore(pc, &pc->IncludeNameTable, &Snap->IncludeNameTable);
+    pc->IncludeOnDemand = Snap->IncludeOnDemand;
+    TableStrRestore(pc, Snap);
+    pc->PicocExitValue = 0;
+}
+
 /* free memory */
 void PicocCleanup(Picoc *pc)
 {
+    PicocRestoreSnapshot(pc);
+    PicocFreeSnapshot(pc);
 #ifdef DEBUGGER
     DebugCleanup(pc);
 #endif
     IncludeCleanup(pc);
+    LibraryCleanup(pc);
     ParseCleanup(pc);
     LexCleanup(pc);
     VariableCleanup(pc);
     TypeCleanup(pc);
+    StdioFreeFormats(pc);
+    ProfileCleanup(pc);
     TableStrFree(pc);
     HeapCleanup(pc);
+#ifdef UNIX_HOST
+    pthread_mutex_destroy(&pc->SharedLock);
+#endif
+    if (pc->OutputStream != NULL)
+        fclose(pc->OutputStream);
     PlatformCleanup(pc);
 }
 
-/* platform-dependent code for running programs */
-#if defined(UNIX_HOST) || defined(WIN32)
+/* find a function in the program so the host can call it with
+    PicocCallFunction(). returns NULL if there's no such function */
+struct Value *PicocGetFunction(Picoc *pc, const char *FuncName)
+{
+    struct Value *FuncValue;
+    char *Ident = TableStrRegister(pc, FuncName);
+
+    if (!VariableDefined(pc, Ident))
+        return NULL;
 
-#define CALL_MAIN_NO_ARGS_RETURN_VOID "main();"
-#define CALL_MAIN_WITH_ARGS_RETURN_VOID "main(__argc,__argv);"
-#define CALL_MAIN_NO_ARGS_RETURN_INT "__exit_value = main();"
-#define CALL_MAIN_WITH_ARGS_RETURN_INT "__exit_value = main(__argc,__argv);"
+    VariableGet(pc, NULL, Ident, &FuncValue);
+    if (FuncValue->Typ->Base != TypeFunction)
+        return NULL;
 
-void PicocCallMain(Picoc *pc, int argc, char **argv)
+    return FuncValue;
+}
+
+/* the host is calling in, maybe on a different thread to the one which
+    initialized picoc, so measure the native stack and how much of it is
+    left from here. a call made while the program is running further up
+    this same stack (eg. loading a header on demand, or a coroutine) keeps
+    the outer base. stacks grow down on everything picoc runs on */
+void PlatformNativeStackEnter(Picoc *pc, char *StackMarker)
 {
-    /* check if the program wants arguments */
-    struct Value *FuncValue = NULL;
+    struct ThreadState *Thread = THREAD(pc);
+    char *StackBase = Thread->NativeStackBase;
 
-    if (!VariableDefined(pc, TableStrRegister(pc, "main")))
-        ProgramFailNoParser(pc, "main() is not defined");
+    if (StackBase != NULL && StackMarker < StackBase &&
+            (size_t)(StackBase - StackMarker) <= Thread->NativeStackLimit)
+        return;
 
-    VariableGet(pc, NULL, TableStrRegister(pc, "main"), &FuncValue);
-    if (FuncValue->Typ->Base != TypeFunction)
-        ProgramFailNoParser(pc, "main is not a function - can't call it");
-
-    if (FuncValue->Val->FuncDef.NumParams != 0) {
-        /* define the arguments */
-        VariableDefinePlatformVar(pc, NULL, "__argc", &pc->IntType,
-            (union AnyValue*)&argc, false);
-        VariableDefinePlatformVar(pc, NULL, "__argv", pc->CharPtrPtrType,
-            (union AnyValue*)&argv, false);
+    Thread->NativeStackBase = StackMarker;
+    Thread->NativeStackLimit = PlatformNativeStackLeft(StackMarker);
+}
+
+/* call a function in the program from the host. each of Args holds a
+    value of the type of the matching parameter, and the result is put
+    in ReturnValue unless it's NULL. structs and unions can't be passed.
+    if the program exits or fails the call's stack frames are popped on
+    the way back to the host's exit point, so it can call again */
+void PicocCallFunction(Picoc *pc, struct Value *FuncValue,
+    union AnyValue *Args, int NumArgs, union AnyValue *ReturnValue)
+{
+    char StackMarker;
+    struct ParseState Parser;
+    struct ThreadState *Thread = THREAD(pc);
+    struct StackFrame *TopStackFrame = Thread->TopStackFrame;
+    void *StackFrame = Thread->StackFrame;
+    void *HeapStackTop = Thread->HeapStackTop;
+    jmp_buf HostExitBuf;
+    int ExitCode;
+
+    memcpy(HostExitBuf, *Thread->ExitBuf, sizeof(jmp_buf));
+    ExitCode = setjmp(*Thread->ExitBuf);
+    if (ExitCode != 0) {
+        VariableStackUnwind(Thread, TopStackFrame, StackFrame, HeapStackTop);
+        memcpy(*Thread->ExitBuf, HostExitBuf, sizeof(jmp_buf));
+        longjmp(*Thread->ExitBuf, ExitCode);
     }
 
-    if (FuncValue->Val->FuncDef.ReturnType == &pc->VoidType) {
-        if (FuncValue->Val->FuncDef.NumParams == 0)
-            PicocParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_VOID,
-                strlen(CALL_MAIN_NO_ARGS_RETURN_VOID), true, true, false,
-                gEnableDebugger);
-        else
-            PicocParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_VOID,
-                strlen(CALL_MAIN_WITH_ARGS_RETURN_VOID), true, true, false,
-                gEnableDebugger);
-    } else {
-        VariableDefinePlatformVar(pc, NULL, "__exit_value", &pc->IntType,
-            (union AnyValue *)&pc->PicocExitValue, true);
+    PlatformNativeStackEnter(pc, &StackMarker);
+    LexInitParser(&Parser, pc, NULL, NULL,
+        (char*)FuncValue->Val->FuncDef.Name, true, gEnableDebugger);
+    ExpressionCallback(&Parser, FuncValue, Args, NumArgs, ReturnValue);
+    memcpy(*Thread->ExitBuf, HostExitBuf, sizeof(jmp_buf));
+}
+
+/* run the program's main() */
+void PicocCallMain(Picoc *pc, int argc, char **argv)
+{
+    union AnyValue Args[2];
+    union AnyValue ExitValue;
+    struct Value *FuncValue = PicocGetFunction(pc, "main");
 
-        if (FuncValue->Val->FuncDef.NumParams == 0)
-            PicocParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_INT,
-                strlen(CALL_MAIN_NO_ARGS_RETURN_INT), true, true, false,
-                gEnableDebugger);
+    if (FuncValue == NULL) {
+        if (!VariableDefined(pc, TableStrRegister(pc, "main")))
+            ProgramFailNoParser(pc, "main() is not defined");
         else
-            PicocParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_INT,
-                strlen(CALL_MAIN_WITH_ARGS_RETURN_INT), true, true, false,
-                gEnableDebugger);
+            ProgramFailNoParser(pc, "main is not a function - can't call it");
     }
+
+    /* the program may not want arguments */
+    Args[0].Integer = argc;
+    Args[1].Pointer = argv;
+    PicocCallFunction(pc, FuncValue, Args, FuncValue->Val->FuncDef.NumParams,
+        &ExitValue);
+
+    if (FuncValue->Val->FuncDef.ReturnType != &pc->VoidType)
+        pc->PicocExitValue = ExitValue.Integer;
+}
+
+/* send the program's stdout to Writer instead, without the host needing a
+    FILE * for it. output is buffered and handed to the writer in chunks -
+    when the buffer fills, when the program calls fflush(stdout) or exits
+    or fails, and on PicocFlushOutput(). a NULL Writer goes back to the
+    real stdout. returns false if the platform can't do this */
+int PicocSetOutput(Picoc *pc, PicocWriter *Writer, void *Context)
+{
+    IOFILE *Stream = stdout;
+
+    if (pc->OutputStream != NULL) {
+        fclose(pc->OutputStream);
+        pc->OutputStream = NULL;
+    }
+
+    pc->OutputWriter = Writer;
+    pc->OutputContext = Context;
+    if (Writer != NULL) {
+        Stream = PlatformOpenWriter(pc);
+        if (Stream == NULL) {
+            pc->OutputWriter = NULL;
+            pc->CStdOut = stdout;
+            return false;
+        }
+
+        setvbuf(Stream, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        pc->OutputStream = Stream;
+    }
+
+    pc->CStdOut = Stream;
+    return true;
+}
+
+/* hand anything the program has written but is still buffered over to
+    the writer, or to stdout */
+void PicocFlushOutput(Picoc *pc)
+{
+    fflush(pc->CStdOut);
 }
-#endif
 
 void PrintSourceTextErrorLine(IOFILE *Stream, const char *FileName,
     const char *SourceText, int Line, int CharacterPos)
@@ -157,6 +322,21 @@ void ProgramFail(struct ParseState *Parser, const char *Message, ...)
     PlatformExit(Parser->pc, 1);
 }
 
+/* exit with a message and a particular exit value */
+void ProgramFailExit(struct ParseState *Parser, int ExitValue,
+    const char *Message, ...)
+{
+    va_list Args;
+
+    PrintSourceTextErrorLine(Parser->pc->CStdOut, Parser->FileName,
+        Parser->SourceText, Parser->Line, Parser->CharacterPos);
+    va_start(Args, Message);
+    PlatformVPrintf(Parser->pc->CStdOut, Message, Args);
+    va_end(Args);
+    PlatformPrintf(Parser->pc->CStdOut, "\n");
+    PlatformExit(Parser->pc, ExitValue);
+}
+
 /* exit with a message, when we're not parsing a program */
 void ProgramFailNoParser(Picoc *pc, const char *Message, ...)
 {
@@ -220,6 +400,7 @@ void PlatformPrintf(IOFILE *Stream, const char *Format, ...)
 void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args)
 {
     const char *FPos;
+    const char *Text;
 
     for (FPos = Format; *FPos != '\0'; FPos++) {
         if (*FPos == '%') {
@@ -249,8 +430,14 @@ void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args)
             default:
                 break;
             }
-        } else
-            PrintCh(*FPos, Stream);
+        } else {
+            /* a run of plain text goes out in one go */
+            Text = FPos;
+            while (FPos[1] != '\0' && FPos[1] != '%')
+                FPos++;
+
+            fwrite(Text, 1, FPos - Text + 1, Stream);
+        }
     }
 }
 
@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
@@ -13,12 +14,16 @@
 #include <setjmp.h>
 #include <math.h>
 #include <stdbool.h>
+#include <limits.h>
 
 /* host platform includes */
 #ifdef UNIX_HOST
 # include <stdint.h>
 # include <unistd.h>
+# include <pthread.h>
+# define THREAD_LOCAL __thread
 #elif defined(WIN32) /*(predefined on MSVC)*/
+# define THREAD_LOCAL __declspec(thread)
 #else
 # error ***** A platform must be explicitly defined! *****
 #endif
@@ -53,14 +58,28 @@
 #define ALIGN_TYPE void*
 #endif
 
-#define GLOBAL_TABLE_SIZE (97)                /* global variable table */
-#define STRING_TABLE_SIZE (97)                /* shared string table size */
-#define STRING_LITERAL_TABLE_SIZE (97)        /* string literal table size */
-#define RESERVED_WORD_TABLE_SIZE (97)         /* reserved word table size */
+#define GLOBAL_TABLE_SIZE (128)               /* global variable table (power of two, can expand) */
+#define STRING_TABLE_SIZE (256)               /* shared string table size (power of two, can expand) */
+#define STRING_LITERAL_TABLE_SIZE (64)        /* string literal table size (power of two, can expand) */
+#define RESERVED_WORD_TABLE_SIZE (128)        /* reserved word table size (power of two) */
 #define PARAMETER_MAX (16)                    /* maximum number of parameters to a function */
 #define LINEBUFFER_MAX (256)                  /* maximum number of characters on a line */
-#define LOCAL_TABLE_SIZE (11)                 /* size of local variable table (can expand) */
-#define STRUCT_TABLE_SIZE (11)                /* size of struct/union member table (can expand) */
+#define STRING_CHUNK_SIZE (8192)              /* size of each chunk of the interned string arena */
+#define LOCAL_TABLE_SIZE (8)                  /* size of local variable table (power of two, can expand) */
+#define STRUCT_TABLE_SIZE (8)                 /* size of struct/union member table (power of two, can expand) */
+#define STATIC_TABLE_SIZE (16)                /* static locals by declaration site (power of two, can expand) */
+#define LIBRARY_TABLE_SIZE (256)              /* library functions not yet used (power of two, can expand) */
+#define INCLUDE_NAME_TABLE_SIZE (256)         /* names system headers define, for loading on demand (power of two, can expand) */
+#define NATIVE_STACK_MARGIN (256*1024)        /* native stack kept in reserve below the recursion limit */
+#define SERVER_CACHE_SIZE (4)                 /* parsed programs each server thread keeps ready to run */
+#define COROUTINE_STACK_SIZE (1024*1024)      /* default native stack for a coroutine */
+#define COROUTINE_STACK_MARGIN (64*1024)      /* coroutine stack kept in reserve below its recursion limit */
+#define FORMAT_CACHE_SIZE (64)                /* printf format cache hash buckets (power of two) */
+#define FORMAT_CACHE_MAX (512)                /* most printf formats kept compiled at once */
+#define OUTPUT_BUFFER_SIZE (16*1024)          /* output buffered before it's handed to an embedder's writer */
+#define PROFILE_HASH_SIZE (1024)              /* profiler function and line hash buckets (power of two) */
+#define PROFILE_REPORT_LINES (20)             /* how many of the busiest lines a profile report lists */
+#define BUDGET_CHECK_INTERVAL (1024)          /* checkpoints between looking at the clock and memory limits */
 
 #define INTERACTIVE_PROMPT_START "starting picoc " PICOC_VERSION " (Ctrl+D to exit)\n"
 #define INTERACTIVE_PROMPT_STATEMENT "picoc> "
@@ -1,6 +1,8 @@
 #include "../picoc.h"
 #include "../interpreter.h"
 
+#include <windows.h>
+
 #ifdef DEBUGGER
 static int gEnableDebugger = true;
 #else
@@ -88,6 +90,46 @@ void PicocPlatformScanFile(Picoc *pc, const char *FileName)
 /* exit the program */
 void PlatformExit(Picoc *pc, int RetVal)
 {
-    pc->PicocExitValue = RetVal;
-    longjmp(pc->PicocExitBuf, 1);
+    struct ThreadState *Thread = THREAD(pc);
+
+    /* don't leave the program's last words in the buffer */
+    fflush(pc->CStdOut);
+
+    *Thread->ExitValue = RetVal;
+    longjmp(*Thread->ExitBuf, 1);
+}
+
+/* there's no portable way to put a FILE * in front of a writer here, so
+    PicocSetOutput() isn't supported */
+IOFILE *PlatformOpenWriter(Picoc *pc)
+{
+    return NULL;
+}
+
+/* a monotonic clock, in nanoseconds */
+uint64_t PlatformClock(void)
+{
+    LARGE_INTEGER Now;
+    LARGE_INTEGER Frequency;
+
+    QueryPerformanceCounter(&Now);
+    QueryPerformanceFrequency(&Frequency);
+    return (uint64_t)(Now.QuadPart / Frequency.QuadPart) * 1000000000 +
+        (uint64_t)(Now.QuadPart % Frequency.QuadPart) * 1000000000 /
+        Frequency.QuadPart;
+}
+
+/* how much native stack the interpreter may recurse into. this is the
+ * linker's default reserve, adjust if the stack size is changed with /STACK */
+size_t PlatformNativeStackSize(void)
+{
+    size_t Size = 1024*1024;
+
+    return Size - NATIVE_STACK_MARGIN;
+}
+
+/* how much native stack is left below StackMarker on this thread */
+size_t PlatformNativeStackLeft(char *StackMarker)
+{
+    return PlatformNativeStackSize();
 }
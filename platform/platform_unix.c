@@ -1,6 +1,10 @@
+#define _GNU_SOURCE
 #include "../picoc.h"
 #include "../interpreter.h"
 
+#include <sys/resource.h>
+#include <pthread.h>
+
 #ifdef USE_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -133,7 +137,92 @@ void PicocPlatformScanFile(Picoc *pc, const char *FileName)
 /* exit the program */
 void PlatformExit(Picoc *pc, int RetVal)
 {
-    pc->PicocExitValue = RetVal;
-    longjmp(pc->PicocExitBuf, 1);
+    struct ThreadState *Thread = THREAD(pc);
+
+    /* we might have failed part way through changing something shared */
+    while (Thread->LockDepth > 0)
+        ThreadUnlock(pc);
+
+    /* don't leave the program's last words in the buffer */
+    fflush(pc->CStdOut);
+
+    *Thread->ExitValue = RetVal;
+    longjmp(*Thread->ExitBuf, 1);
+}
+
+/* the stream in front of an embedder's writer hands its buffer over here */
+#ifdef __GLIBC__
+static ssize_t PlatformWriterWrite(void *Cookie, const char *Buf, size_t Size)
+#else
+static int PlatformWriterWrite(void *Cookie, const char *Buf, int Size)
+#endif
+{
+    Picoc *pc = Cookie;
+
+    pc->OutputWriter(pc->OutputContext, Buf, Size);
+    return Size;
+}
+
+/* open a stream which writes to pc->OutputWriter */
+IOFILE *PlatformOpenWriter(Picoc *pc)
+{
+#ifdef __GLIBC__
+    cookie_io_functions_t WriterFuncs = {NULL, PlatformWriterWrite, NULL, NULL};
+
+    return fopencookie(pc, "w", WriterFuncs);
+#else
+    return funopen(pc, NULL, PlatformWriterWrite, NULL, NULL);
+#endif
+}
+
+/* a monotonic clock, in nanoseconds */
+uint64_t PlatformClock(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec * 1000000000 + Now.tv_nsec;
+}
+
+/* how much native stack the interpreter may recurse into */
+size_t PlatformNativeStackSize(void)
+{
+    struct rlimit Limit;
+    size_t Size = 8*1024*1024;
+
+    if (getrlimit(RLIMIT_STACK, &Limit) == 0 && Limit.rlim_cur != RLIM_INFINITY)
+        Size = (size_t)Limit.rlim_cur;
+
+    if (Size < 2*NATIVE_STACK_MARGIN)
+        return Size/2;
+
+    return Size - NATIVE_STACK_MARGIN;
+}
+
+/* how much native stack is left below StackMarker on this thread, less the
+    margin. the host may call in from any of its threads, and they needn't
+    have stacks as big as the main thread's */
+size_t PlatformNativeStackLeft(char *StackMarker)
+{
+    pthread_attr_t Attr;
+    void *StackAddr;
+    size_t StackSize;
+    size_t Left = 0;
+
+    if (pthread_getattr_np(pthread_self(), &Attr) != 0)
+        return PlatformNativeStackSize();
+
+    if (pthread_attr_getstack(&Attr, &StackAddr, &StackSize) == 0 &&
+            StackMarker > (char *)StackAddr)
+        Left = StackMarker - (char *)StackAddr;
+
+    pthread_attr_destroy(&Attr);
+    if (Left == 0)
+        return PlatformNativeStackSize();
+
+    if (Left < 2*NATIVE_STACK_MARGIN)
+        return Left/2;
+
+    return Left - NATIVE_STACK_MARGIN;
 }
 
@@ -0,0 +1,457 @@
+/* picoc profiler - counts calls and times each function the program runs,
+ * and counts how often each line's statements run. it's off unless the
+ * host turns it on with PicocProfileStart(), and only follows the
+ * interpreter's own thread, not threads the program starts */
+
+#include "picoc.h"
+#include "interpreter.h"
+
+/* what's been seen of one function */
+struct ProfileFunc {
+    const char *Name;
+    unsigned long Calls;
+    uint64_t SelfTime;          /* in nanoseconds, not counting what it called */
+    uint64_t TotalTime;         /* including what it called */
+    int Active;                 /* calls to it still running, so recursion isn't counted twice */
+    struct ProfileFunc *Next;   /* next in the hash chain */
+};
+
+/* a place in the call tree, for the folded stacks */
+struct ProfileNode {
+    struct ProfileFunc *Func;
+    struct ProfileNode *Parent;
+    struct ProfileNode *FirstChild;
+    struct ProfileNode *NextSibling;
+    uint64_t SelfTime;
+};
+
+/* a call that's still running */
+struct ProfileFrame {
+    struct StackFrame *Frame;   /* the interpreter's frame for it */
+    struct ProfileNode *Node;
+    uint64_t Start;
+    uint64_t ChildTime;
+};
+
+/* how many times the statements on a line have run */
+struct ProfileLine {
+    const char *FileName;
+    int Line;
+    unsigned long Hits;
+    struct ProfileLine *Next;
+};
+
+struct Profile {
+    struct ProfileFunc *FuncHash[PROFILE_HASH_SIZE];
+    struct ProfileLine *LineHash[PROFILE_HASH_SIZE];
+    struct ProfileLine *LastLine;   /* statements often follow on the same line */
+    int NumFuncs;
+    int NumLines;
+    struct ProfileFrame *Stack;
+    int StackDepth;
+    int StackAlloc;
+    int MaxDepth;
+    struct ProfileNode Root;        /* code outside any function */
+    uint64_t CalledTime;            /* time in the outermost calls */
+    uint64_t Start;
+    uint64_t Stop;                  /* when the report closed the open calls */
+};
+
+#define PROFILE_HASH(p, n) ((((uintptr_t)(p) >> 4) ^ (uintptr_t)(n) * 31) & (PROFILE_HASH_SIZE-1))
+
+
+/* start profiling the program, forgetting anything seen so far */
+void PicocProfileStart(Picoc *pc)
+{
+    ProfileCleanup(pc);
+    pc->Profile = HeapAllocMem(pc, sizeof(struct Profile));
+    if (pc->Profile == NULL)
+        ProgramFailNoParser(pc, "(PicocProfileStart) out of memory");
+
+    pc->Profile->Start = PlatformClock();
+}
+
+/* free the profile */
+void ProfileCleanup(Picoc *pc)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileNode *Node;
+    struct ProfileNode *Next;
+    void *Entry;
+    int Count;
+
+    if (Prof == NULL)
+        return;
+
+    for (Count = 0; Count < PROFILE_HASH_SIZE; Count++) {
+        while (Prof->FuncHash[Count] != NULL) {
+            Entry = Prof->FuncHash[Count];
+            Prof->FuncHash[Count] = Prof->FuncHash[Count]->Next;
+            HeapFreeMem(pc, Entry);
+        }
+
+        while (Prof->LineHash[Count] != NULL) {
+            Entry = Prof->LineHash[Count];
+            Prof->LineHash[Count] = Prof->LineHash[Count]->Next;
+            HeapFreeMem(pc, Entry);
+        }
+    }
+
+    /* free the call tree children first, without recursing */
+    Node = Prof->Root.FirstChild;
+    while (Node != NULL) {
+        if (Node->FirstChild != NULL) {
+            Node = Node->FirstChild;
+            continue;
+        }
+
+        Next = Node->NextSibling != NULL ? Node->NextSibling : Node->Parent;
+        if (Node->Parent != NULL)
+            Node->Parent->FirstChild = Node->NextSibling;
+        HeapFreeMem(pc, Node);
+        Node = Next == &Prof->Root ? NULL : Next;
+    }
+
+    HeapFreeMem(pc, Prof->Stack);
+    HeapFreeMem(pc, Prof);
+    pc->Profile = NULL;
+}
+
+/* find a function's entry, adding it if it's new */
+static struct ProfileFunc *ProfileGetFunc(Picoc *pc, const char *Name)
+{
+    struct Profile *Prof = pc->Profile;
+    int Hash = PROFILE_HASH(Name, 0);
+    struct ProfileFunc *Func;
+
+    for (Func = Prof->FuncHash[Hash]; Func != NULL; Func = Func->Next) {
+        if (Func->Name == Name)
+            return Func;
+    }
+
+    Func = HeapAllocMem(pc, sizeof(struct ProfileFunc));
+    if (Func == NULL)
+        ProgramFailNoParser(pc, "(profile) out of memory");
+
+    Func->Name = Name;
+    Func->Next = Prof->FuncHash[Hash];
+    Prof->FuncHash[Hash] = Func;
+    Prof->NumFuncs++;
+
+    return Func;
+}
+
+/* find where a call goes in the call tree */
+static struct ProfileNode *ProfileGetNode(Picoc *pc, struct ProfileNode *Parent,
+    struct ProfileFunc *Func)
+{
+    struct ProfileNode *Node;
+
+    for (Node = Parent->FirstChild; Node != NULL; Node = Node->NextSibling) {
+        if (Node->Func == Func)
+            return Node;
+    }
+
+    Node = HeapAllocMem(pc, sizeof(struct ProfileNode));
+    if (Node == NULL)
+        ProgramFailNoParser(pc, "(profile) out of memory");
+
+    Node->Func = Func;
+    Node->Parent = Parent;
+    Node->NextSibling = Parent->FirstChild;
+    Parent->FirstChild = Node;
+
+    return Node;
+}
+
+/* a function has been called and Frame is its new stack frame */
+void ProfileEnter(Picoc *pc, const char *FuncName, struct StackFrame *Frame)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileFunc *Func;
+    struct ProfileFrame *Top;
+    struct ProfileNode *Parent;
+
+    if (THREAD(pc) != &pc->MainThread)
+        return;
+
+    if (Prof->StackDepth == Prof->StackAlloc) {
+        int NewAlloc = Prof->StackAlloc ? Prof->StackAlloc * 2 : 64;
+        struct ProfileFrame *NewStack = HeapAllocMem(pc,
+            sizeof(struct ProfileFrame) * NewAlloc);
+
+        if (NewStack == NULL)
+            ProgramFailNoParser(pc, "(profile) out of memory");
+
+        if (Prof->StackDepth > 0)
+            memcpy(NewStack, Prof->Stack,
+                sizeof(struct ProfileFrame) * Prof->StackDepth);
+        HeapFreeMem(pc, Prof->Stack);
+        Prof->Stack = NewStack;
+        Prof->StackAlloc = NewAlloc;
+    }
+
+    Func = ProfileGetFunc(pc, FuncName);
+    Func->Calls++;
+    Func->Active++;
+
+    Parent = Prof->StackDepth > 0 ? Prof->Stack[Prof->StackDepth-1].Node :
+        &Prof->Root;
+    Top = &Prof->Stack[Prof->StackDepth++];
+    if (Prof->StackDepth > Prof->MaxDepth)
+        Prof->MaxDepth = Prof->StackDepth;
+
+    Top->Frame = Frame;
+    Top->Node = ProfileGetNode(pc, Parent, Func);
+    Top->ChildTime = 0;
+    Top->Start = PlatformClock();
+}
+
+/* charge the innermost running call with its time and take it off */
+static void ProfilePop(struct Profile *Prof, uint64_t Now)
+{
+    struct ProfileFrame *Top = &Prof->Stack[--Prof->StackDepth];
+    struct ProfileFunc *Func = Top->Node->Func;
+    uint64_t Elapsed = Now - Top->Start;
+
+    Func->SelfTime += Elapsed - Top->ChildTime;
+    Top->Node->SelfTime += Elapsed - Top->ChildTime;
+    if (--Func->Active == 0)
+        Func->TotalTime += Elapsed;
+
+    if (Prof->StackDepth > 0)
+        Prof->Stack[Prof->StackDepth-1].ChildTime += Elapsed;
+    else
+        Prof->CalledTime += Elapsed;
+}
+
+/* the function with stack frame Frame is returning. any calls inside it
+    which were left without returning - by a coroutine which was thrown
+    away, say - end now too */
+void ProfileLeave(Picoc *pc, struct StackFrame *Frame)
+{
+    struct Profile *Prof = pc->Profile;
+    uint64_t Now;
+    int Depth;
+
+    if (THREAD(pc) != &pc->MainThread)
+        return;
+
+    for (Depth = Prof->StackDepth; Depth > 0; Depth--) {
+        if (Prof->Stack[Depth-1].Frame == Frame)
+            break;
+    }
+
+    if (Depth == 0)
+        return;
+
+    Now = PlatformClock();
+    while (Prof->StackDepth >= Depth)
+        ProfilePop(Prof, Now);
+}
+
+/* a statement is about to run */
+void ProfileStatement(struct ParseState *Parser)
+{
+    Picoc *pc = Parser->pc;
+    struct Profile *Prof = pc->Profile;
+    struct ProfileLine *Entry = Prof->LastLine;
+    int Line;
+    int Hash;
+
+    if (THREAD(pc) != &pc->MainThread)
+        return;
+
+    Line = LexPeekLine(Parser);
+    if (Entry != NULL && Entry->Line == Line &&
+            Entry->FileName == Parser->FileName) {
+        Entry->Hits++;
+        return;
+    }
+
+    Hash = PROFILE_HASH(Parser->FileName, Line);
+    for (Entry = Prof->LineHash[Hash]; Entry != NULL; Entry = Entry->Next) {
+        if (Entry->Line == Line && Entry->FileName == Parser->FileName)
+            break;
+    }
+
+    if (Entry == NULL) {
+        Entry = HeapAllocMem(pc, sizeof(struct ProfileLine));
+        if (Entry == NULL)
+            ProgramFail(Parser, "(profile) out of memory");
+
+        Entry->FileName = Parser->FileName;
+        Entry->Line = Line;
+        Entry->Next = Prof->LineHash[Hash];
+        Prof->LineHash[Hash] = Entry;
+        Prof->NumLines++;
+    }
+
+    Entry->Hits++;
+    Prof->LastLine = Entry;
+}
+
+/* sort functions by the time spent in them, most first */
+static int ProfileCompareFuncs(const void *A, const void *B)
+{
+    const struct ProfileFunc *FuncA = *(struct ProfileFunc **)A;
+    const struct ProfileFunc *FuncB = *(struct ProfileFunc **)B;
+
+    if (FuncA->SelfTime != FuncB->SelfTime)
+        return FuncA->SelfTime < FuncB->SelfTime ? 1 : -1;
+
+    return strcmp(FuncA->Name, FuncB->Name);
+}
+
+/* sort lines by how often they ran, most first */
+static int ProfileCompareLines(const void *A, const void *B)
+{
+    const struct ProfileLine *LineA = *(struct ProfileLine **)A;
+    const struct ProfileLine *LineB = *(struct ProfileLine **)B;
+    int Diff;
+
+    if (LineA->Hits != LineB->Hits)
+        return LineA->Hits < LineB->Hits ? 1 : -1;
+
+    Diff = strcmp(LineA->FileName, LineB->FileName);
+    return Diff != 0 ? Diff : LineA->Line - LineB->Line;
+}
+
+/* write the functions, busiest first */
+static void ProfileReportFuncs(Picoc *pc, FILE *Report, uint64_t Total)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileFunc **Funcs;
+    struct ProfileFunc *Func;
+    int NumFuncs = 0;
+    int Count;
+
+    Funcs = HeapAllocMem(pc, sizeof(struct ProfileFunc *) * (Prof->NumFuncs + 1));
+    if (Funcs == NULL)
+        return;
+
+    for (Count = 0; Count < PROFILE_HASH_SIZE; Count++) {
+        for (Func = Prof->FuncHash[Count]; Func != NULL; Func = Func->Next)
+            Funcs[NumFuncs++] = Func;
+    }
+
+    qsort(Funcs, NumFuncs, sizeof(struct ProfileFunc *), ProfileCompareFuncs);
+    fprintf(Report, "%10s %12s %7s %12s  %s\n", "calls", "self ms", "self %",
+        "total ms", "function");
+    for (Count = 0; Count < NumFuncs; Count++) {
+        Func = Funcs[Count];
+        fprintf(Report, "%10lu %12.3f %6.1f%% %12.3f  %s\n", Func->Calls,
+            Func->SelfTime / 1e6, Total ? Func->SelfTime * 100.0 / Total : 0.0,
+            Func->TotalTime / 1e6, Func->Name);
+    }
+
+    HeapFreeMem(pc, Funcs);
+}
+
+/* write the lines which ran most often */
+static void ProfileReportLines(Picoc *pc, FILE *Report)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileLine **Lines;
+    struct ProfileLine *Line;
+    int NumLines = 0;
+    int Count;
+
+    Lines = HeapAllocMem(pc, sizeof(struct ProfileLine *) * (Prof->NumLines + 1));
+    if (Lines == NULL)
+        return;
+
+    for (Count = 0; Count < PROFILE_HASH_SIZE; Count++) {
+        for (Line = Prof->LineHash[Count]; Line != NULL; Line = Line->Next)
+            Lines[NumLines++] = Line;
+    }
+
+    qsort(Lines, NumLines, sizeof(struct ProfileLine *), ProfileCompareLines);
+    fprintf(Report, "\n%10s  %s\n", "runs", "line");
+    for (Count = 0; Count < NumLines && Count < PROFILE_REPORT_LINES; Count++)
+        fprintf(Report, "%10lu  %s:%d\n", Lines[Count]->Hits,
+            Lines[Count]->FileName, Lines[Count]->Line);
+
+    HeapFreeMem(pc, Lines);
+}
+
+/* write the call tree as folded stacks, which flame graph tools read: the
+    functions from the outermost in, separated by ';', then the microseconds
+    spent in the innermost one */
+static void ProfileReportFolded(Picoc *pc, FILE *Folded)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileNode *Node = Prof->Root.FirstChild;
+    struct ProfileNode *Path;
+    const char **Names;
+    int Depth;
+
+    Names = HeapAllocMem(pc, sizeof(const char *) * (Prof->MaxDepth + 1));
+    if (Names == NULL)
+        return;
+
+    if (Prof->Root.SelfTime >= 1000)
+        fprintf(Folded, "(top level) %llu\n",
+            (unsigned long long)(Prof->Root.SelfTime / 1000));
+
+    /* walk the tree without recursing, since it's as deep as the program's
+        deepest recursion */
+    while (Node != NULL) {
+        if (Node->SelfTime >= 1000) {
+            Depth = 0;
+            for (Path = Node; Path != &Prof->Root; Path = Path->Parent)
+                Names[Depth++] = Path->Func->Name;
+
+            while (--Depth > 0)
+                fprintf(Folded, "%s;", Names[Depth]);
+
+            fprintf(Folded, "%s %llu\n", Names[0],
+                (unsigned long long)(Node->SelfTime / 1000));
+        }
+
+        if (Node->FirstChild != NULL)
+            Node = Node->FirstChild;
+        else {
+            while (Node != &Prof->Root && Node->NextSibling == NULL)
+                Node = Node->Parent;
+
+            Node = Node == &Prof->Root ? NULL : Node->NextSibling;
+        }
+    }
+
+    HeapFreeMem(pc, Names);
+}
+
+/* write what the profiler has seen. calls which haven't returned yet, eg.
+    because the program called exit(), are ended first. Report gets the
+    functions and the lines which ran most, Folded gets the call stacks in
+    the format flame graph tools use. either can be NULL */
+void PicocProfileReport(Picoc *pc, FILE *Report, FILE *Folded)
+{
+    struct Profile *Prof = pc->Profile;
+    uint64_t Total;
+
+    if (Prof == NULL)
+        return;
+
+    if (Prof->Stop == 0) {
+        Prof->Stop = PlatformClock();
+        while (Prof->StackDepth > 0)
+            ProfilePop(Prof, Prof->Stop);
+    }
+
+    Total = Prof->Stop - Prof->Start;
+    Prof->Root.SelfTime = Total - Prof->CalledTime;
+
+    if (Report != NULL) {
+        fprintf(Report, "profile: %.3f s\n", Total / 1e9);
+        ProfileReportFuncs(pc, Report, Total);
+        ProfileReportLines(pc, Report);
+        fflush(Report);
+    }
+
+    if (Folded != NULL) {
+        ProfileReportFolded(pc, Folded);
+        fflush(Folded);
+    }
+}
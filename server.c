@@ -0,0 +1,662 @@
+/* picoc server - keeps interpreters with programs already parsed in them
+ * ready to run, and runs them for clients connecting over a unix domain
+ * socket. this saves clients the start up and parsing time.
+ *
+ * requests and replies are series of frames, each a line "<kind> <length>\n"
+ * followed by that many bytes of data. a request is:
+ *   "f" - the file to run
+ *   "n" - the function to call, or main() if there isn't one
+ *   "a" - an argument, one frame each, in order
+ *   "e 0\n" - the end of the request
+ *
+ * in the reply "o" frames carry the program's output, "r" what the function
+ * returned, as text, and "x <exit value>\n" ends the reply. a connection
+ * can make any number of requests */
+
+#define _GNU_SOURCE
+#include "picoc.h"
+#include "interpreter.h"
+
+#ifdef UNIX_HOST
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_LINE_MAX (4096)      /* longest frame header */
+#define SERVER_REQUEST_MAX (1024*1024)  /* most data in a request */
+#define SERVER_ARGS_MAX (1024)      /* most arguments in a request */
+
+/* a program parsed into its own interpreter, snapshotted just after
+    parsing so every run starts from the same state */
+struct ServerProgram
+{
+    Picoc *pc;
+    char *FileName;
+    struct timespec ModTime;
+    off_t Size;
+    unsigned long LastUsed;
+};
+
+/* a request read from a client. each field is allocated on its own */
+struct ServerRequest
+{
+    char *FuncName;                 /* NULL to call main() */
+    int NumArgs;
+    char *Argv[SERVER_ARGS_MAX+2];  /* the file, then the arguments */
+    size_t Size;                    /* how much data it's had so far */
+    int TooLarge;                   /* some of it was thrown away */
+};
+
+/* each worker thread has its own programs so they never need locking */
+struct ServerWorker
+{
+    int Listen;
+    int StackSize;
+    unsigned long Clock;
+    struct ServerProgram Cache[SERVER_CACHE_SIZE];
+};
+
+
+/* write all of a buffer to a socket */
+static int ServerSend(int Conn, const char *Buf, size_t Size)
+{
+    ssize_t Sent;
+
+    while (Size > 0) {
+        Sent = send(Conn, Buf, Size, MSG_NOSIGNAL);
+        if (Sent < 0 && errno == EINTR)
+            continue;
+        if (Sent <= 0)
+            return -1;
+
+        Buf += Sent;
+        Size -= Sent;
+    }
+
+    return 0;
+}
+
+/* send a frame with a small printf-style body */
+static int ServerSendFrame(int Conn, const char *Format, ...)
+{
+    char Frame[SERVER_LINE_MAX];
+    va_list Args;
+    int Len;
+
+    va_start(Args, Format);
+    Len = vsnprintf(Frame, sizeof(Frame), Format, Args);
+    va_end(Args);
+
+    if (Len >= (int)sizeof(Frame))
+        Len = sizeof(Frame) - 1;
+
+    return ServerSend(Conn, Frame, Len);
+}
+
+/* send a frame of Kind with Size bytes of data after it */
+static int ServerSendData(int Conn, char Kind, const char *Buf, size_t Size)
+{
+    if (ServerSendFrame(Conn, "%c %lu\n", Kind, (unsigned long)Size) < 0)
+        return -1;
+
+    return ServerSend(Conn, Buf, Size);
+}
+
+/* read a frame's header. returns false if there isn't a good one */
+static int ServerReadFrame(FILE *Input, char *Kind, size_t *Size)
+{
+    char Header[SERVER_LINE_MAX];
+    char *End;
+
+    if (fgets(Header, sizeof(Header), Input) == NULL || Header[0] == '\0' ||
+            Header[1] != ' ' || !isdigit((unsigned char)Header[2]))
+        return false;
+
+    *Kind = Header[0];
+    *Size = strtoul(&Header[2], &End, 10);
+    return *End == '\n';
+}
+
+/* read past Size bytes of data we don't want */
+static int ServerSkipData(FILE *Input, size_t Size)
+{
+    char Buf[BUFSIZ];
+    size_t Got;
+
+    while (Size > 0) {
+        Got = fread(Buf, 1, Size < sizeof(Buf) ? Size : sizeof(Buf), Input);
+        if (Got == 0)
+            return false;
+
+        Size -= Got;
+    }
+
+    return true;
+}
+
+/* free a request's fields */
+static void ServerFreeRequest(struct ServerRequest *Req)
+{
+    int Count;
+
+    free(Req->FuncName);
+    for (Count = 0; Count <= Req->NumArgs; Count++)
+        free(Req->Argv[Count]);
+}
+
+/* read a request from a client. a request with too much in it is read to
+    the end but its extra data is thrown away and TooLarge is set. returns
+    false if the client has gone or doesn't follow the protocol */
+static int ServerReadRequest(FILE *Input, struct ServerRequest *Req)
+{
+    char Kind;
+    size_t Size;
+    char *Data;
+
+    memset((void*)Req, '\0', sizeof(*Req));
+    while (ServerReadFrame(Input, &Kind, &Size)) {
+        if (Kind == 'e')
+            return true;
+
+        if (Kind != 'f' && Kind != 'n' && Kind != 'a')
+            return false;
+
+        Data = NULL;
+        if (Size <= SERVER_REQUEST_MAX - Req->Size &&
+                (Kind != 'a' || Req->NumArgs < SERVER_ARGS_MAX))
+            Data = malloc(Size + 1);
+
+        if (Data == NULL) {
+            Req->TooLarge = true;
+            if (!ServerSkipData(Input, Size))
+                return false;
+            continue;
+        }
+
+        if (fread(Data, 1, Size, Input) != Size) {
+            free(Data);
+            return false;
+        }
+
+        Data[Size] = '\0';
+        Req->Size += Size;
+        if (Kind == 'f') {
+            free(Req->Argv[0]);
+            Req->Argv[0] = Data;
+        } else if (Kind == 'n') {
+            free(Req->FuncName);
+            Req->FuncName = Data;
+        } else
+            Req->Argv[++Req->NumArgs] = Data;
+    }
+
+    return false;
+}
+
+/* the program's stdout, each write becomes an output frame */
+static ssize_t ServerWriteOutput(void *Cookie, const char *Buf, size_t Size)
+{
+    int Conn = *(int*)Cookie;
+
+    if (ServerSendData(Conn, 'o', Buf, Size) < 0)
+        return -1;
+
+    return Size;
+}
+
+/* get rid of a cached program */
+static void ServerDiscard(struct ServerProgram *Prog)
+{
+    if (Prog->pc != NULL) {
+        PicocCleanup(Prog->pc);
+        free(Prog->pc);
+    }
+
+    free(Prog->FileName);
+    memset((void*)Prog, '\0', sizeof(*Prog));
+}
+
+/* find a program in the cache, parsing it if it isn't there or the file
+    has changed since it was parsed. parse errors go to Output */
+static struct ServerProgram *ServerLoad(struct ServerWorker *Worker,
+    const char *FileName, FILE *Output)
+{
+    int Count;
+    struct stat FileInfo;
+    struct ServerProgram *Prog = NULL;
+
+    if (stat(FileName, &FileInfo) != 0) {
+        fprintf(Output, "can't read file %s\n", FileName);
+        return NULL;
+    }
+
+    for (Count = 0; Count < SERVER_CACHE_SIZE; Count++) {
+        struct ServerProgram *This = &Worker->Cache[Count];
+
+        if (This->FileName != NULL && strcmp(This->FileName, FileName) == 0) {
+            if (This->Size == FileInfo.st_size &&
+                    This->ModTime.tv_sec == FileInfo.st_mtim.tv_sec &&
+                    This->ModTime.tv_nsec == FileInfo.st_mtim.tv_nsec) {
+                This->LastUsed = ++Worker->Clock;
+                return This;
+            }
+
+            /* it's changed, parse it again */
+            Prog = This;
+            break;
+        }
+
+        if (Prog == NULL || This->LastUsed < Prog->LastUsed)
+            Prog = This;
+    }
+
+    ServerDiscard(Prog);
+    Prog->pc = malloc(sizeof(Picoc));
+    if (Prog->pc == NULL) {
+        fprintf(Output, "out of memory\n");
+        return NULL;
+    }
+
+    PicocInitialize(Prog->pc, Worker->StackSize);
+    Prog->pc->CStdOut = Output;
+    if (PicocPlatformSetExitPoint(Prog->pc)) {
+        Prog->pc->CStdOut = stdout;
+        ServerDiscard(Prog);
+        return NULL;
+    }
+
+    PicocPlatformScanFile(Prog->pc, FileName);
+    PicocSnapshot(Prog->pc);
+    Prog->pc->CStdOut = stdout;
+
+    Prog->FileName = strdup(FileName);
+    Prog->ModTime = FileInfo.st_mtim;
+    Prog->Size = FileInfo.st_size;
+    Prog->LastUsed = ++Worker->Clock;
+
+    return Prog;
+}
+
+/* convert a request argument to the type of the parameter it's for */
+static void ServerParseArg(Picoc *pc, struct ValueType *Typ, char *Arg,
+    union AnyValue *Val)
+{
+    switch (Typ->Base) {
+    case TypeChar:
+        Val->Character = strtol(Arg, NULL, 0);
+        break;
+    case TypeUnsignedChar:
+        Val->UnsignedCharacter = strtoul(Arg, NULL, 0);
+        break;
+    case TypeShort:
+        Val->ShortInteger = strtol(Arg, NULL, 0);
+        break;
+    case TypeUnsignedShort:
+        Val->UnsignedShortInteger = strtoul(Arg, NULL, 0);
+        break;
+    case TypeInt:
+    case TypeEnum:
+        Val->Integer = strtol(Arg, NULL, 0);
+        break;
+    case TypeUnsignedInt:
+        Val->UnsignedInteger = strtoul(Arg, NULL, 0);
+        break;
+    case TypeLong:
+        Val->LongInteger = strtol(Arg, NULL, 0);
+        break;
+    case TypeUnsignedLong:
+        Val->UnsignedLongInteger = strtoul(Arg, NULL, 0);
+        break;
+    case TypeFP:
+        Val->FP = strtod(Arg, NULL);
+        break;
+    case TypePointer:
+        if (Typ->FromType->Base == TypeChar) {
+            Val->Pointer = Arg;
+            break;
+        }
+        /* fall through */
+    default:
+        ProgramFailNoParser(pc, "can't pass \"%s\" as %t", Arg, Typ);
+    }
+}
+
+/* send what a function returned as a return frame */
+static void ServerSendReturn(int Conn, struct ValueType *Typ,
+    union AnyValue *Val)
+{
+    char Text[64];
+    const char *Buf = Text;
+    int Len;
+
+    switch (Typ->Base) {
+    case TypeChar:
+        Len = snprintf(Text, sizeof(Text), "%d", Val->Character);
+        break;
+    case TypeUnsignedChar:
+        Len = snprintf(Text, sizeof(Text), "%u", Val->UnsignedCharacter);
+        break;
+    case TypeShort:
+        Len = snprintf(Text, sizeof(Text), "%d", Val->ShortInteger);
+        break;
+    case TypeUnsignedShort:
+        Len = snprintf(Text, sizeof(Text), "%u", Val->UnsignedShortInteger);
+        break;
+    case TypeInt:
+    case TypeEnum:
+        Len = snprintf(Text, sizeof(Text), "%d", Val->Integer);
+        break;
+    case TypeUnsignedInt:
+        Len = snprintf(Text, sizeof(Text), "%u", Val->UnsignedInteger);
+        break;
+    case TypeLong:
+        Len = snprintf(Text, sizeof(Text), "%ld", Val->LongInteger);
+        break;
+    case TypeUnsignedLong:
+        Len = snprintf(Text, sizeof(Text), "%lu", Val->UnsignedLongInteger);
+        break;
+    case TypeFP:
+        Len = snprintf(Text, sizeof(Text), "%.17g", Val->FP);
+        break;
+    case TypePointer:
+        /* strings can be any length and have newlines in them, which is
+            why the frame has a length rather than ending with a newline */
+        if (Typ->FromType->Base != TypeChar || Val->Pointer == NULL)
+            return;
+
+        Buf = Val->Pointer;
+        Len = strlen(Buf);
+        break;
+    default:
+        return;
+    }
+
+    ServerSendData(Conn, 'r', Buf, Len);
+}
+
+/* call a function in the program with arguments from the request */
+static void ServerCall(Picoc *pc, int Conn, FILE *Output, char *FuncName,
+    int NumArgs, char **ArgText)
+{
+    int Count;
+    union AnyValue Args[PARAMETER_MAX];
+    union AnyValue ReturnValue;
+    struct Value *FuncValue = PicocGetFunction(pc, FuncName);
+
+    if (FuncValue == NULL)
+        ProgramFailNoParser(pc, "%s() is not defined", FuncName);
+
+    if (NumArgs != FuncValue->Val->FuncDef.NumParams)
+        ProgramFailNoParser(pc, "%s() takes %d arguments, not %d", FuncName,
+            FuncValue->Val->FuncDef.NumParams, NumArgs);
+
+    for (Count = 0; Count < NumArgs; Count++)
+        ServerParseArg(pc, FuncValue->Val->FuncDef.ParamType[Count],
+            ArgText[Count], &Args[Count]);
+
+    PicocCallFunction(pc, FuncValue, Args, NumArgs, &ReturnValue);
+
+    fflush(Output);
+    ServerSendReturn(Conn, FuncValue->Val->FuncDef.ReturnType, &ReturnValue);
+}
+
+/* carry out one request and send the reply */
+static void ServerRequest(struct ServerWorker *Worker, int Conn, FILE *Output,
+    struct ServerRequest *Req)
+{
+    int ExitValue = 1;
+    struct ServerProgram *Prog;
+
+    if (Req->TooLarge) {
+        fprintf(Output, "request too large\n");
+    } else if (Req->Argv[0] == NULL) {
+        fprintf(Output, "bad request\n");
+    } else if ((Prog = ServerLoad(Worker, Req->Argv[0], Output)) != NULL) {
+        Picoc *pc = Prog->pc;
+
+        pc->CStdOut = Output;
+        if (!PicocPlatformSetExitPoint(pc)) {
+            if (Req->FuncName != NULL)
+                ServerCall(pc, Conn, Output, Req->FuncName, Req->NumArgs,
+                    &Req->Argv[1]);
+            else
+                PicocCallMain(pc, Req->NumArgs+1, Req->Argv);
+        }
+
+        ExitValue = pc->PicocExitValue;
+        pc->CStdOut = stdout;
+        PicocRestoreSnapshot(pc);
+    }
+
+    fflush(Output);
+    ServerSendFrame(Conn, "x %d\n", ExitValue);
+}
+
+/* take requests from a client until it hangs up */
+static void ServerConnection(struct ServerWorker *Worker, int Conn)
+{
+    cookie_io_functions_t OutputFuncs = { NULL, ServerWriteOutput, NULL, NULL };
+    struct ServerRequest *Req = malloc(sizeof(struct ServerRequest));
+    FILE *Input = fdopen(Conn, "r");
+    FILE *Output = fopencookie(&Conn, "w", OutputFuncs);
+
+    if (Req == NULL || Input == NULL || Output == NULL) {
+        free(Req);
+        if (Output != NULL)
+            fclose(Output);
+        if (Input != NULL)
+            fclose(Input);
+        else
+            close(Conn);
+        return;
+    }
+
+    setvbuf(Output, NULL, _IOLBF, BUFSIZ);
+    while (ServerReadRequest(Input, Req)) {
+        ServerRequest(Worker, Conn, Output, Req);
+        ServerFreeRequest(Req);
+    }
+
+    ServerFreeRequest(Req);
+    free(Req);
+    fclose(Output);
+    fclose(Input);
+}
+
+/* a worker thread. it serves one connection at a time */
+static void *ServerWorkerThread(void *Arg)
+{
+    struct ServerWorker *Worker = Arg;
+    int Count;
+    int Conn;
+
+    while (true) {
+        Conn = accept(Worker->Listen, NULL, NULL);
+        if (Conn >= 0)
+            ServerConnection(Worker, Conn);
+        else if (errno != EINTR && errno != ECONNABORTED)
+            break;
+    }
+
+    for (Count = 0; Count < SERVER_CACHE_SIZE; Count++)
+        ServerDiscard(&Worker->Cache[Count]);
+
+    return NULL;
+}
+
+/* remove a socket left behind by an earlier server. anything else with
+    the same name is left alone and is an error */
+static int ServerRemoveSocket(const char *SocketPath)
+{
+    struct stat FileInfo;
+
+    if (lstat(SocketPath, &FileInfo) != 0)
+        return (errno == ENOENT) ? 0 : -1;
+
+    if (!S_ISSOCK(FileInfo.st_mode)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    return unlink(SocketPath);
+}
+
+/* serve requests on a unix domain socket with NumThreads workers. only
+    returns if the socket can't be set up, or stops working */
+int PicocServe(const char *SocketPath, int NumThreads, int StackSize)
+{
+    struct sockaddr_un Addr;
+    struct ServerWorker *Workers;
+    pthread_t *Threads;
+    pthread_attr_t Attr;
+    int Started = 0;
+    int Listen;
+    int Count;
+
+    if (strlen(SocketPath) >= sizeof(Addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset((void*)&Addr, '\0', sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strcpy(Addr.sun_path, SocketPath);
+
+    Listen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Listen < 0)
+        return -1;
+
+    if (ServerRemoveSocket(SocketPath) != 0 ||
+            bind(Listen, (struct sockaddr*)&Addr, sizeof(Addr)) != 0 ||
+            listen(Listen, SOMAXCONN) != 0) {
+        close(Listen);
+        return -1;
+    }
+
+    if (NumThreads < 1)
+        NumThreads = 1;
+
+    Workers = calloc(NumThreads, sizeof(struct ServerWorker));
+    Threads = malloc(sizeof(pthread_t) * NumThreads);
+    if (Workers == NULL || Threads == NULL) {
+        free(Workers);
+        free(Threads);
+        close(Listen);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* the same native stack as the main thread, like PicocRunBatch() */
+    pthread_attr_init(&Attr);
+    pthread_attr_setstacksize(&Attr,
+        PlatformNativeStackSize() + NATIVE_STACK_MARGIN);
+
+    for (; Started < NumThreads; Started++) {
+        Workers[Started].Listen = Listen;
+        Workers[Started].StackSize = StackSize;
+        if (pthread_create(&Threads[Started], &Attr, ServerWorkerThread,
+                &Workers[Started]) != 0)
+            break;
+    }
+
+    if (Started == 0) {
+        Workers[0].Listen = Listen;
+        Workers[0].StackSize = StackSize;
+        ServerWorkerThread(&Workers[0]);
+    }
+
+    for (Count = 0; Count < Started; Count++)
+        pthread_join(Threads[Count], NULL);
+
+    pthread_attr_destroy(&Attr);
+    close(Listen);
+    ServerRemoveSocket(SocketPath);
+    free(Workers);
+    free(Threads);
+    return -1;
+}
+
+/* copy Size bytes of a frame's data from Input to Output */
+static void ServerCopyData(FILE *Input, FILE *Output, size_t Size)
+{
+    char Buf[BUFSIZ];
+    size_t Got;
+
+    while (Size > 0) {
+        Got = fread(Buf, 1, Size < sizeof(Buf) ? Size : sizeof(Buf), Input);
+        if (Got == 0)
+            break;
+
+        fwrite(Buf, 1, Got, Output);
+        Size -= Got;
+    }
+}
+
+/* send the fields of a request */
+static int ServerSendRequest(int Conn, const char *FileName,
+    const char *FuncName, int NumArgs, char **Args)
+{
+    int Count;
+
+    if (ServerSendData(Conn, 'f', FileName, strlen(FileName)) < 0)
+        return -1;
+
+    if (FuncName != NULL &&
+            ServerSendData(Conn, 'n', FuncName, strlen(FuncName)) < 0)
+        return -1;
+
+    for (Count = 0; Count < NumArgs; Count++) {
+        if (ServerSendData(Conn, 'a', Args[Count], strlen(Args[Count])) < 0)
+            return -1;
+    }
+
+    return ServerSendFrame(Conn, "e 0\n");
+}
+
+/* ask a server to run FileName, calling FuncName, or main() if it's NULL,
+    with the arguments, and copy the reply to Output. returns the program's
+    exit value, or -1 if the server couldn't be reached */
+int PicocServerRequest(const char *SocketPath, const char *FileName,
+    const char *FuncName, int NumArgs, char **Args, FILE *Output)
+{
+    struct sockaddr_un Addr;
+    char Frame[SERVER_LINE_MAX];
+    FILE *Input;
+    int Conn;
+
+    if (strlen(SocketPath) >= sizeof(Addr.sun_path))
+        return -1;
+
+    memset((void*)&Addr, '\0', sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strcpy(Addr.sun_path, SocketPath);
+
+    Conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Conn < 0)
+        return -1;
+
+    if (connect(Conn, (struct sockaddr*)&Addr, sizeof(Addr)) != 0 ||
+            ServerSendRequest(Conn, FileName, FuncName, NumArgs, Args) < 0 ||
+            (Input = fdopen(Conn, "r")) == NULL) {
+        close(Conn);
+        return -1;
+    }
+
+    while (fgets(Frame, sizeof(Frame), Input) != NULL) {
+        if (Frame[0] == 'o') {
+            ServerCopyData(Input, Output, strtoul(&Frame[2], NULL, 10));
+            fflush(Output);
+        } else if (Frame[0] == 'r') {
+            ServerCopyData(Input, Output, strtoul(&Frame[2], NULL, 10));
+            putc('\n', Output);
+        } else if (Frame[0] == 'x') {
+            fclose(Input);
+            return atoi(&Frame[2]);
+        }
+    }
+
+    fclose(Input);
+    return -1;
+}
+#endif
@@ -1,102 +1,297 @@
 /* picoc hash table module. This hash table code is used for both symbol tables
- * and the shared string table. */
+ * and the shared string table. Tables are open addressed with linear probing
+ * and grow when they get three quarters full. */
 
 #include "interpreter.h"
 
 
-static unsigned int TableHash(const char *Key, int Len);
+/* the program's threads search the interpreter's tables without taking
+    the lock, while a thread holding it may add to them. a slot's key is
+    stored last and read first, and a table's slots and size are read
+    together under its version like a seqlock (see TableGetSlots()) */
+#ifdef UNIX_HOST
+#define TableLoad(Field, Order) __atomic_load_n(&(Field), (Order))
+#define TableStore(Field, Value, Order) __atomic_store_n(&(Field), (Value), (Order))
+#define TableFence(Order) __atomic_thread_fence(Order)
+#else
+#define TableLoad(Field, Order) (Field)
+#define TableStore(Field, Value, Order) ((Field) = (Value))
+#define TableFence(Order)
+#endif
+
+/* marks a deleted slot so searches carry on past it */
+static struct Value TableDeletedValue;
+
 static struct TableEntry *TableSearch(struct Table *Tbl, const char *Key,
-    int *AddAt);
+    struct TableEntry **AddAt);
 static struct TableEntry *TableSearchIdentifier(struct Table *Tbl,
-    const char *Key, int Len, int *AddAt);
+    const char *Key, int Len, unsigned int Hash, struct TableEntry **AddAt);
 
 /* initialize the shared string system */
 void TableInit(Picoc *pc)
 {
     TableInitTable(&pc->StringTable, &pc->StringHashTable[0],
-            STRING_TABLE_SIZE, true);
+            STRING_TABLE_SIZE);
     pc->StrEmpty = TableStrRegister(pc, "");
 }
 
-/* hash function for strings */
-unsigned int TableHash(const char *Key, int Len)
+/* mix the bits of a hash word together */
+static uint64_t TableMix(uint64_t Hash)
 {
-    unsigned int Hash = Len;
-    int Offset;
-    int Count;
+    Hash ^= Hash >> 32;
+    Hash *= 0xd6e8feb86659fd93ULL;
+    Hash ^= Hash >> 32;
 
-    for (Count = 0, Offset = 8; Count < Len; Count++, Offset+=7) {
-        if (Offset > sizeof(unsigned int) * 8 - 7)
-            Offset -= sizeof(unsigned int) * 8 - 6;
+    return Hash;
+}
+
+/* hash function for strings. it takes the string a word at a time,
+    multiplying each one in, in the style of wyhash */
+unsigned int TableHash(const char *Key, int Len)
+{
+    uint64_t Hash = 0x9e3779b97f4a7c15ULL ^ (uint64_t)Len;
+    uint64_t Word;
 
-        Hash ^= *Key++ << Offset;
+    for (; Len >= sizeof(Word); Len -= sizeof(Word), Key += sizeof(Word)) {
+        memcpy((void*)&Word, (void*)Key, sizeof(Word));
+        Hash = TableMix((Hash ^ Word) * 0xa0761d6478bd642fULL);
     }
 
-    return Hash;
+    Word = 0;
+    memcpy((void*)&Word, (void*)Key, Len);
+    Hash = TableMix((Hash ^ Word) * 0xa0761d6478bd642fULL);
+
+    return (unsigned int)Hash;
+}
+
+/* hash function for shared strings. they have unique addresses so we
+    don't need to look at the characters. the bottom bit is ignored since
+    variables which are out of scope have it set */
+static unsigned int TablePointerHash(const char *Key)
+{
+    uintptr_t Addr = (uintptr_t)Key >> 1;
+
+    return (unsigned int)Addr ^ (unsigned int)(Addr >> 16 >> 16);
+}
+
+/* spread a hash over the slots of a table */
+static unsigned int TableSlot(unsigned int Hash, int Size)
+{
+    Hash ^= Hash >> 16;
+    Hash *= 0x45d9f3b;
+    Hash ^= Hash >> 16;
+
+    return Hash & (Size - 1);
 }
 
-/* initialize a table */
-void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size,
-    int OnHeap)
+/* initialize a table. Size must be a power of two */
+void TableInitTable(struct Table *Tbl, struct TableEntry *HashTable, int Size)
 {
     Tbl->Size = Size;
-    Tbl->OnHeap = OnHeap;
+    Tbl->Count = 0;
+    Tbl->Used = 0;
+    Tbl->OnHeap = false;
+    Tbl->Version = 0;
     Tbl->HashTable = HashTable;
-    memset((void*)HashTable, '\0', sizeof(struct TableEntry*) * Size);
+    memset((void*)HashTable, '\0', sizeof(struct TableEntry) * Size);
+}
+
+/* get a table's slots and its size as a matching pair, even if another
+    thread is growing it. the version is odd while they're being changed
+    and goes up again when they're done, so if it's the same before and
+    after they were read together */
+static void TableGetSlots(struct Table *Tbl, struct TableEntry **HashTable,
+    int *Size)
+{
+    unsigned int Version;
+
+    do {
+        Version = TableLoad(Tbl->Version, __ATOMIC_ACQUIRE);
+        *HashTable = TableLoad(Tbl->HashTable, __ATOMIC_RELAXED);
+        *Size = TableLoad(Tbl->Size, __ATOMIC_RELAXED);
+        TableFence(__ATOMIC_ACQUIRE);
+    } while ((Version & 1) != 0 ||
+        Version != TableLoad(Tbl->Version, __ATOMIC_RELAXED));
+}
+
+/* give a table new slots. the caller holds the lock if there are threads */
+static void TableSetSlots(struct Table *Tbl, struct TableEntry *HashTable,
+    int Size)
+{
+    TableStore(Tbl->Version, Tbl->Version + 1, __ATOMIC_RELAXED);
+    TableFence(__ATOMIC_RELEASE);
+    TableStore(Tbl->HashTable, HashTable, __ATOMIC_RELAXED);
+    TableStore(Tbl->Size, Size, __ATOMIC_RELAXED);
+    TableStore(Tbl->Version, Tbl->Version + 1, __ATOMIC_RELEASE);
+}
+
+/* free a table's slots if they've been grown onto the heap. the table
+    can't be used again afterwards */
+void TableFree(Picoc *pc, struct Table *Tbl)
+{
+    if (Tbl->OnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+
+    Tbl->HashTable = NULL;
+    Tbl->Size = 0;
+    Tbl->Count = 0;
+    Tbl->Used = 0;
+    Tbl->OnHeap = false;
+}
+
+#ifdef UNIX_HOST
+/* keep a shared table's old slots until the interpreter is cleaned up */
+static void TableRetire(Picoc *pc, struct TableEntry *HashTable)
+{
+    struct RetiredSlots *Retired = HeapAllocMem(pc, sizeof(struct RetiredSlots));
+    if (Retired == NULL)
+        ProgramFailNoParser(pc, "(TableRetire) out of memory");
+
+    Retired->HashTable = HashTable;
+    Retired->Next = pc->RetiredSlots;
+    pc->RetiredSlots = Retired;
+}
+#endif
+
+/* make room for another entry, growing the table or clearing out
+    deleted slots when it gets too full */
+static void TableMakeRoom(Picoc *pc, struct Table *Tbl)
+{
+    int Count;
+    int NewSize = Tbl->Size;
+    struct TableEntry *NewHashTable;
+
+    if ((Tbl->Used + 1) * 4 <= Tbl->Size * 3)
+        return;
+
+    if ((Tbl->Count + 1) * 2 > Tbl->Size)
+        NewSize *= 2;
+
+    NewHashTable = HeapAllocCategory(pc, sizeof(struct TableEntry) * NewSize,
+        MemTables);
+    if (NewHashTable == NULL)
+        ProgramFailNoParser(pc, "(TableMakeRoom) out of memory");
+
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        struct TableEntry *Entry = &Tbl->HashTable[Count];
+        unsigned int Slot;
+
+        if (Entry->Key == NULL)
+            continue;
+
+        Slot = TableSlot(Entry->Hash, NewSize);
+        while (NewHashTable[Slot].Key != NULL)
+            Slot = (Slot + 1) & (NewSize - 1);
+
+        NewHashTable[Slot] = *Entry;
+    }
+
+#ifdef UNIX_HOST
+    /* the tables in the interpreter itself are shared by the program's
+        threads, which may still be searching the old slots. rather than
+        make every search take the lock they're kept until cleanup */
+    if (Tbl->OnHeap && pc->Threaded && (char*)Tbl >= (char*)pc &&
+            (char*)Tbl < (char*)(pc + 1))
+        TableRetire(pc, Tbl->HashTable);
+    else
+#endif
+    if (Tbl->OnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+
+    TableSetSlots(Tbl, NewHashTable, NewSize);
+    Tbl->Used = Tbl->Count;
+    Tbl->OnHeap = true;
 }
 
 /* check a hash table entry for a key */
 struct TableEntry *TableSearch(struct Table *Tbl, const char *Key,
-    int *AddAt)
+    struct TableEntry **AddAt)
 {
-    /* shared strings have unique addresses so we don't need to hash them */
-    int HashValue = ((unsigned long)Key) % Tbl->Size;
-    struct TableEntry *Entry;
-
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next) {
-        if (Entry->p.v.Key == Key)
+    struct TableEntry *HashTable;
+    struct TableEntry *FirstDeleted = NULL;
+    int Size;
+    unsigned int Mask;
+    unsigned int Slot;
+
+    TableGetSlots(Tbl, &HashTable, &Size);
+    Mask = Size - 1;
+    Slot = TableSlot(TablePointerHash(Key), Size);
+    while (true) {
+        struct TableEntry *Entry = &HashTable[Slot];
+        char *EntryKey = TableLoad(Entry->Key, __ATOMIC_ACQUIRE);
+
+        if (EntryKey == Key)
             return Entry;   /* found */
-    }
 
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return NULL;
+        if (EntryKey == NULL) {
+            if (Entry->Val == NULL) {
+                /* didn't find it, reuse a deleted slot if we passed one */
+                *AddAt = (FirstDeleted != NULL) ? FirstDeleted : Entry;
+                return NULL;
+            }
+
+            if (FirstDeleted == NULL)
+                FirstDeleted = Entry;
+        }
+
+        Slot = (Slot + 1) & Mask;
+    }
 }
 
-/* set an identifier to a value. returns FALSE if it already exists.
- * Key must be a shared string from TableStrRegister() */
-int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val,
-    const char *DeclFileName, int DeclLine, int DeclColumn)
+/* add an entry for Key holding what's in New. returns FALSE if Key's
+    already there */
+static int TableAdd(Picoc *pc, struct Table *Tbl, char *Key,
+    const struct TableEntry *New)
 {
-    int AddAt;
-    struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
+    struct TableEntry *AddAt;
+    struct TableEntry *FoundEntry;
 
+    TableMakeRoom(pc, Tbl);
+    FoundEntry = TableSearch(Tbl, Key, &AddAt);
     if (FoundEntry == NULL) {   /* add it to the table */
-        struct TableEntry *NewEntry = VariableAlloc(pc, NULL,
-            sizeof(struct TableEntry), Tbl->OnHeap);
-        NewEntry->DeclFileName = DeclFileName;
-        NewEntry->DeclLine = DeclLine;
-        NewEntry->DeclColumn = DeclColumn;
-        NewEntry->p.v.Key = Key;
-        NewEntry->p.v.Val = Val;
-        NewEntry->Next = Tbl->HashTable[AddAt];
-        Tbl->HashTable[AddAt] = NewEntry;
+        if (AddAt->Val == NULL)
+            Tbl->Used++;
+
+        /* the key goes in last since a search takes the entry as soon as it
+            sees the key */
+        Tbl->Count++;
+        AddAt->Val = New->Val;
+        AddAt->DeclFileName = New->DeclFileName;
+        AddAt->DeclLine = New->DeclLine;
+        AddAt->DeclColumn = New->DeclColumn;
+        AddAt->Hash = TablePointerHash(Key);
+        TableStore(AddAt->Key, Key, __ATOMIC_RELEASE);
         return true;
     }
 
     return false;
 }
 
+/* set an identifier to a value. returns FALSE if it already exists.
+ * Key must be a shared string from TableStrRegister() */
+int TableSet(Picoc *pc, struct Table *Tbl, char *Key, struct Value *Val,
+    const char *DeclFileName, int DeclLine, int DeclColumn)
+{
+    struct TableEntry New;
+
+    New.Val = Val;
+    New.DeclFileName = DeclFileName;
+    New.DeclLine = DeclLine;
+    New.DeclColumn = DeclColumn;
+    return TableAdd(pc, Tbl, Key, &New);
+}
+
 /* find a value in a table. returns FALSE if not found.
  * Key must be a shared string from TableStrRegister() */
 int TableGet(struct Table *Tbl, const char *Key, struct Value **Val,
     const char **DeclFileName, int *DeclLine, int *DeclColumn)
 {
-    int AddAt;
+    struct TableEntry *AddAt;
     struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
     if (FoundEntry == NULL)
         return false;
 
-    *Val = FoundEntry->p.v.Val;
+    *Val = FoundEntry->Val;
 
     if (DeclFileName != NULL) {
         *DeclFileName = FoundEntry->DeclFileName;
@@ -107,76 +302,156 @@ int TableGet(struct Table *Tbl, const char *Key, struct Value **Val,
     return true;
 }
 
+/* remove an entry from the table, keeping a copy of it in Removed.
+    returns FALSE if it wasn't there */
+static int TableRemove(struct Table *Tbl, const char *Key,
+    struct TableEntry *Removed)
+{
+    struct TableEntry *AddAt;
+    struct TableEntry *DeleteEntry = TableSearch(Tbl, Key, &AddAt);
+
+    if (DeleteEntry == NULL)
+        return false;
+
+    *Removed = *DeleteEntry;
+    DeleteEntry->Key = NULL;
+    DeleteEntry->Val = &TableDeletedValue;
+    Tbl->Count--;
+
+    return true;
+}
+
 /* remove an entry from the table */
 struct Value *TableDelete(Picoc *pc, struct Table *Tbl, const char *Key)
 {
-    /* shared strings have unique addresses so we don't need to hash them */
-    int HashValue = ((unsigned long)Key) % Tbl->Size;
-    struct TableEntry **EntryPtr;
+    struct TableEntry Removed;
 
-    for (EntryPtr = &Tbl->HashTable[HashValue];
-            *EntryPtr != NULL; EntryPtr = &(*EntryPtr)->Next) {
-        if ((*EntryPtr)->p.v.Key == Key) {
-            struct TableEntry *DeleteEntry = *EntryPtr;
-            struct Value *Val = DeleteEntry->p.v.Val;
-            *EntryPtr = DeleteEntry->Next;
-            HeapFreeMem(pc, DeleteEntry);
+    return TableRemove(Tbl, Key, &Removed) ? Removed.Val : NULL;
+}
 
-            return Val;
-        }
-    }
+/* tables of things other than values - library functions waiting to be
+    defined and the headers identifiers come from - keep a plain pointer
+    in each entry. Ptr mustn't be NULL */
+int TableSetPtr(Picoc *pc, struct Table *Tbl, char *Key, void *Ptr)
+{
+    struct TableEntry New;
+
+    New.Ptr = Ptr;
+    New.DeclFileName = NULL;
+    New.DeclLine = 0;
+    New.DeclColumn = 0;
+    return TableAdd(pc, Tbl, Key, &New);
+}
+
+/* find a pointer in a table, or NULL if it isn't there */
+void *TableGetPtr(struct Table *Tbl, const char *Key)
+{
+    struct TableEntry *AddAt;
+    struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
+
+    return (FoundEntry != NULL) ? FoundEntry->Ptr : NULL;
+}
+
+/* remove a pointer from a table, returning it or NULL if it wasn't there */
+void *TableDeletePtr(Picoc *pc, struct Table *Tbl, const char *Key)
+{
+    struct TableEntry Removed;
 
-    return NULL;
+    return TableRemove(Tbl, Key, &Removed) ? Removed.Ptr : NULL;
 }
 
-/* check a hash table entry for an identifier */
+/* check a hash table entry for an identifier. the stored hash rejects
+    nearly every mismatch before we look at the characters */
 struct TableEntry *TableSearchIdentifier(struct Table *Tbl,
-    const char *Key, int Len, int *AddAt)
+    const char *Key, int Len, unsigned int Hash, struct TableEntry **AddAt)
 {
-    int HashValue = TableHash(Key, Len) % Tbl->Size;
-    struct TableEntry *Entry;
+    unsigned int Mask = Tbl->Size - 1;
+    unsigned int Slot = TableSlot(Hash, Tbl->Size);
+
+    while (true) {
+        struct TableEntry *Entry = &Tbl->HashTable[Slot];
+
+        if (Entry->Key == NULL) {
+            *AddAt = Entry;    /* didn't find it */
+            return NULL;
+        }
 
-    for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next) {
-        if (strncmp(&Entry->p.Key[0], (char*)Key, Len) == 0 &&
-                Entry->p.Key[Len] == '\0')
+        if (Entry->Hash == Hash && memcmp(Entry->Key, Key, Len) == 0 &&
+                Entry->Key[Len] == '\0')
             return Entry;   /* found */
+
+        Slot = (Slot + 1) & Mask;
+    }
+}
+
+/* copy a string into the string arena. strings are kept on even
+    addresses since the bottom bit of a key marks it as out of scope */
+static char *TableStrArenaAdd(Picoc *pc, const char *Str, int Len)
+{
+    struct StringChunk *Chunk = pc->StringChunks;
+    size_t Size = (Len + 2) & ~1;
+    char *NewStr;
+
+    if (Chunk == NULL || Chunk->Used + Size > Chunk->Size) {
+        /* start a new chunk. big strings get one to themselves */
+        size_t ChunkSize = (Size > STRING_CHUNK_SIZE/4) ? Size : STRING_CHUNK_SIZE;
+
+        Chunk = HeapAllocCategory(pc, sizeof(struct StringChunk) + ChunkSize,
+            MemStrings);
+        if (Chunk == NULL)
+            ProgramFailNoParser(pc, "(TableStrArenaAdd) out of memory");
+
+        Chunk->Size = ChunkSize;
+        Chunk->Used = 0;
+        if (ChunkSize == STRING_CHUNK_SIZE || pc->StringChunks == NULL) {
+            Chunk->Next = pc->StringChunks;
+            pc->StringChunks = Chunk;
+        } else {
+            /* keep filling the current chunk after this one */
+            Chunk->Next = pc->StringChunks->Next;
+            pc->StringChunks->Next = Chunk;
+        }
     }
 
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return NULL;
+    NewStr = &Chunk->Data[Chunk->Used];
+    Chunk->Used += Size;
+    memcpy(NewStr, Str, Len);
+    NewStr[Len] = '\0';
+
+    return NewStr;
 }
 
 /* set an identifier and return the identifier. share if possible */
 char *TableSetIdentifier(Picoc *pc, struct Table *Tbl, const char *Ident,
     int IdentLen)
 {
-    int AddAt;
-    struct TableEntry *FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen,
-        &AddAt);
+    unsigned int Hash = TableHash(Ident, IdentLen);
+    struct TableEntry *AddAt;
+    struct TableEntry *FoundEntry;
 
+    TableMakeRoom(pc, Tbl);
+    FoundEntry = TableSearchIdentifier(Tbl, Ident, IdentLen, Hash, &AddAt);
     if (FoundEntry != NULL)
-        return &FoundEntry->p.Key[0];
-    else {
-        /* add it to the table - we economise by not allocating
-            the whole structure here */
-        struct TableEntry *NewEntry = HeapAllocMem(pc,
-            sizeof(struct TableEntry) -
-            sizeof(union TableEntryPayload) + IdentLen + 1);
-        if (NewEntry == NULL)
-            ProgramFailNoParser(pc, "(TableSetIdentifier) out of memory");
-
-        strncpy((char *)&NewEntry->p.Key[0], (char *)Ident, IdentLen);
-        NewEntry->p.Key[IdentLen] = '\0';
-        NewEntry->Next = Tbl->HashTable[AddAt];
-        Tbl->HashTable[AddAt] = NewEntry;
-        return &NewEntry->p.Key[0];
-    }
+        return FoundEntry->Key;
+
+    /* add it to the table */
+    AddAt->Key = TableStrArenaAdd(pc, Ident, IdentLen);
+    AddAt->Hash = Hash;
+    Tbl->Count++;
+    Tbl->Used++;
+    return AddAt->Key;
 }
 
 /* register a string in the shared string store */
 char *TableStrRegister2(Picoc *pc, const char *Str, int Len)
 {
-    return TableSetIdentifier(pc, &pc->StringTable, Str, Len);
+    char *Registered;
+
+    ThreadLock(pc);
+    Registered = TableSetIdentifier(pc, &pc->StringTable, Str, Len);
+    ThreadUnlock(pc);
+
+    return Registered;
 }
 
 char *TableStrRegister(Picoc *pc, const char *Str)
@@ -184,18 +459,99 @@ char *TableStrRegister(Picoc *pc, const char *Str)
     return TableStrRegister2(pc, Str, strlen((char *)Str));
 }
 
-/* free all the strings */
+/* free all the strings, and any table slots threads were keeping */
 void TableStrFree(Picoc *pc)
 {
-    int Count;
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
-
-    for (Count = 0; Count < pc->StringTable.Size; Count++) {
-        for (Entry = pc->StringTable.HashTable[Count];
-                Entry != NULL; Entry = NextEntry) {
-            NextEntry = Entry->Next;
-            HeapFreeMem(pc, Entry);
-        }
+    struct StringChunk *Chunk;
+    struct StringChunk *NextChunk;
+
+    for (Chunk = pc->StringChunks; Chunk != NULL; Chunk = NextChunk) {
+        NextChunk = Chunk->Next;
+        HeapFreeMem(pc, Chunk);
+    }
+
+#ifdef UNIX_HOST
+    while (pc->RetiredSlots != NULL) {
+        struct RetiredSlots *Retired = pc->RetiredSlots;
+
+        pc->RetiredSlots = Retired->Next;
+        HeapFreeMem(pc, Retired->HashTable);
+        HeapFreeMem(pc, Retired);
     }
+#endif
+
+    pc->StringChunks = NULL;
+    TableFree(pc, &pc->StringTable);
+}
+
+/* keep a copy of a table's slots so it can be put back later */
+void TableSave(Picoc *pc, struct Table *Tbl, struct SavedTable *Saved)
+{
+    Saved->Tbl = *Tbl;
+    Saved->HashTable = HeapAllocCategory(pc, sizeof(struct TableEntry) * Tbl->Size,
+        MemTables);
+    if (Saved->HashTable == NULL)
+        ProgramFailNoParser(pc, "(TableSave) out of memory");
+
+    memcpy((void*)Saved->HashTable, (void*)Tbl->HashTable,
+        sizeof(struct TableEntry) * Tbl->Size);
+}
+
+/* put a table back the way it was saved. the caller deals with any
+    values which were added since */
+void TableRestore(Picoc *pc, struct Table *Tbl, struct SavedTable *Saved)
+{
+    struct TableEntry *HashTable = Saved->Tbl.HashTable;
+
+    if (Tbl->OnHeap)
+        HeapFreeMem(pc, Tbl->HashTable);
+
+    if (Saved->Tbl.OnHeap) {
+        /* the slots it had then may have been freed when it grew */
+        HashTable = HeapAllocCategory(pc,
+            sizeof(struct TableEntry) * Saved->Tbl.Size, MemTables);
+        if (HashTable == NULL)
+            ProgramFailNoParser(pc, "(TableRestore) out of memory");
+    }
+
+    *Tbl = Saved->Tbl;
+    Tbl->HashTable = HashTable;
+    memcpy((void*)HashTable, (void*)Saved->HashTable,
+        sizeof(struct TableEntry) * Saved->Tbl.Size);
+}
+
+/* free a saved copy of a table */
+void TableSavedFree(Picoc *pc, struct SavedTable *Saved)
+{
+    HeapFreeMem(pc, Saved->HashTable);
+    Saved->HashTable = NULL;
+}
+
+/* remember which strings there are so any added later can be forgotten */
+void TableStrSnapshot(Picoc *pc, struct Snapshot *Snap)
+{
+    TableSave(pc, &pc->StringTable, &Snap->StringTable);
+    Snap->StringChunk = pc->StringChunks;
+    Snap->StringChunkNext = pc->StringChunks->Next;
+    Snap->StringChunkUsed = pc->StringChunks->Used;
+}
+
+/* forget the strings added since the snapshot. new chunks are always
+    linked in ahead of the one after the snapshot's newest chunk */
+void TableStrRestore(Picoc *pc, struct Snapshot *Snap)
+{
+    struct StringChunk *Chunk;
+    struct StringChunk *NextChunk;
+
+    for (Chunk = pc->StringChunks; Chunk != Snap->StringChunkNext;
+            Chunk = NextChunk) {
+        NextChunk = Chunk->Next;
+        if (Chunk != Snap->StringChunk)
+            HeapFreeMem(pc, Chunk);
+    }
+
+    pc->StringChunks = Snap->StringChunk;
+    pc->StringChunks->Next = Snap->StringChunkNext;
+    pc->StringChunks->Used = Snap->StringChunkUsed;
+    TableRestore(pc, &pc->StringTable, &Snap->StringTable);
 }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 char Buf[100];
 int Count;
@@ -9,4 +10,33 @@ for (Count = 1; Count <= 20; Count++)
     printf("%s", Buf);
 }
 
+/* a shorter string over a longer one */
+for (Count = 1000; Count >= 1; Count /= 10)
+{
+    sprintf(Buf, "%d", Count);
+    printf("%s\n", Buf);
+}
+
+/* snprintf() into too small a buffer keeps to it and says how long the
+    whole thing would have been. Small[4] is past the end */
+char Small[8];
+int Len;
+
+void Check(int Len)
+{
+    printf("%d [%s] %c\n", Len, Small, Small[4]);
+    strcpy(Small, "ZZZZZZZ");
+}
+
+strcpy(Small, "ZZZZZZZ");
+Check(snprintf(Small, 4, "%d", 123456));
+Check(snprintf(Small, 4, "%ld", 1234567890123L));
+Check(snprintf(Small, 4, "%f", 3.25));
+Check(snprintf(Small, 4, "ab%dcd%s", 12, "efgh"));
+Len = snprintf(Small, 4, "%p", Small);
+printf("%d %d %c\n", Len > 3, strlen(Small), Small[4]);
+strcpy(Small, "ZZZZZZZ");
+Check(snprintf(Small, 1, "%d %f", 99, 1.5));
+printf("%d\n", snprintf(NULL, 0, "%d %ld %f", 12345, 123L, 0.5));
+
 void main() {}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+int counter()
+{
+    static int Count = 0;
+
+    Count++;
+    return Count;
+}
+
+void loop()
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        static int Total = 10;
+
+        Total++;
+        printf("Total = %d\n", Total);
+    }
+}
+
+int depth(int n)
+{
+    static int Deepest = 0;
+
+    if (n > Deepest)
+        Deepest = n;
+
+    if (n < 4)
+        depth(n + 1);
+
+    return Deepest;
+}
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < 5; i++)
+        counter();
+
+    printf("%d\n", counter());
+    loop();
+    loop();
+    printf("%d\n", depth(0));
+    printf("%d\n", depth(2));
+
+    return 0;
+}
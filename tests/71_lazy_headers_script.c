@@ -0,0 +1,10 @@
+/* system headers are loaded as their names are first used */
+struct tm *later;
+time_t now = time(NULL);
+FILE *f = stdout;
+bool ok = true;
+
+fprintf(f, "%d %d %d\n", ok, now > 0, EOF);
+printf("%s\n", strerror(0) != NULL ? "yes" : "no");
+printf("%d\n", (int)sqrt(16.0));
+printf("%d\n", ENOENT == 2);
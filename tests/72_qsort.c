@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int compare_ints(int *a, int *b)
+{
+    return *a - *b;
+}
+
+int compare_desc(void *a, void *b)
+{
+    return *(int *)b - *(int *)a;
+}
+
+int main()
+{
+    int a[10] = { 42, 7, 19, -3, 88, 0, 7, 61, 25, 13 };
+    int Count;
+    int Key = 25;
+    int Missing = 26;
+    int *Found;
+
+    qsort(a, 10, sizeof(int), compare_ints);
+    for (Count = 0; Count < 10; Count++)
+        printf("%d ", a[Count]);
+    printf("\n");
+
+    Found = bsearch(&Key, a, 10, sizeof(int), compare_ints);
+    printf("found %d %d\n", *Found, Found == &a[6]);
+    printf("missing %d\n", bsearch(&Missing, a, 10, sizeof(int), compare_ints) == NULL);
+
+    qsort(a, 10, sizeof(int), compare_desc);
+    for (Count = 0; Count < 10; Count++)
+        printf("%d ", a[Count]);
+    printf("\n");
+
+    return 0;
+}
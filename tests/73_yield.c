@@ -0,0 +1,16 @@
+#include <stdio.h>
+#include <coroutine.h>
+
+int main()
+{
+    int Count;
+
+    /* there's no coroutine here so yield() just carries on */
+    for (Count = 0; Count < 3; Count++)
+    {
+        printf("%d\n", Count);
+        yield();
+    }
+
+    return 0;
+}
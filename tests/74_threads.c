@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+
+#define NUM_THREADS 4
+#define PER_THREAD 1000
+
+int Total = 0;
+int Atomic = 0;
+mutex_t Lock;
+cond_t Ready;
+int ReadyCount = 0;
+
+int Square(int X)
+{
+    int *P = &X;
+    return *P * *P;
+}
+
+int Worker(void *Arg)
+{
+    int Id = *(int *)Arg;
+    int Count;
+    int Sum = 0;
+    static int Calls = 0;
+
+    for (Count = 0; Count < PER_THREAD; Count++)
+    {
+        Sum += Square(Count % 10);
+        atomic_add(&Atomic, 1);
+    }
+
+    mutex_lock(Lock);
+    Total += Sum;
+    Calls++;
+    ReadyCount++;
+    cond_signal(Ready);
+    mutex_unlock(Lock);
+
+    return Id * 100;
+}
+
+int Quitter(void *Arg)
+{
+    exit(7);
+    return 0;
+}
+
+int main()
+{
+    thread_t Threads[NUM_THREADS];
+    int Ids[NUM_THREADS];
+    int Count;
+    int Result = 0;
+    int Value = 5;
+
+    Lock = mutex_create();
+    Ready = cond_create();
+
+    for (Count = 0; Count < NUM_THREADS; Count++)
+    {
+        Ids[Count] = Count;
+        Threads[Count] = thread_create(Worker, &Ids[Count]);
+    }
+
+    mutex_lock(Lock);
+    while (ReadyCount < NUM_THREADS)
+        cond_wait(Ready, Lock);
+    mutex_unlock(Lock);
+
+    for (Count = 0; Count < NUM_THREADS; Count++)
+        Result += thread_join(Threads[Count]);
+
+    printf("results %d\n", Result);
+    printf("total %d\n", Total);
+    printf("atomic %d\n", atomic_load(&Atomic));
+    printf("quitter %d\n", thread_join(thread_create(Quitter, NULL)));
+    printf("cas %d %d\n", atomic_cas(&Value, 5, 6), atomic_cas(&Value, 5, 7));
+    printf("exchange %d %d\n", atomic_exchange(&Value, 9), Value);
+    printf("trylock %d\n", mutex_trylock(Lock));
+    mutex_unlock(Lock);
+    printf("cpus %d\n", cpu_count() > 0);
+
+    cond_destroy(Ready);
+    mutex_destroy(Lock);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <thread.h>
+
+#define N 1000
+
+int in[N];
+int out[N];
+int hits;
+
+void scale(int i, void *ctx)
+{
+    int factor = *(int *)ctx;
+
+    out[i] = in[i] * factor;
+}
+
+void count(int i)
+{
+    atomic_add(&hits, 1);
+}
+
+int main()
+{
+    int i;
+    int factor = 3;
+    long sum = 0;
+
+    for (i = 0; i < N; i++)
+        in[i] = i;
+
+    parallel_for(0, N, scale, &factor);
+    for (i = 0; i < N; i++)
+        sum += out[i];
+    printf("sum %ld\n", sum);
+
+    parallel_for(10, 17, count, NULL);
+    printf("hits %d\n", hits);
+
+    parallel_for(5, 5, count, NULL);
+    parallel_for(5, 0, count, NULL);
+    printf("hits %d\n", hits);
+
+    return 0;
+}
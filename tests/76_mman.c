@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+int main()
+{
+    FILE *f;
+    char *text;
+    char *map;
+    unsigned long len;
+    unsigned long i;
+    int lines = 0;
+
+    f = fopen("mman_test.txt", "w");
+    fputs("first line\nsecond line\nthird\n", f);
+    fclose(f);
+
+    text = map_file("mman_test.txt", &len);
+    printf("len %lu\n", len);
+    for (i = 0; i < len; i++) {
+        if (text[i] == '\n')
+            lines++;
+    }
+    printf("lines %d\n", lines);
+    printf("starts %d\n", strncmp(text, "first", 5) == 0);
+    printf("unmap %d\n", munmap(text, len));
+
+    /* a mapping of our own which we can write to */
+    map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    printf("mapped %d\n", map != MAP_FAILED);
+    strcpy(map, "hello");
+    printf("%s\n", map);
+    printf("advise %d\n", madvise(map, 4096, MADV_RANDOM));
+    printf("unmap %d\n", munmap(map, 4096));
+
+    printf("missing %d\n", map_file("no_such_file.txt", &len) == NULL);
+    printf("len %lu\n", len);
+
+    remove("mman_test.txt");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <vmath.h>
+
+#define N 10
+
+double a[N];
+double b[N];
+double out[N];
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < N; i++) {
+        a[i] = i;
+        b[i] = N - i;
+    }
+
+    vec_add(out, a, b, N);
+    printf("add %f %f\n", out[0], out[9]);
+    vec_mul(out, a, b, N);
+    printf("mul %f %f\n", out[1], out[5]);
+    vec_sub(out, a, b, N);
+    vec_div(out, out, b, N);
+    printf("div %f\n", out[5]);
+
+    vec_sqrt(out, a, N);
+    printf("sqrt %f %f\n", out[4], out[9]);
+    vec_pow(out, a, 2.0, N);
+    printf("pow %f\n", out[7]);
+    vec_fabs(out, b, N);
+    vec_floor(out, out, N);
+    printf("floor %f\n", out[3]);
+
+    vec_scale(out, a, 0.5, N);
+    printf("scale %f\n", out[3]);
+    vec_fill(out, 1.0, N);
+    vec_axpy(out, 2.0, a, N);
+    printf("axpy %f %f\n", out[0], out[9]);
+
+    printf("dot %f\n", vec_dot(a, b, N));
+    printf("sum %f\n", vec_sum(a, N));
+    printf("sum3 %f\n", vec_sum(a, 3));
+    printf("min %f max %f\n", vec_min(b, N), vec_max(b, N));
+
+    vec_fill(out, 0.0, N);
+    vec_cos(out, out, N);
+    printf("cos %f\n", vec_sum(out, N));
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include <collections.h>
+
+char *words[] = { "the", "cat", "sat", "on", "the", "mat", "the", "end" };
+
+int main()
+{
+    map_t counts = map_create();
+    map_t squares = imap_create();
+    array_t longs = array_create(sizeof(long));
+    array_t doubles = array_create(sizeof(double));
+    char key[16];
+    long total;
+    double d;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        map_add(counts, words[i], 1);
+
+    printf("%d words, the=%ld cat=%ld dog=%ld\n", map_size(counts),
+        map_get(counts, "the", 0), map_get(counts, "cat", 0),
+        map_get(counts, "dog", -1));
+
+    total = 0;
+    for (i = map_next(counts, 0); i >= 0; i = map_next(counts, i+1))
+        total += map_value(counts, i);
+    printf("total %ld\n", total);
+
+    printf("remove mat %d, again %d, has mat %d, size %d\n",
+        map_remove(counts, "mat"), map_remove(counts, "mat"),
+        map_has(counts, "mat"), map_size(counts));
+
+    map_put_ptr(counts, "ptr", words[1]);
+    printf("ptr %s\n", (char *)map_get_ptr(counts, "ptr"));
+
+    /* enough keys to make the map grow a few times */
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "k%d", i);
+        map_put(counts, key, i);
+    }
+
+    for (i = 0; i < 1000; i += 2) {
+        sprintf(key, "k%d", i);
+        map_remove(counts, key);
+    }
+
+    total = 0;
+    for (i = 0; i < 1000; i++) {
+        sprintf(key, "k%d", i);
+        total += map_get(counts, key, 0);
+    }
+    printf("size %d, total %ld\n", map_size(counts), total);
+
+    for (i = -50; i < 50; i++)
+        imap_put(squares, i * 1000, i * i);
+
+    printf("%d squares, %ld %ld %d %d\n", map_size(squares),
+        imap_get(squares, -7000, 0), imap_get(squares, 49000, 0),
+        imap_has(squares, 3), imap_remove(squares, 0));
+
+    for (i = 0; i < 100; i++)
+        array_push_long(longs, i * 3);
+
+    array_set_long(longs, 0, 1000);
+    printf("%d longs, %ld %ld %ld\n", array_len(longs),
+        array_get_long(longs, 0), array_get_long(longs, 99),
+        *(long *)array_at(longs, 10));
+
+    for (i = 0; i < 5; i++) {
+        d = i / 2.0;
+        array_push(doubles, &d);
+    }
+
+    array_push_double(doubles, 9.5);
+    array_pop(doubles, &d);
+    printf("%d doubles, popped %f, last %f\n", array_len(doubles), d,
+        array_get_double(doubles, 4));
+
+    array_resize(doubles, 8);
+    printf("resized %d, %f\n", array_len(doubles),
+        ((double *)array_data(doubles))[7]);
+
+    array_clear(doubles);
+    printf("cleared %d, pop %d\n", array_len(doubles), array_pop(doubles, NULL));
+
+    map_destroy(counts);
+    map_destroy(squares);
+    array_destroy(longs);
+    array_destroy(doubles);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return fib(n-1) + fib(n-2);
+}
+
+int sum(int n)
+{
+    int i;
+    int total = 0;
+
+    for (i = 0; i < n; i++)
+        total += i;
+
+    return total;
+}
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        printf("%d %d\n", fib(10), sum(100));
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+int depth(int n)
+{
+    char buf[100];
+
+    buf[0] = n;
+    if (n == 0)
+        return 1;
+
+    return depth(n-1) + buf[0] - n + 1;
+}
+
+int main()
+{
+    printf("%d\n", depth(20));
+    printf("%d\n", depth(5));
+    return 0;
+}
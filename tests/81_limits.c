@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void grow(int n)
+{
+    char *blocks[100];
+    int i;
+
+    for (i = 0; i < n; i++)
+        blocks[i] = malloc(10000);
+
+    for (i = 0; i < n; i++)
+        free(blocks[i]);
+}
+
+int main()
+{
+    int i;
+    int total = 0;
+    char *s = strdup("hello");
+
+    s = realloc(s, 100);
+    strcat(s, " world");
+    printf("%s\n", s);
+    free(s);
+
+    grow(100);
+    printf("grown\n");
+
+    for (i = 0; i < 100000; i++)
+        total += i % 7;
+
+    printf("%d\n", total);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <collections.h>
+
+/* run with --max-mem 1000000 and one of these as the argument, each stops
+   the program as soon as it asks for the memory. with no argument it does
+   them all */
+int main(int argc, char **argv)
+{
+    char *what = "all";
+    int all;
+    char *p;
+    array_t a;
+    unsigned long len;
+    FILE *f;
+
+    if (argc > 1)
+        what = argv[1];
+
+    all = strcmp(what, "all") == 0;
+    if (all || strcmp(what, "malloc") == 0) {
+        p = malloc(2000000);
+        printf("malloc %d\n", p != NULL);
+        free(p);
+    }
+
+    if (all || strcmp(what, "array") == 0) {
+        a = array_create(sizeof(int));
+        array_resize(a, 1000000);
+        printf("array %d\n", array_len(a));
+        array_destroy(a);
+    }
+
+    if (all || strcmp(what, "mmap") == 0) {
+        p = mmap(NULL, 2000000, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        printf("mmap %d\n", p != MAP_FAILED);
+        munmap(p, 2000000);
+    }
+
+    if (all || strcmp(what, "map_file") == 0) {
+        f = fopen("82_mem_limit.tmp", "w");
+        fseek(f, 2000000, SEEK_SET);
+        fputc('x', f);
+        fclose(f);
+        p = map_file("82_mem_limit.tmp", &len);
+        printf("map_file %lu\n", len);
+        munmap(p, len);
+        remove("82_mem_limit.tmp");
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+char compare_chars(void *l, void *r)
+{
+    char a = *(char *)l;
+    char b = *(char *)r;
+
+    if (a < b)
+        return -1;
+    return a > b;
+}
+
+double compare_doubles(void *l, void *r)
+{
+    return *(double *)l - *(double *)r;
+}
+
+long compare_longs(void *l, void *r)
+{
+    /* too big for an int */
+    return (*(long *)l - *(long *)r) * 100000000L;
+}
+
+int main()
+{
+    char s[] = "picoc qsort";
+    double d[6] = { 0.5, 0.25, 0.75, 0.1, 0.3, 0.2 };
+    long n[5] = { 30, -10, 50, 20, 40 };
+    double Key = 0.3;
+    double *Found;
+    int i;
+
+    qsort(s, 11, 1, compare_chars);
+    printf("[%s]\n", s);
+
+    qsort(d, 6, sizeof(double), compare_doubles);
+    for (i = 0; i < 6; i++)
+        printf("%.2f ", d[i]);
+    printf("\n");
+
+    Found = bsearch(&Key, d, 6, sizeof(double), compare_doubles);
+    printf("found %.2f %d\n", *Found, Found == &d[3]);
+
+    qsort(n, 5, sizeof(long), compare_longs);
+    for (i = 0; i < 5; i++)
+        printf("%d ", n[i]);
+    printf("\n");
+
+    return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+/* no header which declares index() has been included */
+int index = 3;
+printf("index %d\n", index);
+
+#include <string.h>
+
+/* strchr() hasn't been used yet, but it's declared all the same */
+int strchr;
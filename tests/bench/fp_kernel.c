@@ -0,0 +1,47 @@
+/* floating point kernels: a matrix multiply and a numerical integration */
+#include <stdio.h>
+#include <math.h>
+
+#define N 32
+
+double A[N][N];
+double B[N][N];
+double C[N][N];
+
+int main()
+{
+    int i;
+    int j;
+    int k;
+    double Sum;
+    double Trace = 0.0;
+    double X;
+    double Area = 0.0;
+    double Step = 1.0 / 20000;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            A[i][j] = (i + j) / 10.0;
+            B[i][j] = (2 * i - j) / 7.0;
+        }
+    }
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            Sum = 0.0;
+            for (k = 0; k < N; k++)
+                Sum += A[i][k] * B[k][j];
+            C[i][j] = Sum;
+        }
+        Trace += C[i][i];
+    }
+
+    /* integrate 4 / (1 + x^2) from 0 to 1, which is pi */
+    for (i = 0; i < 20000; i++) {
+        X = (i + 0.5) * Step;
+        Area += 4.0 / (1.0 + X * X) * Step;
+    }
+
+    printf("%.4f %.8f %.6f\n", Trace, Area, sqrt(fabs(Trace)));
+    return 0;
+}
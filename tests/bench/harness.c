@@ -0,0 +1,257 @@
+/* benchmark harness - runs each benchmark program under picoc a number of
+ * times and reports the fastest and median wall times and the peak memory
+ * use. the results can be written as JSON and compared with an earlier run,
+ * eg. one from another build.
+ *
+ * usage: harness [-n runs] [-o results.json] [-c baseline.json] picoc file.c...
+ *
+ * this is compiled with the host's C compiler, not run under picoc */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_RUNS 100
+#define NAME_MAX_LEN 64
+
+struct Result {
+    char Name[NAME_MAX_LEN];
+    double Min;
+    double Median;
+    long MaxRSS;                /* in kilobytes */
+    int Status;                 /* the exit status, or -1 if it was killed */
+    double BaselineMedian;      /* 0 if there's nothing to compare with */
+};
+
+/* the benchmark's name is its file name without the directory or ".c" */
+static void BenchName(char *Name, const char *FileName)
+{
+    const char *Base = strrchr(FileName, '/');
+    char *Dot;
+
+    snprintf(Name, NAME_MAX_LEN, "%s", Base != NULL ? Base + 1 : FileName);
+    Dot = strrchr(Name, '.');
+    if (Dot != NULL)
+        *Dot = '\0';
+}
+
+static double Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+/* run the benchmark once with its output thrown away. returns the wall
+    time and fills in its exit status and peak memory use */
+static double RunOnce(const char *Picoc, const char *FileName, int *Status,
+    long *MaxRSS)
+{
+    struct rusage Usage;
+    double Start = Now();
+    int WaitStatus;
+    pid_t Pid;
+    int Null;
+
+    Pid = fork();
+    if (Pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (Pid == 0) {
+        Null = open("/dev/null", O_WRONLY);
+        dup2(Null, 1);
+        dup2(Null, 2);
+        execl(Picoc, Picoc, FileName, (char *)NULL);
+        _exit(127);
+    }
+
+    if (wait4(Pid, &WaitStatus, 0, &Usage) < 0) {
+        perror("wait4");
+        exit(1);
+    }
+
+    *Status = WIFEXITED(WaitStatus) ? WEXITSTATUS(WaitStatus) : -1;
+#ifdef __APPLE__
+    *MaxRSS = Usage.ru_maxrss / 1024;
+#else
+    *MaxRSS = Usage.ru_maxrss;
+#endif
+
+    return Now() - Start;
+}
+
+static int CompareTimes(const void *A, const void *B)
+{
+    double TimeA = *(const double *)A;
+    double TimeB = *(const double *)B;
+
+    return TimeA < TimeB ? -1 : TimeA > TimeB;
+}
+
+/* run a benchmark Runs times */
+static void RunBenchmark(struct Result *Result, const char *Picoc,
+    const char *FileName, int Runs)
+{
+    double Times[MAX_RUNS];
+    long MaxRSS;
+    int Count;
+
+    BenchName(Result->Name, FileName);
+    Result->MaxRSS = 0;
+    Result->Status = 0;
+    for (Count = 0; Count < Runs; Count++) {
+        Times[Count] = RunOnce(Picoc, FileName, &Result->Status, &MaxRSS);
+        if (MaxRSS > Result->MaxRSS)
+            Result->MaxRSS = MaxRSS;
+
+        if (Result->Status != 0)
+            break;
+    }
+
+    if (Count < Runs)
+        Runs = Count + 1;
+
+    qsort(Times, Runs, sizeof(double), CompareTimes);
+    Result->Min = Times[0];
+    Result->Median = Runs % 2 ? Times[Runs/2] :
+        (Times[Runs/2 - 1] + Times[Runs/2]) / 2;
+}
+
+/* find each benchmark's median in a results file from an earlier run. it
+    only has to read what WriteResults() writes: one benchmark per line */
+static void ReadBaseline(const char *FileName, struct Result *Results,
+    int NumResults)
+{
+    char Line[512];
+    char Name[NAME_MAX_LEN];
+    double Min;
+    double Median;
+    char *Start;
+    int Count;
+    FILE *In = fopen(FileName, "r");
+
+    if (In == NULL) {
+        perror(FileName);
+        exit(1);
+    }
+
+    while (fgets(Line, sizeof(Line), In) != NULL) {
+        Start = strstr(Line, "{\"name\": \"");
+        if (Start == NULL || sscanf(Start,
+                "{\"name\": \"%63[^\"]\", \"min\": %lf, \"median\": %lf",
+                Name, &Min, &Median) != 3)
+            continue;
+
+        for (Count = 0; Count < NumResults; Count++) {
+            if (strcmp(Results[Count].Name, Name) == 0)
+                Results[Count].BaselineMedian = Median;
+        }
+    }
+
+    fclose(In);
+}
+
+static void WriteResults(const char *FileName, const char *Picoc,
+    struct Result *Results, int NumResults, int Runs)
+{
+    int Count;
+    FILE *Out = fopen(FileName, "w");
+
+    if (Out == NULL) {
+        perror(FileName);
+        exit(1);
+    }
+
+    fprintf(Out, "{\n  \"picoc\": \"%s\",\n  \"runs\": %d,\n  \"benchmarks\": [\n",
+        Picoc, Runs);
+    for (Count = 0; Count < NumResults; Count++)
+        fprintf(Out, "    {\"name\": \"%s\", \"min\": %.6f, \"median\": %.6f, "
+            "\"max_rss_kb\": %ld, \"status\": %d}%s\n", Results[Count].Name,
+            Results[Count].Min, Results[Count].Median, Results[Count].MaxRSS,
+            Results[Count].Status, Count < NumResults - 1 ? "," : "");
+
+    fprintf(Out, "  ]\n}\n");
+    fclose(Out);
+}
+
+static void PrintResult(struct Result *Result, int Compare)
+{
+    printf("%-16s %10.4f %10.4f %10ld", Result->Name, Result->Min,
+        Result->Median, Result->MaxRSS);
+    if (Compare && Result->BaselineMedian > 0)
+        printf(" %9.2fx", Result->BaselineMedian / Result->Median);
+    else if (Compare)
+        printf(" %10s", "-");
+
+    if (Result->Status != 0)
+        printf("  FAILED (%d)", Result->Status);
+
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *OutName = NULL;
+    const char *BaselineName = NULL;
+    struct Result *Results;
+    int Runs = 5;
+    int NumResults;
+    int Failed = 0;
+    int Count;
+    int Opt;
+
+    while ((Opt = getopt(argc, argv, "n:o:c:")) != -1) {
+        switch (Opt) {
+        case 'n': Runs = atoi(optarg); break;
+        case 'o': OutName = optarg; break;
+        case 'c': BaselineName = optarg; break;
+        default: argc = 0; break;
+        }
+    }
+
+    if (argc - optind < 2 || Runs < 1 || Runs > MAX_RUNS) {
+        fprintf(stderr, "usage: %s [-n runs] [-o results.json] "
+            "[-c baseline.json] picoc file.c...\n", argv[0]);
+        return 2;
+    }
+
+    NumResults = argc - optind - 1;
+    Results = calloc(NumResults, sizeof(struct Result));
+    if (Results == NULL)
+        return 1;
+
+    /* with a baseline the table waits until they have all run, so the
+        baseline can be the same file the results are written to */
+    printf("%-16s %10s %10s %10s%s\n", "benchmark", "min s", "median s",
+        "max rss KB", BaselineName != NULL ? "    speedup" : "");
+    for (Count = 0; Count < NumResults; Count++) {
+        RunBenchmark(&Results[Count], argv[optind], argv[optind + 1 + Count], Runs);
+        if (BaselineName == NULL)
+            PrintResult(&Results[Count], false);
+        Failed |= Results[Count].Status != 0;
+    }
+
+    if (BaselineName != NULL) {
+        ReadBaseline(BaselineName, Results, NumResults);
+        for (Count = 0; Count < NumResults; Count++)
+            PrintResult(&Results[Count], true);
+    }
+
+    if (OutName != NULL)
+        WriteResults(OutName, argv[optind], Results, NumResults, Runs);
+
+    free(Results);
+    return Failed;
+}
@@ -0,0 +1,32 @@
+/* tight integer loops: arithmetic, shifts and array indexing */
+#include <stdio.h>
+
+#define N 1000
+
+int Primes[N];
+
+int main()
+{
+    int i;
+    int j;
+    int Count = 0;
+    unsigned int Hash = 2166136261u;
+
+    /* trial division */
+    for (i = 2; Count < N; i++) {
+        for (j = 0; j < Count && Primes[j] * Primes[j] <= i; j++) {
+            if (i % Primes[j] == 0)
+                break;
+        }
+
+        if (j == Count || Primes[j] * Primes[j] > i)
+            Primes[Count++] = i;
+    }
+
+    /* mix the bits of every number up to the last prime */
+    for (i = 0; i < Primes[N-1] * 4; i++)
+        Hash = (Hash ^ (i & 0xff)) * 16777619u + (Hash >> 13);
+
+    printf("%d %u\n", Primes[N-1], Hash);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* structs and pointers: a linked list and a binary search tree */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 3000
+
+struct Node {
+    int Key;
+    struct Node *Next;
+};
+
+struct Tree {
+    int Key;
+    struct Tree *Left;
+    struct Tree *Right;
+};
+
+struct Node Nodes[N];
+
+struct Tree *insert(struct Tree *Root, int Key)
+{
+    struct Tree **Link = &Root;
+
+    while (*Link != NULL)
+        Link = Key < (*Link)->Key ? &(*Link)->Left : &(*Link)->Right;
+
+    *Link = malloc(sizeof(struct Tree));
+    (*Link)->Key = Key;
+    (*Link)->Left = NULL;
+    (*Link)->Right = NULL;
+
+    return Root;
+}
+
+int height(struct Tree *Root)
+{
+    int Left;
+    int Right;
+
+    if (Root == NULL)
+        return 0;
+
+    Left = height(Root->Left);
+    Right = height(Root->Right);
+    return (Left > Right ? Left : Right) + 1;
+}
+
+int main()
+{
+    struct Tree *Root = NULL;
+    struct Node *Pos;
+    long Sum = 0;
+    int i;
+    int Pass;
+
+    /* a list which visits the array in a scattered order */
+    for (i = 0; i < N; i++) {
+        Nodes[i].Key = i;
+        Nodes[i].Next = &Nodes[(i * 7 + 13) % N];
+    }
+
+    Pos = &Nodes[0];
+    for (Pass = 0; Pass < N * 3; Pass++) {
+        Sum += Pos->Key;
+        Pos = Pos->Next;
+    }
+
+    for (i = 0; i < N / 2; i++)
+        Root = insert(Root, (i * 7919) % N);
+
+    printf("%ld %d\n", Sum, height(Root));
+    return 0;
+}
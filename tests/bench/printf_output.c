@@ -0,0 +1,13 @@
+/* lots of formatted output */
+#include <stdio.h>
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < 40000; i++)
+        printf("%5d %-8s %08x %.3f\n", i, i % 3 ? "odd" : "even", i * 2654435761u,
+            i / 7.0);
+
+    return 0;
+}
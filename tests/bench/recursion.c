@@ -0,0 +1,35 @@
+/* deep and wide recursion: function call overhead */
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return fib(n-1) + fib(n-2);
+}
+
+int ackermann(int m, int n)
+{
+    if (m == 0)
+        return n + 1;
+
+    if (n == 0)
+        return ackermann(m - 1, 1);
+
+    return ackermann(m - 1, ackermann(m, n - 1));
+}
+
+int depth(int n)
+{
+    if (n == 0)
+        return 0;
+
+    return depth(n - 1) + 1;
+}
+
+int main()
+{
+    printf("%d %d %d\n", fib(21), ackermann(2, 60), depth(500));
+    return 0;
+}
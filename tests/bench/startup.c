@@ -0,0 +1,10 @@
+/* starting up and shutting down, with the usual headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int main()
+{
+    return 0;
+}
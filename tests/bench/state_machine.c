@@ -0,0 +1,58 @@
+/* a switch statement state machine: tokenising a small language */
+#include <stdio.h>
+
+enum State { Start, InNumber, InWord, InComment };
+
+char *Source = "let x1 = 42 + y * (17 - z2); # comment\nif (x1 > 9) { print x1; } else { y = y + 1; }\n";
+
+int main()
+{
+    int Numbers = 0;
+    int Words = 0;
+    int Symbols = 0;
+    int Pass;
+    char *Pos;
+    enum State State;
+
+    for (Pass = 0; Pass < 150; Pass++) {
+        State = Start;
+        for (Pos = Source; *Pos != '\0'; Pos++) {
+            switch (State) {
+            case Start:
+                if (*Pos >= '0' && *Pos <= '9')
+                    State = InNumber;
+                else if ((*Pos >= 'a' && *Pos <= 'z') || *Pos == '_')
+                    State = InWord;
+                else if (*Pos == '#')
+                    State = InComment;
+                else if (*Pos != ' ' && *Pos != '\n')
+                    Symbols++;
+                break;
+
+            case InNumber:
+                if (*Pos < '0' || *Pos > '9') {
+                    Numbers++;
+                    State = Start;
+                    Pos--;
+                }
+                break;
+
+            case InWord:
+                if (!((*Pos >= 'a' && *Pos <= 'z') || (*Pos >= '0' && *Pos <= '9'))) {
+                    Words++;
+                    State = Start;
+                    Pos--;
+                }
+                break;
+
+            case InComment:
+                if (*Pos == '\n')
+                    State = Start;
+                break;
+            }
+        }
+    }
+
+    printf("%d %d %d\n", Numbers, Words, Symbols);
+    return 0;
+}
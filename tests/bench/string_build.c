@@ -0,0 +1,36 @@
+/* building, searching and scanning strings */
+#include <stdio.h>
+#include <string.h>
+
+char Buf[40000];
+char Line[1000];
+
+int main()
+{
+    char Word[32];
+    char *End = Buf;
+    char *Pos;
+    int Count = 0;
+    int i;
+
+    for (i = 0; i < 4000; i++) {
+        sprintf(Word, "w%d,", i * 37 % 1000);
+        strcpy(End, Word);
+        End += strlen(Word);
+    }
+
+    /* the slow way, finding the end every time */
+    for (i = 0; i < 600; i++)
+        strcat(Line, i % 2 ? "ab" : "c");
+
+    for (Pos = Buf; (Pos = strstr(Pos, "w1")) != NULL; Pos++)
+        Count++;
+
+    for (i = 0; Buf[i] != '\0'; i++) {
+        if (Buf[i] >= '0' && Buf[i] <= '9')
+            Buf[i] = '0' + (Buf[i] - '0' + 1) % 10;
+    }
+
+    printf("%d %d %d %c\n", (int)strlen(Buf), (int)strlen(Line), Count, Buf[100]);
+    return 0;
+}
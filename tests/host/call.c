@@ -0,0 +1,152 @@
+/* a host looks up functions in the program and calls them, passing
+ * arguments and using what they return. calls which exit or fail go back
+ * to the host's exit point, and later calls work as before */
+#include <stdio.h>
+#include <string.h>
+#include "picoc.h"
+
+static const char *Source =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "int calls;\n"
+    "\n"
+    "int add(int a, int b)\n"
+    "{\n"
+    "    calls++;\n"
+    "    return a + b;\n"
+    "}\n"
+    "\n"
+    "double scale(double x, char *factor)\n"
+    "{\n"
+    "    calls++;\n"
+    "    return x * atoi(factor);\n"
+    "}\n"
+    "\n"
+    "int depth(int n)\n"
+    "{\n"
+    "    if (n == 0)\n"
+    "        return 0;\n"
+    "\n"
+    "    return depth(n - 1) + 1;\n"
+    "}\n"
+    "\n"
+    "int quit(int n)\n"
+    "{\n"
+    "    if (n == 0)\n"
+    "        exit(3);\n"
+    "\n"
+    "    return quit(n - 1);\n"
+    "}\n"
+    "\n"
+    "int fail(int n)\n"
+    "{\n"
+    "    int *p = NULL;\n"
+    "\n"
+    "    if (n == 0)\n"
+    "        return *p;\n"
+    "\n"
+    "    return fail(n - 1);\n"
+    "}\n"
+    "\n"
+    "int runaway(int n)\n"
+    "{\n"
+    "    return runaway(n + 1) + 1;\n"
+    "}\n"
+    "\n"
+    "int total = 0;\n";
+
+static Picoc pc;
+
+/* call Name(Arg) and say how it went */
+static void Call(const char *Name, int Arg)
+{
+    union AnyValue Args[1];
+    union AnyValue Result;
+    struct Value *FuncValue = PicocGetFunction(&pc, Name);
+    FILE *Errors = tmpfile();
+    char Message[256] = "";
+
+    Args[0].Integer = Arg;
+    pc.CStdOut = Errors;
+    pc.PicocExitValue = 0;
+    if (PicocPlatformSetExitPoint(&pc)) {
+        rewind(Errors);
+        while (fgets(Message, sizeof(Message), Errors) != NULL &&
+                strstr(Message, "call.c:") == NULL) {
+        }
+
+        printf("%s(%d) stopped with %d\n", Name, Arg, pc.PicocExitValue);
+        if (strstr(Message, "stack overflow") != NULL)
+            printf("    stack overflow\n");    /* the depth varies */
+        else if (Message[0] != '\0')
+            printf("    %s", Message);
+    } else {
+        PicocCallFunction(&pc, FuncValue, Args, 1, &Result);
+        printf("%s(%d) = %d\n", Name, Arg, Result.Integer);
+    }
+
+    pc.CStdOut = stdout;
+    fclose(Errors);
+}
+
+int main()
+{
+    union AnyValue Args[2];
+    union AnyValue Result;
+    struct Value *Add;
+    const char *Calls = "printf(\"calls %d\\n\", calls);";
+
+    PicocInitialize(&pc, 1024*1024);
+    if (PicocPlatformSetExitPoint(&pc)) {
+        printf("failed\n");
+        return 1;
+    }
+
+    PicocParse(&pc, "call.c", Source, strlen(Source), true, false, false,
+        false);
+
+    /* look a function up once and call it as often as we like */
+    Add = PicocGetFunction(&pc, "add");
+    Args[0].Integer = 2;
+    Args[1].Integer = 3;
+    PicocCallFunction(&pc, Add, Args, 2, &Result);
+    Args[0].Integer = Result.Integer;
+    Args[1].Integer = 10;
+    PicocCallFunction(&pc, Add, Args, 2, &Result);
+    printf("add(add(2, 3), 10) = %d\n", Result.Integer);
+
+    Args[0].FP = 1.25;
+    Args[1].Pointer = "4";
+    PicocCallFunction(&pc, PicocGetFunction(&pc, "scale"), Args, 2, &Result);
+    printf("scale(1.25, \"4\") = %.2f\n", Result.FP);
+
+    printf("missing: %s\n",
+        PicocGetFunction(&pc, "missing") == NULL ? "NULL" : "found");
+    printf("total: %s\n",
+        PicocGetFunction(&pc, "total") == NULL ? "NULL" : "found");
+
+    /* calls which exit or fail deep down, even by filling the stack, leave
+        nothing behind */
+    Call("quit", 50);
+    Call("depth", 500);
+    Call("fail", 50);
+    Call("depth", 500);
+    Call("runaway", 0);
+    Call("depth", 500);
+    Call("quit", 0);
+    Call("add", 1);
+
+    /* the exit point set in Call() has gone, so set a new one */
+    if (PicocPlatformSetExitPoint(&pc)) {
+        printf("failed\n");
+        return 1;
+    }
+
+    PicocParse(&pc, "calls.c", Calls, strlen(Calls), true, false, false,
+        false);
+
+    PicocCleanup(&pc);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/* a host runs functions in the program as coroutines, resuming them each
+ * time they yield. one fails part way through, one exits and one is
+ * stopped before it's finished, and the program can be started again
+ * after each */
+#include <stdio.h>
+#include <string.h>
+#include "picoc.h"
+
+static const char *Source =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <coroutine.h>\n"
+    "\n"
+    "int total;\n"
+    "\n"
+    "int counter(int n)\n"
+    "{\n"
+    "    int i;\n"
+    "\n"
+    "    for (i = 0; i < n; i++) {\n"
+    "        total += i;\n"
+    "        printf(\"step %d\\n\", i);\n"
+    "        yield();\n"
+    "    }\n"
+    "\n"
+    "    return total;\n"
+    "}\n"
+    "\n"
+    "int broken(int n)\n"
+    "{\n"
+    "    int *p = NULL;\n"
+    "\n"
+    "    yield();\n"
+    "    return *p + n;\n"
+    "}\n"
+    "\n"
+    "int quitter(int n)\n"
+    "{\n"
+    "    yield();\n"
+    "    exit(n);\n"
+    "}\n";
+
+static Picoc pc;
+static union AnyValue Result;
+
+static const char *StatusName(int Status)
+{
+    return Status == PICOC_YIELDED ? "yielded" : "finished";
+}
+
+/* start Name(Arg) as a coroutine */
+static int Start(const char *Name, int Arg)
+{
+    union AnyValue Args[1];
+    int Status;
+
+    Args[0].Integer = Arg;
+    Result.Integer = -1;
+    Status = PicocStartCoroutine(&pc, PicocGetFunction(&pc, Name), Args, 1,
+        &Result, 0);
+    printf("start %s(%d): %s\n", Name, Arg, StatusName(Status));
+    return Status;
+}
+
+static int Resume(void)
+{
+    int Status = PicocResumeCoroutine(&pc);
+
+    printf("resume: %s\n", StatusName(Status));
+    return Status;
+}
+
+int main()
+{
+    FILE *Errors = tmpfile();
+    char Message[256] = "";
+
+    PicocInitialize(&pc, 1024*1024);
+    if (PicocPlatformSetExitPoint(&pc)) {
+        printf("parse failed\n");
+        return 1;
+    }
+
+    PicocParse(&pc, "coroutine.c", Source, strlen(Source), true, false,
+        false, false);
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    /* yield and resume until it returns */
+    if (Start("counter", 3) == PICOC_YIELDED) {
+        while (Resume() == PICOC_YIELDED) {
+        }
+    }
+    printf("result %d, exit value %d\n", Result.Integer, pc.PicocExitValue);
+    printf("resume after finishing: %s\n", StatusName(PicocResumeCoroutine(&pc)));
+
+    /* an error part way through ends the coroutine, not the host */
+    pc.CStdOut = Errors;
+    Start("broken", 1);
+    Resume();
+    pc.CStdOut = stdout;
+    rewind(Errors);
+    while (fgets(Message, sizeof(Message), Errors) != NULL &&
+            strstr(Message, "coroutine.c:") == NULL) {
+    }
+    printf("error: %s", Message);
+    printf("exit value %d\n", pc.PicocExitValue);
+    fclose(Errors);
+
+    /* stopping it part way through leaves its globals as they were */
+    Start("counter", 5);
+    Resume();
+    PicocStopCoroutine(&pc);
+    printf("stopped\n");
+
+    /* and it can be started again afterwards */
+    Start("counter", 2);
+    Resume();
+    Resume();
+    printf("result %d\n", Result.Integer);
+
+    Start("quitter", 7);
+    Resume();
+    printf("exit value %d\n", pc.PicocExitValue);
+
+    PicocCleanup(&pc);
+    return 0;
+}
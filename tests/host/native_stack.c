@@ -0,0 +1,97 @@
+/* picoc is initialized on one thread and called on others, one of them with
+ * a small stack. the native stack is measured from where each call comes
+ * in, so deep recursion works on every thread and runaway recursion is
+ * stopped cleanly before it runs off the end of the thread's stack */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "picoc.h"
+
+static const char *Source =
+    "int depth(int n)\n"
+    "{\n"
+    "    if (n == 0)\n"
+    "        return 0;\n"
+    "\n"
+    "    return depth(n - 1) + 1;\n"
+    "}\n"
+    "\n"
+    "int runaway(int n)\n"
+    "{\n"
+    "    return runaway(n + 1) + 1;\n"
+    "}\n";
+
+static Picoc pc;
+
+/* call Name(Arg) in the program and say how it went. the error message
+    has the frame count in it, which depends on the compiler, so only say
+    what sort of error it was */
+static void Call(const char *Name, int Arg)
+{
+    union AnyValue Args[1];
+    union AnyValue Result;
+    struct Value *FuncValue = PicocGetFunction(&pc, Name);
+    char Message[256] = "";
+    FILE *Errors = tmpfile();
+
+    Args[0].Integer = Arg;
+    pc.CStdOut = Errors;
+    if (PicocPlatformSetExitPoint(&pc)) {
+        rewind(Errors);
+        while (fgets(Message, sizeof(Message), Errors) != NULL &&
+                strstr(Message, "stack overflow") == NULL) {
+        }
+
+        printf("%s(%d) failed: %s\n", Name, Arg,
+            strstr(Message, "stack overflow") ? "stack overflow" : Message);
+    } else {
+        PicocCallFunction(&pc, FuncValue, Args, 1, &Result);
+        printf("%s(%d) = %d\n", Name, Arg, Result.Integer);
+    }
+
+    pc.CStdOut = stdout;
+    fclose(Errors);
+}
+
+static void *CallFromThread(void *Arg)
+{
+    Call("depth", *(int *)Arg);
+    Call("runaway", 0);
+    return NULL;
+}
+
+/* run the calls on a new thread with a StackSize stack, or the default
+    one if it's 0 */
+static void RunThread(size_t StackSize, int Depth)
+{
+    pthread_t Thread;
+    pthread_attr_t Attr;
+
+    pthread_attr_init(&Attr);
+    if (StackSize != 0)
+        pthread_attr_setstacksize(&Attr, StackSize);
+
+    pthread_create(&Thread, &Attr, CallFromThread, &Depth);
+    pthread_join(Thread, NULL);
+    pthread_attr_destroy(&Attr);
+}
+
+int main()
+{
+    /* plenty of interpreter stack, so it's the native stack which runs out */
+    PicocInitialize(&pc, 64*1024*1024);
+    if (PicocPlatformSetExitPoint(&pc)) {
+        printf("parse failed\n");
+        return 1;
+    }
+
+    PicocParse(&pc, "native_stack.c", Source, strlen(Source), true, false,
+        false, false);
+
+    Call("depth", 1000);
+    RunThread(0, 1000);
+    RunThread(1024*1024, 200);
+
+    PicocCleanup(&pc);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/* a server and its client in one process. arguments can be empty or have
+ * spaces and newlines in them. the replies carry program output, return
+ * values with newlines in and longer than a frame header, and exit values.
+ * requests which are too large are refused. a server won't start on a
+ * path which isn't a socket */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "picoc.h"
+
+static const char *Source =
+    "#include <stdio.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "char Text[6000];\n"
+    "\n"
+    "int main(int argc, char **argv)\n"
+    "{\n"
+    "    int i;\n"
+    "\n"
+    "    printf(\"main got %d arguments:\", argc);\n"
+    "    for (i = 1; i < argc; i++)\n"
+    "        printf(\" [%s]\", argv[i]);\n"
+    "    printf(\"\\n\");\n"
+    "    return 3;\n"
+    "}\n"
+    "\n"
+    "int length(char *s)\n"
+    "{\n"
+    "    return strlen(s);\n"
+    "}\n"
+    "\n"
+    "char *lines(int n)\n"
+    "{\n"
+    "    int i;\n"
+    "\n"
+    "    strcpy(Text, \"\");\n"
+    "    for (i = 0; i < n; i++)\n"
+    "        strcat(Text, \"line\\n\");\n"
+    "\n"
+    "    return Text;\n"
+    "}\n"
+    "\n"
+    "char *repeat(int n)\n"
+    "{\n"
+    "    memset(Text, 'x', n);\n"
+    "    Text[n] = 0;\n"
+    "    return Text;\n"
+    "}\n"
+    "\n"
+    "double half(int n)\n"
+    "{\n"
+    "    printf(\"halving %d\\n\", n);\n"
+    "    return n / 2.0;\n"
+    "}\n";
+
+static char SocketPath[64];
+
+static void *Serve(void *Arg)
+{
+    PicocServe(SocketPath, 1, 128000*4);
+    return NULL;
+}
+
+/* send a request and show the reply, or how long it was if it's long.
+    Label says what the request was */
+static void Request(const char *Label, const char *FileName,
+    const char *FuncName, int NumArgs, char **Args)
+{
+    char *Reply = NULL;
+    size_t ReplyLen = 0;
+    FILE *Output = open_memstream(&Reply, &ReplyLen);
+    int ExitValue = PicocServerRequest(SocketPath, FileName, FuncName,
+        NumArgs, Args, Output);
+
+    fclose(Output);
+    printf("%s: exit %d\n", Label, ExitValue);
+    if (ReplyLen < 200)
+        printf("%s", Reply);
+    else
+        printf("%lu bytes, %lu after the first newline\n",
+            (unsigned long)ReplyLen, (unsigned long)strlen(strchr(Reply, '\n')));
+
+    free(Reply);
+}
+
+int main()
+{
+    char Dir[] = "/tmp/picoc_server_XXXXXX";
+    char FileName[64];
+    pthread_t Thread;
+    struct stat FileInfo;
+    FILE *File;
+    int Tries;
+    int Result;
+    char **Many;
+
+    if (mkdtemp(Dir) == NULL)
+        return 1;
+
+    snprintf(FileName, sizeof(FileName), "%s/prog.c", Dir);
+    snprintf(SocketPath, sizeof(SocketPath), "%s/sock", Dir);
+    File = fopen(FileName, "w");
+    fputs(Source, File);
+    fclose(File);
+
+    /* something which isn't a socket is in the way */
+    File = fopen(SocketPath, "w");
+    fclose(File);
+    Result = PicocServe(SocketPath, 1, 128000*4);
+    printf("serve on a file: %d, %s\n", Result, strerror(errno));
+    printf("file still there: %s\n", stat(SocketPath, &FileInfo) == 0 &&
+        S_ISREG(FileInfo.st_mode) ? "yes" : "no");
+    unlink(SocketPath);
+
+    pthread_create(&Thread, NULL, Serve, NULL);
+    for (Tries = 0; Tries < 500 && access(SocketPath, F_OK) != 0; Tries++)
+        usleep(10000);
+
+    chdir(Dir);
+    Request("main one two", "prog.c", NULL, 2, (char *[]){ "one", "two" });
+    Request("main with spaces, empty and newlines", "prog.c", NULL, 4,
+        (char *[]){ "hello world", "", "a\nmain missing.c", "  " });
+    Request("length \"a b\"", "prog.c", "length", 1, (char *[]){ "a b" });
+    Request("length \"\"", "prog.c", "length", 1, (char *[]){ "" });
+    Request("half 7", "prog.c", "half", 1, (char *[]){ "7" });
+    Request("lines 3", "prog.c", "lines", 1, (char *[]){ "3" });
+    Request("repeat 5000", "prog.c", "repeat", 1, (char *[]){ "5000" });
+    Request("nothing", "prog.c", "nothing", 0, NULL);
+    Request("main missing.c", "missing.c", NULL, 0, NULL);
+
+    /* too many arguments, or too much in them, is an error not truncation */
+    Many = malloc(sizeof(char *) * 2000);
+    for (Tries = 0; Tries < 2000; Tries++)
+        Many[Tries] = "x";
+    Request("main with 2000 arguments", "prog.c", NULL, 2000, Many);
+    Many[0] = malloc(2*1024*1024);
+    memset(Many[0], 'x', 2*1024*1024 - 1);
+    Many[0][2*1024*1024 - 1] = '\0';
+    Request("main with a 2MB argument", "prog.c", NULL, 1, Many);
+    Request("length after that", "prog.c", "length", 1, (char *[]){ "abc" });
+    free(Many[0]);
+    free(Many);
+
+    unlink(SocketPath);
+    unlink(FileName);
+    rmdir(Dir);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* a program's globals, statics and structs are changed after the snapshot
+ * is taken, and more code is parsed into it. restoring the snapshot puts
+ * every value back the way it was and forgets the new code */
+#include <stdio.h>
+#include <string.h>
+#include "picoc.h"
+
+static const char *Source =
+    "#include <stdio.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "struct point { int x; int y; char name[8]; };\n"
+    "\n"
+    "int count = 3;\n"
+    "double scale = 1.5;\n"
+    "int table[4] = { 1, 2, 3, 4 };\n"
+    "struct point origin;\n"
+    "char *greeting = \"hello\";\n"
+    "\n"
+    "int next()\n"
+    "{\n"
+    "    static int serial = 100;\n"
+    "    return serial++;\n"
+    "}\n"
+    "\n"
+    "void setup()\n"
+    "{\n"
+    "    origin.x = 10;\n"
+    "    origin.y = 20;\n"
+    "    strcpy(origin.name, \"origin\");\n"
+    "    next();\n"
+    "}\n"
+    "\n"
+    "void show()\n"
+    "{\n"
+    "    printf(\"count %d scale %.1f table %d %d %d %d\\n\", count, scale,\n"
+    "        table[0], table[1], table[2], table[3]);\n"
+    "    printf(\"origin %d %d %s greeting %s\\n\", origin.x, origin.y,\n"
+    "        origin.name, greeting);\n"
+    "}\n"
+    "\n"
+    "void change()\n"
+    "{\n"
+    "    count = 99;\n"
+    "    scale = -2.5;\n"
+    "    table[0] = table[3] = 0;\n"
+    "    origin.x = -1;\n"
+    "    origin.y = -2;\n"
+    "    strcpy(origin.name, \"moved\");\n"
+    "    greeting = \"bye\";\n"
+    "}\n";
+
+static const char *Extra =
+    "int added = 5;\n"
+    "\n"
+    "void extra()\n"
+    "{\n"
+    "    count = added;\n"
+    "}\n";
+
+static Picoc pc;
+
+/* call a function with no arguments which returns an int or nothing */
+static int Call(const char *Name)
+{
+    union AnyValue Result;
+
+    Result.Integer = 0;
+    PicocCallFunction(&pc, PicocGetFunction(&pc, Name), NULL, 0, &Result);
+    return Result.Integer;
+}
+
+int main()
+{
+    int Round;
+    int First;
+
+    PicocInitialize(&pc, 1024*1024);
+    if (PicocPlatformSetExitPoint(&pc)) {
+        printf("failed\n");
+        return 1;
+    }
+
+    PicocParse(&pc, "snapshot.c", Source, strlen(Source), true, false,
+        false, false);
+    setvbuf(stdout, NULL, _IONBF, 0);
+    Call("setup");
+    PicocSnapshot(&pc);
+
+    for (Round = 1; Round <= 2; Round++) {
+        printf("round %d\n", Round);
+        Call("show");
+        First = Call("next");
+        Call("next");
+        printf("next %d then %d\n", First, Call("next"));
+
+        Call("change");
+        PicocParse(&pc, "extra.c", Extra, strlen(Extra), true, false,
+            false, false);
+        Call("extra");
+        Call("show");
+
+        PicocRestoreSnapshot(&pc);
+        printf("extra() after restoring: %s\n",
+            PicocGetFunction(&pc, "extra") == NULL ? "gone" : "still there");
+    }
+
+    Call("show");
+    PicocCleanup(&pc);
+    return 0;
+}
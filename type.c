@@ -18,9 +18,12 @@ static struct ValueType *TypeParseBack(struct ParseState *Parser,
 
 
 
-/* some basic types */
-static int PointerAlignBytes;
-static int IntAlignBytes;
+/* some basic types. they're constant so interpreters in different
+    threads can share them */
+struct IntAlign {char x; int y;};
+struct PointerAlign {char x; void *y;};
+static const int PointerAlignBytes = offsetof(struct PointerAlign, y);
+static const int IntAlignBytes = offsetof(struct IntAlign, y);
 
 
 /* add a new type to the set of types we know about */
@@ -28,8 +31,8 @@ struct ValueType *TypeAdd(Picoc *pc, struct ParseState *Parser,
     struct ValueType *ParentType, enum BaseType Base, int ArraySize,
     const char *Identifier, int Sizeof, int AlignBytes)
 {
-    struct ValueType *NewType = VariableAlloc(pc, Parser,
-        sizeof(struct ValueType), true);
+    struct ValueType *NewType = VariableAllocHeap(pc, Parser,
+        sizeof(struct ValueType), MemTypes);
     NewType->Base = Base;
     NewType->ArraySize = ArraySize;
     NewType->Sizeof = Sizeof;
@@ -45,6 +48,18 @@ struct ValueType *TypeAdd(Picoc *pc, struct ParseState *Parser,
     return NewType;
 }
 
+/* find a derived type of a parent type, or NULL if there isn't one yet */
+static struct ValueType *TypeFindDerived(struct ValueType *ParentType,
+    enum BaseType Base, int ArraySize, const char *Identifier)
+{
+    struct ValueType *ThisType = ParentType->DerivedTypeList;
+    while (ThisType != NULL && (ThisType->Base != Base ||
+            ThisType->ArraySize != ArraySize || ThisType->Identifier != Identifier))
+        ThisType = ThisType->Next;
+
+    return ThisType;
+}
+
 /* given a parent type, get a matching derived type and make one if necessary.
  * Identifier should be registered with the shared string table. */
 struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser,
@@ -53,10 +68,8 @@ struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser,
 {
     int Sizeof;
     int AlignBytes;
-    struct ValueType *ThisType = ParentType->DerivedTypeList;
-    while (ThisType != NULL && (ThisType->Base != Base ||
-            ThisType->ArraySize != ArraySize || ThisType->Identifier != Identifier))
-        ThisType = ThisType->Next;
+    struct ValueType *ThisType = TypeFindDerived(ParentType, Base, ArraySize,
+        Identifier);
 
     if (ThisType != NULL) {
         if (AllowDuplicates)
@@ -84,8 +97,16 @@ struct ValueType *TypeGetMatching(Picoc *pc, struct ParseState *Parser,
                     when we add members to them */
     }
 
-    return TypeAdd(pc, Parser, ParentType, Base, ArraySize, Identifier, Sizeof,
-        AlignBytes);
+    /* another thread may be adding the same type, so look again once
+        we've got the lock */
+    ThreadLock(pc);
+    ThisType = TypeFindDerived(ParentType, Base, ArraySize, Identifier);
+    if (ThisType == NULL)
+        ThisType = TypeAdd(pc, Parser, ParentType, Base, ArraySize, Identifier,
+            Sizeof, AlignBytes);
+    ThreadUnlock(pc);
+
+    return ThisType;
 }
 
 /* stack space used by a value */
@@ -139,15 +160,10 @@ void TypeAddBaseType(Picoc *pc, struct ValueType *TypeNode, enum BaseType Base,
 /* initialize the type system */
 void TypeInit(Picoc *pc)
 {
-    struct IntAlign {char x; int y;} ia;
     struct ShortAlign {char x; short y;} sa;
     struct CharAlign {char x; char y;} ca;
     struct LongAlign {char x; long y;} la;
     struct DoubleAlign {char x; double y;} da;
-    struct PointerAlign {char x; void *y;} pa;
-
-    IntAlignBytes = (char*)&ia.y - &ia.x;
-    PointerAlignBytes = (char*)&pa.y - &pa.x;
 
     pc->UberType.DerivedTypeList = NULL;
     TypeAddBaseType(pc, &pc->IntType, TypeInt, sizeof(int), IntAlignBytes);
@@ -184,6 +200,21 @@ void TypeInit(Picoc *pc)
         pc->StrEmpty, sizeof(void*), PointerAlignBytes);
 }
 
+/* free a type which was allocated on the heap */
+static void TypeFreeNode(Picoc *pc, struct ValueType *Typ)
+{
+    if (Typ->OnHeap) {
+        /* if it's a struct or union deallocate all the member values */
+        if (Typ->Members != NULL) {
+            VariableTableCleanup(pc, Typ->Members);
+            HeapFreeMem(pc, Typ->Members);
+        }
+
+        /* free this node */
+        HeapFreeMem(pc, Typ);
+    }
+}
+
 /* deallocate heap-allocated types */
 void TypeCleanupNode(Picoc *pc, struct ValueType *Typ)
 {
@@ -195,16 +226,7 @@ void TypeCleanupNode(Picoc *pc, struct ValueType *Typ)
             SubType = NextSubType) {
         NextSubType = SubType->Next;
         TypeCleanupNode(pc, SubType);
-        if (SubType->OnHeap) {
-            /* if it's a struct or union deallocate all the member values */
-            if (SubType->Members != NULL) {
-                VariableTableCleanup(pc, SubType->Members);
-                HeapFreeMem(pc, SubType->Members);
-            }
-
-            /* free this node */
-            HeapFreeMem(pc, SubType);
-        }
+        TypeFreeNode(pc, SubType);
     }
 }
 
@@ -213,6 +235,64 @@ void TypeCleanup(Picoc *pc)
     TypeCleanupNode(pc, &pc->UberType);
 }
 
+/* mark a type and everything derived from it as part of the snapshot */
+static void TypeSnapshotNode(struct ValueType *Typ, int InSnapshot)
+{
+    struct ValueType *SubType;
+
+    for (SubType = Typ->DerivedTypeList; SubType != NULL;
+            SubType = SubType->Next) {
+        SubType->InSnapshot = InSnapshot;
+        SubType->SnapshotIncomplete = InSnapshot &&
+            (SubType->Base == TypeStruct || SubType->Base == TypeUnion) &&
+            SubType->Members == NULL;
+        TypeSnapshotNode(SubType, InSnapshot);
+    }
+}
+
+void TypeSnapshot(Picoc *pc)
+{
+    TypeSnapshotNode(&pc->UberType, true);
+}
+
+void TypeSnapshotFree(Picoc *pc)
+{
+    TypeSnapshotNode(&pc->UberType, false);
+}
+
+/* free the types derived since the snapshot. new types are always
+    added to the front of the derived type list */
+static void TypeRestoreNode(Picoc *pc, struct ValueType *Typ)
+{
+    struct ValueType *SubType;
+
+    while (Typ->DerivedTypeList != NULL && !Typ->DerivedTypeList->InSnapshot) {
+        SubType = Typ->DerivedTypeList;
+        Typ->DerivedTypeList = SubType->Next;
+        TypeCleanupNode(pc, SubType);
+        TypeFreeNode(pc, SubType);
+    }
+
+    for (SubType = Typ->DerivedTypeList; SubType != NULL;
+            SubType = SubType->Next) {
+        if (SubType->SnapshotIncomplete && SubType->Members != NULL) {
+            /* it's been defined since, go back to just being declared */
+            VariableTableCleanup(pc, SubType->Members);
+            HeapFreeMem(pc, SubType->Members);
+            SubType->Members = NULL;
+            SubType->Sizeof = 0;
+            SubType->AlignBytes = 0;
+        }
+
+        TypeRestoreNode(pc, SubType);
+    }
+}
+
+void TypeRestore(Picoc *pc)
+{
+    TypeRestoreNode(pc, &pc->UberType);
+}
+
 /* parse a struct or union declaration */
 void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ,
     int IsStruct)
@@ -252,17 +332,16 @@ void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ,
         return;
     }
 
-    if (pc->TopStackFrame != NULL)
+    if (THREAD(pc)->TopStackFrame != NULL)
         ProgramFail(Parser, "struct/union definitions can only be globals");
 
     LexGetToken(Parser, NULL, true);
-    (*Typ)->Members = VariableAlloc(pc, Parser,
-        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true);
-    (*Typ)->Members->HashTable =
-        (struct TableEntry**)((char*)(*Typ)->Members + sizeof(struct Table));
+    (*Typ)->Members = VariableAllocHeap(pc, Parser,
+        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry),
+        MemTypes);
     TableInitTable((*Typ)->Members,
-        (struct TableEntry**)((char*)(*Typ)->Members + sizeof(struct Table)),
-        STRUCT_TABLE_SIZE, true);
+        (struct TableEntry*)((char*)(*Typ)->Members + sizeof(struct Table)),
+        STRUCT_TABLE_SIZE);
 
     do {
         TypeParse(Parser, &MemberType, &MemberIdentifier, NULL);
@@ -316,17 +395,25 @@ struct ValueType *TypeCreateOpaqueStruct(Picoc *pc, struct ParseState *Parser,
     const char *StructName, int Size)
 {
     struct ValueType *Typ = TypeGetMatching(pc, Parser, &pc->UberType,
-        TypeStruct, 0, StructName, false);
+        TypeStruct, 0, StructName, true);
+
+    /* a program may have already declared it before using its header */
+    if (Typ->Members != NULL) {
+        if (Parser == NULL)
+            ProgramFailNoParser(pc, "data type '%s' is already defined",
+                StructName);
+        else
+            ProgramFail(Parser, "data type '%s' is already defined", StructName);
+    }
 
     /* create the (empty) table */
-    Typ->Members = VariableAlloc(pc,
+    Typ->Members = VariableAllocHeap(pc,
         Parser,
-        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true);
-    Typ->Members->HashTable = (struct TableEntry**)((char*)Typ->Members +
-        sizeof(struct Table));
+        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry),
+        MemTypes);
     TableInitTable(Typ->Members,
-        (struct TableEntry**)((char*)Typ->Members+sizeof(struct Table)),
-        STRUCT_TABLE_SIZE, true);
+        (struct TableEntry*)((char*)Typ->Members+sizeof(struct Table)),
+        STRUCT_TABLE_SIZE);
     Typ->Sizeof = Size;
 
     return Typ;
@@ -363,7 +450,7 @@ void TypeParseEnum(struct ParseState *Parser, struct ValueType **Typ)
         return;
     }
 
-    if (pc->TopStackFrame != NULL)
+    if (THREAD(pc)->TopStackFrame != NULL)
         ProgramFail(Parser, "enum definitions can only be globals");
 
     LexGetToken(Parser, NULL, true);
@@ -6,20 +6,32 @@
 /* maximum size of a value to temporarily copy while we create a variable */
 #define MAX_TMP_COPY_BUF (256)
 
+/* a global variable's contents as kept by a snapshot, followed by the data */
+struct SavedValue {
+    struct Value *Val;
+    int Size;
+};
+
 
 /* initialize the variable system */
 void VariableInit(Picoc *pc)
 {
     TableInitTable(&(pc->GlobalTable), &(pc->GlobalHashTable)[0],
-        GLOBAL_TABLE_SIZE, true);
+        GLOBAL_TABLE_SIZE);
     TableInitTable(&pc->StringLiteralTable, &pc->StringLiteralHashTable[0],
-        STRING_LITERAL_TABLE_SIZE, true);
-    pc->TopStackFrame = NULL;
+        STRING_LITERAL_TABLE_SIZE);
+    TableInitTable(&pc->StaticTable, &pc->StaticHashTable[0],
+        STATIC_TABLE_SIZE);
+    pc->MainThread.TopStackFrame = NULL;
 }
 
 /* deallocate the contents of a variable */
 void VariableFree(Picoc *pc, struct Value *Val)
 {
+    /* restoring the snapshot will bring it back */
+    if (Val->InSnapshot)
+        return;
+
     if (Val->ValOnHeap || Val->AnyValOnHeap) {
         /* free function bodies */
         if (Val->Typ == &pc->FunctionType &&
@@ -45,26 +57,181 @@ void VariableFree(Picoc *pc, struct Value *Val)
 void VariableTableCleanup(Picoc *pc, struct Table *HashTable)
 {
     int Count;
-    struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
 
     for (Count = 0; Count < HashTable->Size; Count++) {
-        for (Entry = HashTable->HashTable[Count];
-                Entry != NULL;
-                Entry = NextEntry) {
-            NextEntry = Entry->Next;
-            VariableFree(pc, Entry->p.v.Val);
-
-            /* free the hash table entry */
-            HeapFreeMem(pc, Entry);
-        }
+        if (HashTable->HashTable[Count].Key != NULL)
+            VariableFree(pc, HashTable->HashTable[Count].Val);
     }
+
+    TableFree(pc, HashTable);
 }
 
 void VariableCleanup(Picoc *pc)
 {
     VariableTableCleanup(pc, &pc->GlobalTable);
     VariableTableCleanup(pc, &pc->StringLiteralTable);
+    TableFree(pc, &pc->StaticTable);  /* its values belong to the global table */
+}
+
+/* does a snapshot keep a copy of this global's contents. read-only
+    values can't change, and the ones library constants point to are
+    shared by every interpreter so mustn't be written back */
+static int VariableSnapshotHasData(Picoc *pc, struct Value *Val)
+{
+    return Val->Typ != &pc->FunctionType && Val->Typ != &pc->MacroType &&
+        Val->IsLValue && Val->Val != NULL && TypeSizeValue(Val, true) > 0;
+}
+
+/* mark the values in a table as part of the snapshot */
+static void VariableSnapshotTable(Picoc *pc, struct Table *Tbl,
+    struct SavedTable *Saved)
+{
+    int Count;
+
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        if (Tbl->HashTable[Count].Key != NULL)
+            Tbl->HashTable[Count].Val->InSnapshot = true;
+    }
+
+    TableSave(pc, Tbl, Saved);
+}
+
+/* save the global variables, their contents and the string literals */
+void VariableSnapshot(Picoc *pc, struct Snapshot *Snap)
+{
+    int Count;
+    size_t DataSize = 0;
+    unsigned char *Data;
+    struct Table *Tbl = &pc->GlobalTable;
+
+    VariableSnapshotTable(pc, &pc->GlobalTable, &Snap->GlobalTable);
+    VariableSnapshotTable(pc, &pc->StringLiteralTable,
+        &Snap->StringLiteralTable);
+    TableSave(pc, &pc->StaticTable, &Snap->StaticTable);
+
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        struct Value *Val = Tbl->HashTable[Count].Val;
+        if (Tbl->HashTable[Count].Key != NULL &&
+                VariableSnapshotHasData(pc, Val))
+            DataSize += MEM_ALIGN(sizeof(struct SavedValue)) +
+                MEM_ALIGN(TypeSizeValue(Val, true));
+    }
+
+    Snap->GlobalData = HeapAllocMem(pc, DataSize + 1);
+    if (Snap->GlobalData == NULL)
+        ProgramFailNoParser(pc, "(VariableSnapshot) out of memory");
+
+    Snap->GlobalDataSize = DataSize;
+    Data = Snap->GlobalData;
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        struct Value *Val = Tbl->HashTable[Count].Val;
+        struct SavedValue *Saved = (struct SavedValue*)Data;
+
+        if (Tbl->HashTable[Count].Key == NULL ||
+                !VariableSnapshotHasData(pc, Val))
+            continue;
+
+        Saved->Val = Val;
+        Saved->Size = TypeSizeValue(Val, true);
+        Data += MEM_ALIGN(sizeof(struct SavedValue));
+        memcpy((void*)Data, (void*)Val->Val, Saved->Size);
+        Data += MEM_ALIGN(Saved->Size);
+    }
+}
+
+/* free the values in a table which aren't in the snapshot */
+static void VariableRestoreTable(Picoc *pc, struct Table *Tbl,
+    struct SavedTable *Saved)
+{
+    int Count;
+
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        if (Tbl->HashTable[Count].Key != NULL)
+            VariableFree(pc, Tbl->HashTable[Count].Val);
+    }
+
+    TableRestore(pc, Tbl, Saved);
+}
+
+/* put the global variables back the way they were in the snapshot */
+void VariableRestore(Picoc *pc, struct Snapshot *Snap)
+{
+    unsigned char *Data = Snap->GlobalData;
+
+    VariableRestoreTable(pc, &pc->GlobalTable, &Snap->GlobalTable);
+    VariableRestoreTable(pc, &pc->StringLiteralTable,
+        &Snap->StringLiteralTable);
+    TableRestore(pc, &pc->StaticTable, &Snap->StaticTable);
+
+    while (Data < Snap->GlobalData + Snap->GlobalDataSize) {
+        struct SavedValue *Saved = (struct SavedValue*)Data;
+
+        Data += MEM_ALIGN(sizeof(struct SavedValue));
+        memcpy((void*)Saved->Val->Val, (void*)Data, Saved->Size);
+        Data += MEM_ALIGN(Saved->Size);
+    }
+
+    pc->MainThread.TopStackFrame = NULL;
+}
+
+/* let go of the values in a saved table. any which have been
+    removed from the table since are only kept alive by the snapshot */
+static void VariableSnapshotFreeTable(Picoc *pc, struct Table *Tbl,
+    struct SavedTable *Saved)
+{
+    int Count;
+    struct Value *Val;
+
+    for (Count = 0; Count < Saved->Tbl.Size; Count++) {
+        struct TableEntry *Entry = &Saved->HashTable[Count];
+        if (Entry->Key == NULL)
+            continue;
+
+        Entry->Val->InSnapshot = false;
+        if (!TableGet(Tbl, Entry->Key, &Val, NULL, NULL, NULL) ||
+                Val != Entry->Val)
+            VariableFree(pc, Entry->Val);
+    }
+
+    TableSavedFree(pc, Saved);
+}
+
+/* free a snapshot of the global variables */
+void VariableSnapshotFree(Picoc *pc, struct Snapshot *Snap)
+{
+    VariableSnapshotFreeTable(pc, &pc->GlobalTable, &Snap->GlobalTable);
+    VariableSnapshotFreeTable(pc, &pc->StringLiteralTable,
+        &Snap->StringLiteralTable);
+    TableSavedFree(pc, &Snap->StaticTable);
+    HeapFreeMem(pc, Snap->GlobalData);
+}
+
+/* fail because the stack has grown as deep as it can go */
+void VariableStackOverflow(Picoc *pc, struct ParseState *Parser)
+{
+    if (Parser == NULL)
+        ProgramFailNoParser(pc, "stack overflow - %d frames deep",
+            VariableStackFrameDepth(pc));
+    else
+        ProgramFail(Parser, "stack overflow - %d frames deep",
+            VariableStackFrameDepth(pc));
+}
+
+/* allocate some memory on the heap, counted as being for Category, and
+    check if we've run out */
+void *VariableAllocHeap(Picoc *pc, struct ParseState *Parser, int Size,
+    enum MemCategory Category)
+{
+    void *NewValue = HeapAllocCategory(pc, Size, Category);
+
+    if (NewValue == NULL) {
+        if (Parser == NULL)
+            ProgramFailNoParser(pc, "(VariableAlloc) out of memory");
+        else
+            ProgramFail(Parser, "(VariableAlloc) out of memory");
+    }
+
+    return NewValue;
 }
 
 /* allocate some memory, either on the heap or the stack
@@ -74,16 +241,20 @@ void *VariableAlloc(Picoc *pc, struct ParseState *Parser, int Size, int OnHeap)
     void *NewValue;
 
     if (OnHeap)
-        NewValue = HeapAllocMem(pc, Size);
-    else
-        NewValue = HeapAllocStack(pc, Size);
-
-    if (NewValue == NULL)
-        ProgramFail(Parser, "(VariableAlloc) out of memory");
+        return VariableAllocHeap(pc, Parser, Size, MemValues);
+
+    NewValue = HeapAllocStack(pc, Size);
+    if (NewValue == NULL) {
+        if (THREAD(pc)->TopStackFrame != NULL)
+            VariableStackOverflow(pc, Parser);
+        else if (Parser == NULL)
+            ProgramFailNoParser(pc, "(VariableAlloc) out of memory");
+        else
+            ProgramFail(Parser, "(VariableAlloc) out of memory");
+    }
 
 #ifdef DEBUG_HEAP
-    if (!OnHeap)
-        printf("pushing %d at 0x%lx\n", Size, (unsigned long)NewValue);
+    printf("pushing %d at 0x%lx\n", Size, (unsigned long)NewValue);
 #endif
 
     return NewValue;
@@ -188,7 +359,6 @@ int VariableScopeBegin(struct ParseState *Parser, int* OldScopeID)
 {
     int Count;
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry;
 #ifdef DEBUG_VAR_SCOPE
     int FirstPrint = 0;
 #endif
@@ -196,31 +366,34 @@ int VariableScopeBegin(struct ParseState *Parser, int* OldScopeID)
     if (Parser->ScopeID == -1)
         return -1;
 
-    struct Table *HashTable = (Parser->pc->TopStackFrame == NULL) ?
-        &(Parser->pc->GlobalTable) : &(Parser->pc->TopStackFrame)->LocalTable;
+    struct Table *HashTable = (THREAD(Parser->pc)->TopStackFrame == NULL) ?
+        &(Parser->pc->GlobalTable) : &(THREAD(Parser->pc)->TopStackFrame)->LocalTable;
 
-    /* XXX dumb hash, let's hope for no collisions... */
+    /* XXX dumb hash, let's hope for no collisions... mix the source in
+        rather than multiplying by it, heap addresses often end in lots
+        of zero bits and the product would too */
     *OldScopeID = Parser->ScopeID;
-    Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) *
-        ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
+    Parser->ScopeID = (int)(((uintptr_t)Parser->Pos ^
+        ((uintptr_t)Parser->SourceText * 2654435761u)) & 0x7fffffff);
     /* or maybe a more human-readable hash for debugging? */
     /* Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos; */
 
+    /* 0 is the file scope, don't collide with it */
+    if (Parser->ScopeID == 0)
+        Parser->ScopeID = 1;
+
     for (Count = 0; Count < HashTable->Size; Count++) {
-        for (Entry = HashTable->HashTable[Count];
-                Entry != NULL; Entry = NextEntry) {
-            NextEntry = Entry->Next;
-            if (Entry->p.v.Val->ScopeID == Parser->ScopeID &&
-                    Entry->p.v.Val->OutOfScope == true) {
-                Entry->p.v.Val->OutOfScope = false;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key & ~1);
+        Entry = &HashTable->HashTable[Count];
+        if (Entry->Key != NULL && Entry->Val->ScopeID == Parser->ScopeID &&
+                Entry->Val->OutOfScope == true) {
+            Entry->Val->OutOfScope = false;
+            Entry->Key = (char*)((intptr_t)Entry->Key & ~1);
 #ifdef DEBUG_VAR_SCOPE
-                if (!FirstPrint) PRINT_SOURCE_POS();
-                FirstPrint = 1;
-                printf(">>> back into scope: %s %x %d\n", Entry->p.v.Key,
-                    Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+            if (!FirstPrint) PRINT_SOURCE_POS();
+            FirstPrint = 1;
+            printf(">>> back into scope: %s %x %d\n", Entry->Key,
+                Entry->Val->ScopeID, Entry->Val->Val->Integer);
 #endif
-            }
         }
     }
 
@@ -231,7 +404,6 @@ void VariableScopeEnd(struct ParseState *Parser, int ScopeID, int PrevScopeID)
 {
     int Count;
     struct TableEntry *Entry;
-    struct TableEntry *NextEntry = NULL;
 #ifdef DEBUG_VAR_SCOPE
     int FirstPrint = 0;
 #endif
@@ -239,24 +411,21 @@ void VariableScopeEnd(struct ParseState *Parser, int ScopeID, int PrevScopeID)
     if (ScopeID == -1)
         return;
 
-    struct Table *HashTable = (Parser->pc->TopStackFrame == NULL) ?
-        &(Parser->pc->GlobalTable) : &(Parser->pc->TopStackFrame)->LocalTable;
+    struct Table *HashTable = (THREAD(Parser->pc)->TopStackFrame == NULL) ?
+        &(Parser->pc->GlobalTable) : &(THREAD(Parser->pc)->TopStackFrame)->LocalTable;
 
     for (Count = 0; Count < HashTable->Size; Count++) {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL;
-            Entry = NextEntry) {
-            NextEntry = Entry->Next;
-            if ((Entry->p.v.Val->ScopeID == ScopeID) &&
-                    (Entry->p.v.Val->OutOfScope == false)) {
+        Entry = &HashTable->HashTable[Count];
+        if (Entry->Key != NULL && (Entry->Val->ScopeID == ScopeID) &&
+                (Entry->Val->OutOfScope == false)) {
 #ifdef DEBUG_VAR_SCOPE
-                if (!FirstPrint) PRINT_SOURCE_POS();
-                FirstPrint = 1;
-                printf(">>> out of scope: %s %x %d\n", Entry->p.v.Key,
-                    Entry->p.v.Val->ScopeID, Entry->p.v.Val->Val->Integer);
+            if (!FirstPrint) PRINT_SOURCE_POS();
+            FirstPrint = 1;
+            printf(">>> out of scope: %s %x %d\n", Entry->Key,
+                Entry->Val->ScopeID, Entry->Val->Val->Integer);
 #endif
-                Entry->p.v.Val->OutOfScope = true;
-                Entry->p.v.Key = (char*)((intptr_t)Entry->p.v.Key | 1); /* alter the key so it won't be found by normal searches */
-            }
+            Entry->Val->OutOfScope = true;
+            Entry->Key = (char*)((intptr_t)Entry->Key | 1); /* alter the key so it won't be found by normal searches */
         }
     }
 
@@ -268,16 +437,14 @@ int VariableDefinedAndOutOfScope(Picoc *pc, const char* Ident)
     int Count;
     struct TableEntry *Entry;
 
-    struct Table * HashTable = (pc->TopStackFrame == NULL) ?
-        &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
+    struct Table * HashTable = (THREAD(pc)->TopStackFrame == NULL) ?
+        &(pc->GlobalTable) : &(THREAD(pc)->TopStackFrame)->LocalTable;
 
     for (Count = 0; Count < HashTable->Size; Count++) {
-        for (Entry = HashTable->HashTable[Count]; Entry != NULL;
-            Entry = Entry->Next) {
-            if (Entry->p.v.Val->OutOfScope == true &&
-                    (char*)((intptr_t)Entry->p.v.Key & ~1) == Ident)
-                return true;
-        }
+        Entry = &HashTable->HashTable[Count];
+        if (Entry->Key != NULL && Entry->Val->OutOfScope == true &&
+                (char*)((intptr_t)Entry->Key & ~1) == Ident)
+            return true;
     }
     return false;
 }
@@ -288,20 +455,25 @@ struct Value *VariableDefine(Picoc *pc, struct ParseState *Parser, char *Ident,
 {
     int ScopeID = Parser ? Parser->ScopeID : -1;
     struct Value * AssignValue;
-    struct Table * currentTable = (pc->TopStackFrame == NULL) ?
-        &(pc->GlobalTable) : &(pc->TopStackFrame)->LocalTable;
+    struct Table * currentTable = (THREAD(pc)->TopStackFrame == NULL) ?
+        &(pc->GlobalTable) : &(THREAD(pc)->TopStackFrame)->LocalTable;
 
 #ifdef DEBUG_VAR_SCOPE
     if (Parser) fprintf(stderr, "def %s %x (%s:%d:%d)\n", Ident, ScopeID,
         Parser->FileName, Parser->Line, Parser->CharacterPos);
 #endif
 
+    /* a library function which hasn't been used yet is still defined, so
+        define it now and a global with its name clashes with it */
+    if (currentTable == &pc->GlobalTable)
+        LibraryResolve(pc, Ident);
+
     if (InitValue != NULL)
         AssignValue = VariableAllocValueAndCopy(pc, Parser, InitValue,
-            pc->TopStackFrame == NULL);
+            THREAD(pc)->TopStackFrame == NULL);
     else
         AssignValue = VariableAllocValueFromType(pc, Parser, Typ, MakeWritable,
-            NULL, pc->TopStackFrame == NULL);
+            NULL, THREAD(pc)->TopStackFrame == NULL);
 
     AssignValue->IsLValue = MakeWritable;
     AssignValue->ScopeID = ScopeID;
@@ -315,6 +487,100 @@ struct Value *VariableDefine(Picoc *pc, struct ParseState *Parser, char *Ident,
     return AssignValue;
 }
 
+/* find the global store for a static variable, defining it under its
+    mangled name if this is the first time we've seen it */
+static struct Value *VariableStaticGlobal(struct ParseState *Parser,
+    char *Ident, struct ValueType *Typ, int *FirstVisit)
+{
+    int DeclLine;
+    int DeclColumn;
+    const char *DeclFileName;
+    Picoc *pc = Parser->pc;
+    struct Value *ExistingValue;
+    char MangledName[LINEBUFFER_MAX];
+    char *MNPos = &MangledName[0];
+    char *MNEnd = &MangledName[LINEBUFFER_MAX-1];
+    const char *RegisteredMangledName;
+
+    /* make the mangled static name (avoiding using sprintf()
+        to minimise library impact) */
+    memset((void*)&MangledName, '\0', sizeof(MangledName));
+    *MNPos++ = '/';
+    strncpy(MNPos, (char*)Parser->FileName, MNEnd - MNPos);
+    MNPos += strlen(MNPos);
+
+    if (THREAD(pc)->TopStackFrame != NULL) {
+        /* we're inside a function */
+        if (MNEnd - MNPos > 0)
+            *MNPos++ = '/';
+        strncpy(MNPos, (char*)THREAD(pc)->TopStackFrame->FuncName, MNEnd - MNPos);
+        MNPos += strlen(MNPos);
+    }
+
+    if (MNEnd - MNPos > 0) *MNPos++ = '/';
+    strncpy(MNPos, Ident, MNEnd - MNPos);
+    RegisteredMangledName = TableStrRegister(pc, MangledName);
+
+    /* is this static already defined? */
+    if (!TableGet(&pc->GlobalTable, RegisteredMangledName, &ExistingValue,
+            &DeclFileName, &DeclLine, &DeclColumn)) {
+        /* define the mangled-named static variable store in the global scope */
+        ExistingValue = VariableAllocValueFromType(Parser->pc, Parser, Typ,
+            true, NULL, true);
+        TableSet(pc, &pc->GlobalTable, (char*)RegisteredMangledName,
+            ExistingValue, (char *)Parser->FileName, Parser->Line,
+            Parser->CharacterPos);
+        *FirstVisit = true;
+    }
+
+    return ExistingValue;
+}
+
+/* define a static variable inside a function. the global store is found
+    once per declaration site and cached so later calls only have to
+    bind a local name to it */
+static struct Value *VariableDefineLocalStatic(struct ParseState *Parser,
+    char *Ident, struct ValueType *Typ, int *FirstVisit)
+{
+    int DeclLine;
+    int DeclColumn;
+    const char *DeclFileName;
+    Picoc *pc = Parser->pc;
+    char *Site = (char*)Parser->Pos;
+    struct Value *ExistingValue;
+    struct Value *LocalValue;
+
+    /* have we come round a loop to a static we've already bound? */
+    if (Parser->Line != 0 && TableGet(&THREAD(pc)->TopStackFrame->LocalTable, Ident,
+                &LocalValue, &DeclFileName, &DeclLine, &DeclColumn)
+            && DeclFileName == Parser->FileName && DeclLine == Parser->Line &&
+            DeclColumn == Parser->CharacterPos)
+        return LocalValue;
+
+    /* token space can be reused so check the cached entry really is
+        from this declaration */
+    if (!TableGet(&pc->StaticTable, Site, &ExistingValue, &DeclFileName,
+                &DeclLine, &DeclColumn) || DeclFileName != Parser->FileName ||
+            DeclLine != Parser->Line || DeclColumn != Parser->CharacterPos ||
+            ExistingValue->Typ != Typ) {
+        TableDelete(pc, &pc->StaticTable, Site);
+        ExistingValue = VariableStaticGlobal(Parser, Ident, Typ, FirstVisit);
+        TableSet(pc, &pc->StaticTable, Site, ExistingValue, Parser->FileName,
+            Parser->Line, Parser->CharacterPos);
+    }
+
+    /* make a mirroring variable in our own scope with the short name.
+        it lives on the stack so it goes away with the function call */
+    LocalValue = VariableAllocValueFromExistingData(Parser, ExistingValue->Typ,
+        ExistingValue->Val, true, NULL);
+    LocalValue->ScopeID = Parser->ScopeID;
+    if (!TableSet(pc, &THREAD(pc)->TopStackFrame->LocalTable, Ident, LocalValue,
+            Parser->FileName, Parser->Line, Parser->CharacterPos))
+        ProgramFail(Parser, "'%s' is already defined", Ident);
+
+    return ExistingValue;
+}
+
 /* define a variable. Ident must be registered. If it's a redefinition
     from the same declaration don't throw an error */
 struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser,
@@ -330,42 +596,14 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser,
     if (TypeIsForwardDeclared(Parser, Typ))
         ProgramFail(Parser, "type '%t' isn't defined", Typ);
 
-    if (IsStatic) {
-        char MangledName[LINEBUFFER_MAX];
-        char *MNPos = &MangledName[0];
-        char *MNEnd = &MangledName[LINEBUFFER_MAX-1];
-        const char *RegisteredMangledName;
-
-        /* make the mangled static name (avoiding using sprintf()
-            to minimise library impact) */
-        memset((void*)&MangledName, '\0', sizeof(MangledName));
-        *MNPos++ = '/';
-        strncpy(MNPos, (char*)Parser->FileName, MNEnd - MNPos);
-        MNPos += strlen(MNPos);
-
-        if (pc->TopStackFrame != NULL) {
-            /* we're inside a function */
-            if (MNEnd - MNPos > 0)
-                *MNPos++ = '/';
-            strncpy(MNPos, (char*)pc->TopStackFrame->FuncName, MNEnd - MNPos);
-            MNPos += strlen(MNPos);
-        }
-
-        if (MNEnd - MNPos > 0) *MNPos++ = '/';
-        strncpy(MNPos, Ident, MNEnd - MNPos);
-        RegisteredMangledName = TableStrRegister(pc, MangledName);
-
-        /* is this static already defined? */
-        if (!TableGet(&pc->GlobalTable, RegisteredMangledName, &ExistingValue,
-                &DeclFileName, &DeclLine, &DeclColumn)) {
-            /* define the mangled-named static variable store in the global scope */
-            ExistingValue = VariableAllocValueFromType(Parser->pc, Parser, Typ,
-                true, NULL, true);
-            TableSet(pc, &pc->GlobalTable, (char*)RegisteredMangledName,
-                ExistingValue, (char *)Parser->FileName, Parser->Line,
-                Parser->CharacterPos);
-            *FirstVisit = true;
-        }
+    if (IsStatic && THREAD(pc)->TopStackFrame != NULL) {
+        /* statics are shared by all the program's threads */
+        ThreadLock(pc);
+        ExistingValue = VariableDefineLocalStatic(Parser, Ident, Typ, FirstVisit);
+        ThreadUnlock(pc);
+        return ExistingValue;
+    } else if (IsStatic) {
+        ExistingValue = VariableStaticGlobal(Parser, Ident, Typ, FirstVisit);
 
         /* static variable exists in the global scope - now make a
             mirroring variable in our own scope with the short name */
@@ -373,8 +611,8 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser,
             ExistingValue->Val, true);
         return ExistingValue;
     } else {
-        if (Parser->Line != 0 && TableGet((pc->TopStackFrame == NULL) ?
-                    &pc->GlobalTable : &pc->TopStackFrame->LocalTable, Ident,
+        if (Parser->Line != 0 && TableGet((THREAD(pc)->TopStackFrame == NULL) ?
+                    &pc->GlobalTable : &THREAD(pc)->TopStackFrame->LocalTable, Ident,
                     &ExistingValue, &DeclFileName, &DeclLine, &DeclColumn)
                 && DeclFileName == Parser->FileName && DeclLine == Parser->Line &&
                 DeclColumn == Parser->CharacterPos)
@@ -384,14 +622,38 @@ struct Value *VariableDefineButIgnoreIdentical(struct ParseState *Parser,
     }
 }
 
+/* find a global, defining it first if it's a library function which
+    hasn't been used yet or comes from a header which hasn't been loaded.
+    if MustExist is set any header might do */
+static int VariableGetGlobal(Picoc *pc, const char *Ident, struct Value **Val,
+    int MustExist)
+{
+    int Found;
+
+    if (TableGet(&pc->GlobalTable, Ident, Val, NULL, NULL, NULL))
+        return true;
+
+    /* another thread may be defining it too, so look again once we've
+        got the lock */
+    ThreadLock(pc);
+    Found = TableGet(&pc->GlobalTable, Ident, Val, NULL, NULL, NULL);
+    if (!Found && (LibraryResolve(pc, Ident) ||
+            IncludeResolve(pc, Ident, MustExist)))
+        Found = VariableGetGlobal(pc, Ident, Val, MustExist);
+    ThreadUnlock(pc);
+
+    return Found;
+}
+
 /* check if a variable with a given name is defined. Ident must be registered */
 int VariableDefined(Picoc *pc, const char *Ident)
 {
     struct Value *FoundValue;
+    struct StackFrame *Frame = THREAD(pc)->TopStackFrame;
 
-    if (pc->TopStackFrame == NULL || !TableGet(&pc->TopStackFrame->LocalTable,
-            Ident, &FoundValue, NULL, NULL, NULL)) {
-        if (!TableGet(&pc->GlobalTable, Ident, &FoundValue, NULL, NULL, NULL))
+    if (Frame == NULL || !TableGet(&Frame->LocalTable, Ident, &FoundValue,
+            NULL, NULL, NULL)) {
+        if (!VariableGetGlobal(pc, Ident, &FoundValue, false))
             return false;
     }
 
@@ -402,9 +664,11 @@ int VariableDefined(Picoc *pc, const char *Ident)
 void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident,
     struct Value **LVal)
 {
-    if (pc->TopStackFrame == NULL || !TableGet(&pc->TopStackFrame->LocalTable,
-            Ident, LVal, NULL, NULL, NULL)) {
-        if (!TableGet(&pc->GlobalTable, Ident, LVal, NULL, NULL, NULL)) {
+    struct StackFrame *Frame = THREAD(pc)->TopStackFrame;
+
+    if (Frame == NULL || !TableGet(&Frame->LocalTable, Ident, LVal,
+            NULL, NULL, NULL)) {
+        if (!VariableGetGlobal(pc, Ident, LVal, true)) {
             if (VariableDefinedAndOutOfScope(pc, Ident))
                 ProgramFail(Parser, "'%s' is out of scope", Ident);
             else
@@ -417,13 +681,13 @@ void VariableGet(Picoc *pc, struct ParseState *Parser, const char *Ident,
 void VariableDefinePlatformVar(Picoc *pc, struct ParseState *Parser, char *Ident,
     struct ValueType *Typ, union AnyValue *FromValue, int IsWritable)
 {
+    struct StackFrame *Frame = THREAD(pc)->TopStackFrame;
     struct Value *SomeValue = VariableAllocValueAndData(pc, NULL, 0, IsWritable,
         NULL, true);
     SomeValue->Typ = Typ;
     SomeValue->Val = FromValue;
 
-    if (!TableSet(pc,
-            (pc->TopStackFrame == NULL) ? &pc->GlobalTable : &pc->TopStackFrame->LocalTable,
+    if (!TableSet(pc, (Frame == NULL) ? &pc->GlobalTable : &Frame->LocalTable,
             TableStrRegister(pc, Ident), SomeValue,
             Parser ? Parser->FileName : NULL,
             Parser ? Parser->Line : 0, Parser ? Parser->CharacterPos : 0))
@@ -457,39 +721,100 @@ void VariableStackPop(struct ParseState *Parser, struct Value *Var)
         ProgramFail(Parser, "stack underrun");
 }
 
+/* calls, blocks and expressions each nest deeper into the native stack, so
+    stop cleanly before the host runs out of it */
+void VariableCheckNativeStack(struct ParseState *Parser)
+{
+    char StackMarker;
+    struct ThreadState *Thread = THREAD(Parser->pc);
+    char *StackBase = Thread->NativeStackBase;
+    size_t StackUsed;
+
+    if (StackBase == NULL)
+        return;
+
+    StackUsed = (StackBase > &StackMarker) ?
+        (size_t)(StackBase - &StackMarker) : (size_t)(&StackMarker - StackBase);
+    if (StackUsed > Thread->NativeStackLimit)
+        VariableStackOverflow(Parser->pc, Parser);
+}
+
 /* add a stack frame when doing a function call */
 void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName,
     int NumParams)
 {
+    struct ThreadState *Thread = THREAD(Parser->pc);
     struct StackFrame *NewFrame;
 
+    VariableCheckNativeStack(Parser);
     HeapPushStackFrame(Parser->pc);
     NewFrame = HeapAllocStack(Parser->pc,
         sizeof(struct StackFrame)+sizeof(struct Value*)*NumParams);
     if (NewFrame == NULL)
-        ProgramFail(Parser, "(VariableStackFrameAdd) out of memory");
+        VariableStackOverflow(Parser->pc, Parser);
 
     ParserCopy(&NewFrame->ReturnParser, Parser);
     NewFrame->FuncName = FuncName;
     NewFrame->Parameter = (NumParams > 0) ?
         ((void*)((char*)NewFrame+sizeof(struct StackFrame))) : NULL;
     TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalHashTable[0],
-        LOCAL_TABLE_SIZE, false);
-    NewFrame->PreviousStackFrame = Parser->pc->TopStackFrame;
-    Parser->pc->TopStackFrame = NewFrame;
+        LOCAL_TABLE_SIZE);
+    NewFrame->PreviousStackFrame = Thread->TopStackFrame;
+    NewFrame->Depth = (Thread->TopStackFrame != NULL) ?
+        Thread->TopStackFrame->Depth + 1 : 1;
+    if (NewFrame->Depth > Thread->PeakFrameDepth)
+        Thread->PeakFrameDepth = NewFrame->Depth;
+    Thread->TopStackFrame = NewFrame;
+
+    if (Parser->pc->Profile != NULL)
+        ProfileEnter(Parser->pc, FuncName, NewFrame);
+}
+
+/* count the frames on the stack */
+int VariableStackFrameDepth(Picoc *pc)
+{
+    struct StackFrame *Frame = THREAD(pc)->TopStackFrame;
+
+    return (Frame != NULL) ? Frame->Depth : 0;
 }
 
 /* remove a stack frame */
 void VariableStackFramePop(struct ParseState *Parser)
 {
-    if (Parser->pc->TopStackFrame == NULL)
+    struct ThreadState *Thread = THREAD(Parser->pc);
+
+    if (Thread->TopStackFrame == NULL)
         ProgramFail(Parser, "stack is empty - can't go back");
 
-    ParserCopy(Parser, &Parser->pc->TopStackFrame->ReturnParser);
-    Parser->pc->TopStackFrame = Parser->pc->TopStackFrame->PreviousStackFrame;
+    if (Parser->pc->Profile != NULL)
+        ProfileLeave(Parser->pc, Thread->TopStackFrame);
+
+    ParserCopy(Parser, &Thread->TopStackFrame->ReturnParser);
+    TableFree(Parser->pc, &Thread->TopStackFrame->LocalTable);
+    Thread->TopStackFrame = Thread->TopStackFrame->PreviousStackFrame;
     HeapPopStackFrame(Parser->pc);
 }
 
+/* pop the stack frames a call left behind when it failed or was abandoned
+    part way through, back to TopStackFrame, and put the stack back where
+    it was before the call */
+void VariableStackUnwind(struct ThreadState *Thread,
+    struct StackFrame *TopStackFrame, void *StackFrame, void *HeapStackTop)
+{
+    Picoc *pc = Thread->pc;
+
+    while (Thread->TopStackFrame != TopStackFrame) {
+        if (pc->Profile != NULL)
+            ProfileLeave(pc, Thread->TopStackFrame);
+
+        TableFree(pc, &Thread->TopStackFrame->LocalTable);
+        Thread->TopStackFrame = Thread->TopStackFrame->PreviousStackFrame;
+    }
+
+    Thread->StackFrame = StackFrame;
+    Thread->HeapStackTop = HeapStackTop;
+}
+
 /* get a string literal. assumes that Ident is already
     registered. NULL if not found */
 struct Value *VariableStringLiteralGet(Picoc *pc, char *Ident)